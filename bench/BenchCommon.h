@@ -0,0 +1,166 @@
+#pragma once
+// Helpers shared by the headless tools in bench/
+#include "ForceCalculator.h"
+#include "AutoCalculator.h"
+#include "BarnesHutCalculator.h"
+#include "InitialConditions.h"
+#include "Parallel.h"
+#include "SpaceFillingCurve.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <ctime>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace Bench {
+    constexpr double G = 39.478; // AU³/(M☉·year²)
+    constexpr double kDefaultSoftening = 0.001; // AU, same as the viewer
+
+    template <typename T, typename Parse>
+    std::vector<T> parseList(const std::string& text, Parse parse) {
+        std::vector<T> out;
+        std::stringstream ss(text);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            if (!item.empty()) out.push_back(parse(item));
+        }
+        return out;
+    }
+
+    inline std::vector<std::string> parseNames(const std::string& text) {
+        return parseList<std::string>(text, [](const std::string& s) { return s; });
+    }
+
+    // Accepts "1e6" as well as "1000000"
+    inline std::vector<size_t> parseCounts(const std::string& text) {
+        return parseList<size_t>(text, [](const std::string& s) { return static_cast<size_t>(std::stod(s)); });
+    }
+
+    inline size_t peakResidentBytes() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS pmc;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return pmc.PeakWorkingSetSize;
+        return 0;
+#else
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+        return static_cast<size_t>(usage.ru_maxrss);        // bytes
+#else
+        return static_cast<size_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+    }
+
+    // Equal masses spread uniformly over a 20 AU square, at rest
+    inline std::vector<MassObject> generateUniform(size_t count, uint64_t seed) {
+        std::vector<MassObject> bodies(count);
+        const double mass = 1.0 / static_cast<double>(std::max<size_t>(count, 1));
+        Parallel::parallelFor(0, count, 1 << 14, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                CounterRng rng(seed, i);
+                float x = static_cast<float>(20.0 * rng.uniform() - 10.0);
+                float y = static_cast<float>(20.0 * rng.uniform() - 10.0);
+                bodies[i] = MassObject(mass, glm::vec2(x, y), glm::vec2(0.0f));
+            }
+        });
+        return bodies;
+    }
+
+    // The viewer's solar system plus a Kepler belt of test particles, 'count' bodies in total
+    inline std::vector<MassObject> generateBelt(size_t count, uint64_t seed) {
+        std::vector<MassObject> bodies = InitialConditions::exampleSolarSystem();
+        const size_t planets = bodies.size();
+        std::vector<MassObject> belt = InitialConditions::generateKeplerBelt(count > planets ? count - planets : 0,
+                                                                             2.1, 3.3, 1e-10, 0.1, 1.0, G, seed);
+        for (MassObject& body : belt) body.setTestParticle(true);
+        bodies.insert(bodies.end(), belt.begin(), belt.end());
+        bodies.resize(std::min(bodies.size(), count));
+        return bodies;
+    }
+
+    // "uniform", "plummer", "disk" (clustered exponential disk around a central mass) or "belt"
+    // (test particles around a few planets)
+    inline std::vector<MassObject> generateBodies(const std::string& distribution, size_t count, uint64_t seed) {
+        if (distribution == "belt") return generateBelt(count, seed);
+        if (distribution == "plummer") return InitialConditions::generatePlummer(count, 1.0, 5.0, G, seed);
+        if (distribution == "disk") return InitialConditions::generateExponentialDisk(count, 0.1, 3.0, 1.0, G, seed);
+        return generateUniform(count, seed);
+    }
+
+    // Storage order of the generated bodies: "none" (as generated), "morton" or "hilbert"
+    // False for unknown names
+    inline bool orderBodies(std::vector<MassObject>& bodies, const std::string& order) {
+        if (order == "none") return true;
+        if (order != "morton" && order != "hilbert") return false;
+        const auto curve = order == "hilbert" ? SpaceFillingCurve::Curve::Hilbert : SpaceFillingCurve::Curve::Morton;
+        const std::vector<size_t> slots = SpaceFillingCurve::sortOrder(bodies, curve);
+        std::vector<MassObject> sorted;
+        sorted.reserve(bodies.size());
+        for (size_t slot : slots) sorted.push_back(bodies[slot]);
+        bodies.swap(sorted);
+        return true;
+    }
+
+    // Calculator names: "brute", "bh<theta>", "bh<theta>r" (tree reuse, see --advance in nbody-bench),
+    // "bh<theta>f<leafSize>" (flat tree), "bh<theta>d<leafSize>" (dual tree) or "auto<error target>", optionally followed by
+    // "@<softening>" (e.g. bh0.5@0.01, auto0.05). Opening criteria go after theta: b (bmax), a<alpha>
+    // (relative acceleration), x (box check), e.g. bh0.5bf8. Returns nullptr for unknown names
+    inline std::unique_ptr<ForceCalculator> makeCalculator(const std::string& name) {
+        std::string kind = name;
+        double softening = kDefaultSoftening;
+        size_t at = name.find('@');
+        if (at != std::string::npos) {
+            kind = name.substr(0, at);
+            softening = std::stod(name.substr(at + 1));
+        }
+
+        if (kind.rfind("auto", 0) == 0) {
+            double target = kind.size() > 4 ? std::stod(kind.substr(4)) : 0.1;
+            auto calculator = std::make_unique<AutoCalculator>(G, softening, target);
+            calculator->setCachePath(""); // measure in every run
+            return calculator;
+        }
+        return AutoCalculator::createCandidate(kind, G, softening);
+    }
+
+    // O(N²) calculators are skipped above a size limit
+    inline bool isQuadratic(const std::string& name) { return name.rfind("brute", 0) == 0; }
+
+    inline double median(std::vector<double> v) {
+        if (v.empty()) return 0.0;
+        std::sort(v.begin(), v.end());
+        return v[v.size() / 2];
+    }
+
+    inline std::string compilerName() {
+#if defined(_MSC_VER)
+        return "MSVC " + std::to_string(_MSC_VER);
+#elif defined(__clang__)
+        return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+        return std::string("gcc ") + __VERSION__;
+#else
+        return "unknown";
+#endif
+    }
+
+    inline std::string timestamp() {
+        std::time_t now = std::time(nullptr);
+        char buffer[32];
+        std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+        return buffer;
+    }
+}
@@ -0,0 +1,427 @@
+// nbody-bench: sweeps body count, initial distribution, force calculator and thread count
+// and reports per-case timings as a table, JSON and/or CSV.
+//
+// usage: nbody-bench [--n 100,1000,10000] [--dist uniform,plummer,disk,belt] [--order none,hilbert]
+//                    [--calc brute,bh0.3,bh0.5,bh0.8]
+//                    [--threads 1,4] [--reps 3] [--brute-max 20000] [--seed 1]
+//                    [--json results.json] [--csv results.csv] [--stats phases.jsonl] [--trace trace.json]
+//                    [--counters] [--advance] [--pin] [--deterministic]
+//
+// --threads sets the threads per parallel loop (the caller plus n - 1 scheduler workers), --pin
+// pins the workers to CPUs, see TaskScheduler.h.
+//
+// Every case reports a hash of its first force evaluation; a case whose hash differs from the
+// same case at the first thread count is reported, forces must not depend on the thread count.
+// --deterministic turns on Parallel::setDeterministic.
+//
+// --counters adds Linux hardware counters (cycles, instructions, cache/branch misses, FP ops)
+// per phase: the whole force call, the tree build and walk, and the integrator.
+//
+// --advance moves the bodies by one Verlet step between force repetitions, so calculators that
+// reuse state across calls (bh<theta>r) are timed on a moving system rather than a frozen one.
+//
+// --order sorts the generated bodies along a space-filling curve (none, morton, hilbert) before
+// timing, the generators emit bodies in random spatial order.
+//
+// Calculator names: "brute", "bh<theta>[b|a<alpha>][x][r|f<leafSize>|d<leafSize>][@softening]" (e.g. bh0.5, bh0.5f8,
+// bh0.5a0.001f8), see Bench::makeCalculator().
+#include "BenchCommon.h"
+#include "Integrator.h"
+#include "PerfCounters.h"
+#include "Profiler.h"
+#include "TaskScheduler.h"
+#include "Trace.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <thread>
+
+using namespace Bench;
+
+namespace {
+    constexpr double kTimestep = 0.0001; // years, same as the viewer
+
+    struct Options {
+        std::vector<size_t> counts = { 100, 1000, 10000, 100000, 1000000 };
+        std::vector<std::string> distributions = { "uniform", "plummer", "disk" };
+        std::vector<std::string> orders = { "none" };
+        std::vector<std::string> calculators = { "brute", "bh0.3", "bh0.5", "bh0.8" };
+        std::vector<unsigned> threads;
+        unsigned reps = 3;
+        size_t bruteMax = 20000; // larger N is skipped for O(N²) calculators
+        uint64_t seed = 1;
+        std::string jsonPath;
+        std::string csvPath;
+        std::string statsPath; // per-rep phase timings as JSON lines
+        std::string tracePath; // Chrome trace of the whole run
+        bool counters = false;
+        bool advance = false;  // integrate between force repetitions
+        bool pin = false;      // pin scheduler workers
+        bool deterministic = false;
+    };
+
+    struct Result {
+        size_t n = 0;
+        std::string distribution;
+        std::string order;             // body storage order, see orderBodies()
+        std::string calculator;
+        unsigned threads = 0;
+        unsigned reps = 0;
+        double forceSeconds = 0.0;     // median over reps
+        double integrateSeconds = 0.0; // median over reps (Verlet)
+        uint64_t interactions = 0;
+        double nsPerInteraction = 0.0;
+        double bodiesPerSecond = 0.0;  // n / (force + integrate)
+        double buildSeconds = 0.0;     // tree calculators only
+        double finalizeSeconds = 0.0;
+        double walkSeconds = 0.0;
+        size_t treeNodes = 0;
+        uint64_t forceHash = 0;        // bits of the first evaluation's accelerations
+        size_t treeBytes = 0;
+        uint64_t nodeBody = 0;         // opening statistics of the last rep
+        uint64_t bodyBody = 0;
+        uint64_t cellCell = 0;         // dual-tree accepted cell pairs
+        uint64_t nodesVisited = 0;
+        uint32_t maxDepth = 0;
+        size_t peakRssBytes = 0;       // process peak after this case (cases run in increasing N)
+        bool hasCounters = false;      // mean per rep
+        PerfCounters::Values forceCounters{};
+        PerfCounters::Values buildCounters{};
+        PerfCounters::Values walkCounters{};
+        PerfCounters::Values integrateCounters{};
+    };
+
+    // Counter blocks written per result, in JSON/CSV order
+    struct CounterPhase {
+        const char* name;
+        PerfCounters::Values Result::* values;
+    };
+    const CounterPhase kCounterPhases[] = {
+        { "forces", &Result::forceCounters },
+        { "tree_build", &Result::buildCounters },
+        { "force_walk", &Result::walkCounters },
+        { "integrate", &Result::integrateCounters },
+    };
+
+    void accumulate(PerfCounters::Values& total, const PerfCounters::Values& delta) {
+        for (size_t i = 0; i < PerfCounters::kCounterCount; ++i) total[i] += delta[i];
+    }
+
+    void divide(PerfCounters::Values& total, unsigned reps) {
+        for (uint64_t& v : total) v /= reps;
+    }
+
+    // Events per thousand instructions
+    double perKiloInstruction(const PerfCounters::Values& v, PerfCounters::Counter counter) {
+        uint64_t instructions = v[static_cast<size_t>(PerfCounters::Counter::Instructions)];
+        return instructions ? 1000.0 * static_cast<double>(v[static_cast<size_t>(counter)]) / static_cast<double>(instructions) : 0.0;
+    }
+
+    std::string summarizeCounters(const PerfCounters::Values& v) {
+        using PerfCounters::Counter;
+        uint64_t cycles = v[static_cast<size_t>(Counter::Cycles)];
+        uint64_t instructions = v[static_cast<size_t>(Counter::Instructions)];
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2) << "IPC " << (cycles ? static_cast<double>(instructions) / static_cast<double>(cycles) : 0.0)
+            << "  L1D/ki " << perKiloInstruction(v, Counter::L1DMisses)
+            << "  LLC/ki " << perKiloInstruction(v, Counter::LLCMisses)
+            << "  br/ki " << perKiloInstruction(v, Counter::BranchMisses);
+        if (PerfCounters::isAvailable(Counter::FpPacked)) {
+            double packed = static_cast<double>(v[static_cast<size_t>(Counter::FpPacked)]);
+            double total = packed + static_cast<double>(v[static_cast<size_t>(Counter::FpScalar)]);
+            out << "  packed FP " << std::setprecision(0) << (total > 0.0 ? 100.0 * packed / total : 0.0) << "%";
+        }
+        return out.str();
+    }
+
+    // FNV-1a over the force bits
+    uint64_t hashForces(const std::vector<glm::vec2>& forces) {
+        uint64_t hash = 1469598103934665603ull;
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(forces.data());
+        for (size_t i = 0; i < forces.size() * sizeof(glm::vec2); ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    Result runCase(const std::vector<MassObject>& initial, const std::string& distribution, const std::string& order,
+                   const std::string& calculatorName, unsigned threads, unsigned reps, bool advance) {
+        using clock = std::chrono::steady_clock;
+        Result r;
+        std::vector<MassObject> bodies = initial;
+        VerletIntegrator stepper;
+        r.n = bodies.size();
+        r.distribution = distribution;
+        r.order = order;
+        r.calculator = calculatorName;
+        r.threads = threads;
+        r.reps = reps;
+
+        Parallel::setThreadCount(threads);
+        std::unique_ptr<ForceCalculator> calculator = makeCalculator(calculatorName);
+        const BarnesHutCalculator* tree = dynamic_cast<const BarnesHutCalculator*>(calculator.get());
+
+        // The engine's call: accelerations, test particles straight from their kernel
+        std::vector<glm::vec2> accelerations = calculator->calculateAccelerations(bodies); // warm-up
+        r.forceHash = hashForces(accelerations);
+        if (advance) stepper.integrate(bodies, accelerations, kTimestep);
+        Profiler::endFrame(); // keep the warm-up out of the first rep's phase totals
+
+        std::vector<double> forceTimes, buildTimes, finalizeTimes, walkTimes;
+        PerfCounters::Values before, after;
+        r.hasCounters = PerfCounters::isOpen();
+        for (unsigned rep = 0; rep < reps; ++rep) {
+            PerfCounters::read(before);
+            auto start = clock::now();
+            accelerations = calculator->calculateAccelerations(bodies);
+            forceTimes.push_back(std::chrono::duration<double>(clock::now() - start).count());
+            if (PerfCounters::read(after)) accumulate(r.forceCounters, PerfCounters::difference(after, before));
+            if (advance) stepper.integrate(bodies, accelerations, kTimestep);
+            Profiler::endFrame(); // one stats line per rep
+            if (r.hasCounters) {
+                accumulate(r.buildCounters, Profiler::getStats(Profiler::Phase::TreeBuild).lastFrameCounters);
+                accumulate(r.walkCounters, Profiler::getStats(Profiler::Phase::ForceWalk).lastFrameCounters);
+            }
+            if (tree) {
+                buildTimes.push_back(tree->getLastStats().buildSeconds);
+                finalizeTimes.push_back(tree->getLastStats().finalizeSeconds);
+                walkTimes.push_back(tree->getLastStats().walkSeconds);
+            }
+        }
+        r.forceSeconds = median(forceTimes);
+        r.interactions = calculator->getLastInteractionCount();
+        if (tree) {
+            r.buildSeconds = median(buildTimes);
+            r.finalizeSeconds = median(finalizeTimes);
+            r.walkSeconds = median(walkTimes);
+            r.treeNodes = tree->getLastStats().nodeCount;
+            r.treeBytes = tree->getLastStats().treeBytes;
+            r.nodeBody = tree->getLastStats().nodeBodyInteractions;
+            r.bodyBody = tree->getLastStats().bodyBodyInteractions;
+            r.cellCell = tree->getLastStats().cellCellInteractions;
+            r.nodesVisited = tree->getLastStats().nodesVisited;
+            r.maxDepth = tree->getLastStats().maxDepth;
+        }
+
+        // Integrator cost on a scratch copy, the accelerations stay fixed
+        std::vector<MassObject> work = bodies;
+        VerletIntegrator integrator;
+        integrator.integrate(work, accelerations, kTimestep);
+        std::vector<double> integrateTimes;
+        for (unsigned rep = 0; rep < reps; ++rep) {
+            PerfCounters::read(before);
+            auto start = clock::now();
+            integrator.integrate(work, accelerations, kTimestep);
+            integrateTimes.push_back(std::chrono::duration<double>(clock::now() - start).count());
+            if (PerfCounters::read(after)) accumulate(r.integrateCounters, PerfCounters::difference(after, before));
+        }
+        r.integrateSeconds = median(integrateTimes);
+        if (r.hasCounters) {
+            for (const CounterPhase& phase : kCounterPhases) divide(r.*phase.values, reps);
+        }
+
+        if (r.interactions > 0) r.nsPerInteraction = r.forceSeconds * 1e9 / static_cast<double>(r.interactions);
+        const double stepSeconds = r.forceSeconds + r.integrateSeconds;
+        if (stepSeconds > 0.0) r.bodiesPerSecond = static_cast<double>(r.n) / stepSeconds;
+        r.peakRssBytes = peakResidentBytes();
+        return r;
+    }
+
+    void writeJson(const std::string& path, const std::vector<Result>& results) {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Failed to open " << path << "\n";
+            return;
+        }
+        out << std::setprecision(9);
+        out << "{\n  \"timestamp\": \"" << timestamp() << "\",\n"
+            << "  \"compiler\": \"" << compilerName() << "\",\n"
+            << "  \"hardwareThreads\": " << std::thread::hardware_concurrency() << ",\n"
+            << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            out << "    {\"n\": " << r.n << ", \"distribution\": \"" << r.distribution << "\", \"order\": \"" << r.order << "\", \"calculator\": \"" << r.calculator
+                << "\", \"threads\": " << r.threads << ", \"reps\": " << r.reps
+                << ", \"forceSeconds\": " << r.forceSeconds << ", \"integrateSeconds\": " << r.integrateSeconds
+                << ", \"interactions\": " << r.interactions << ", \"nsPerInteraction\": " << r.nsPerInteraction
+                << ", \"bodiesPerSecond\": " << r.bodiesPerSecond
+                << ", \"buildSeconds\": " << r.buildSeconds << ", \"finalizeSeconds\": " << r.finalizeSeconds
+                << ", \"walkSeconds\": " << r.walkSeconds << ", \"treeNodes\": " << r.treeNodes
+                << ", \"treeBytes\": " << r.treeBytes << ", \"nodeBody\": " << r.nodeBody << ", \"bodyBody\": " << r.bodyBody << ", \"cellCell\": " << r.cellCell
+                << ", \"nodesVisited\": " << r.nodesVisited << ", \"maxDepth\": " << r.maxDepth
+                << ", \"peakRssBytes\": " << r.peakRssBytes << ", \"forceHash\": \"" << std::hex << r.forceHash << std::dec << '"';
+            if (r.hasCounters) {
+                out << ", \"counters\": {";
+                for (size_t p = 0; p < std::size(kCounterPhases); ++p) {
+                    const PerfCounters::Values& values = r.*kCounterPhases[p].values;
+                    out << (p ? ", " : "") << '"' << kCounterPhases[p].name << "\": {";
+                    bool first = true;
+                    for (size_t c = 0; c < PerfCounters::kCounterCount; ++c) {
+                        PerfCounters::Counter counter = static_cast<PerfCounters::Counter>(c);
+                        if (!PerfCounters::isAvailable(counter)) continue;
+                        out << (first ? "" : ", ") << '"' << PerfCounters::getCounterName(counter) << "\": " << values[c];
+                        first = false;
+                    }
+                    out << "}";
+                }
+                out << "}";
+            }
+            out << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+    }
+
+    void writeCsv(const std::string& path, const std::vector<Result>& results) {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Failed to open " << path << "\n";
+            return;
+        }
+        out << std::setprecision(9);
+        out << "n,distribution,order,calculator,threads,reps,force_s,integrate_s,interactions,ns_per_interaction,bodies_per_s,"
+               "build_s,finalize_s,walk_s,tree_nodes,tree_bytes,node_body,body_body,cell_cell,nodes_visited,max_depth,peak_rss_bytes,force_hash";
+        // Counter columns are always present (zero without --counters), e.g. forces_cycles
+        for (const CounterPhase& phase : kCounterPhases) {
+            for (size_t c = 0; c < PerfCounters::kCounterCount; ++c) {
+                out << ',' << phase.name << '_' << PerfCounters::getCounterName(static_cast<PerfCounters::Counter>(c));
+            }
+        }
+        out << '\n';
+        for (const Result& r : results) {
+            out << r.n << ',' << r.distribution << ',' << r.order << ',' << r.calculator << ',' << r.threads << ',' << r.reps << ','
+                << r.forceSeconds << ',' << r.integrateSeconds << ',' << r.interactions << ',' << r.nsPerInteraction << ','
+                << r.bodiesPerSecond << ',' << r.buildSeconds << ',' << r.finalizeSeconds << ',' << r.walkSeconds << ','
+                << r.treeNodes << ',' << r.treeBytes << ',' << r.nodeBody << ',' << r.bodyBody << ',' << r.cellCell << ','
+                << r.nodesVisited << ',' << r.maxDepth << ',' << r.peakRssBytes << ',' << std::hex << r.forceHash << std::dec;
+            for (const CounterPhase& phase : kCounterPhases) {
+                for (uint64_t value : r.*phase.values) out << ',' << value;
+            }
+            out << '\n';
+        }
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--n" && hasValue) options.counts = parseCounts(argv[++i]);
+            else if (arg == "--dist" && hasValue) options.distributions = parseNames(argv[++i]);
+            else if (arg == "--order" && hasValue) options.orders = parseNames(argv[++i]);
+            else if (arg == "--calc" && hasValue) options.calculators = parseNames(argv[++i]);
+            else if (arg == "--threads" && hasValue) options.threads = parseList<unsigned>(argv[++i], [](const std::string& s) { return static_cast<unsigned>(std::stoul(s)); });
+            else if (arg == "--reps" && hasValue) options.reps = std::max(1u, static_cast<unsigned>(std::stoul(argv[++i])));
+            else if (arg == "--brute-max" && hasValue) options.bruteMax = static_cast<size_t>(std::stod(argv[++i]));
+            else if (arg == "--seed" && hasValue) options.seed = std::stoull(argv[++i]);
+            else if (arg == "--json" && hasValue) options.jsonPath = argv[++i];
+            else if (arg == "--csv" && hasValue) options.csvPath = argv[++i];
+            else if (arg == "--stats" && hasValue) options.statsPath = argv[++i];
+            else if (arg == "--trace" && hasValue) options.tracePath = argv[++i];
+            else if (arg == "--counters") options.counters = true;
+            else if (arg == "--advance") options.advance = true;
+            else if (arg == "--pin") options.pin = true;
+            else if (arg == "--deterministic") options.deterministic = true;
+            else {
+                std::cerr << "Unknown option " << arg << "\n"
+                          << "usage: nbody-bench [--n list] [--dist uniform,plummer,disk,belt] [--order none,morton,hilbert]\n"
+                          << "                   [--calc brute,bh<theta>[@soft],...]\n"
+                          << "                   [--threads list] [--reps k] [--brute-max N] [--seed s] [--json file] [--csv file] [--stats file] [--trace file]\n"
+                          << "                   [--counters] [--advance] [--pin] [--deterministic]\n";
+                return false;
+            }
+        }
+        for (const std::string& order : options.orders) {
+            std::vector<MassObject> none;
+            if (!orderBodies(none, order)) {
+                std::cerr << "Unknown order " << order << "\n";
+                return false;
+            }
+        }
+        for (const std::string& name : options.calculators) {
+            if (!makeCalculator(name)) {
+                std::cerr << "Unknown calculator " << name << "\n";
+                return false;
+            }
+        }
+        if (options.threads.empty()) {
+            unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+            options.threads = { 1 };
+            if (hw > 1) options.threads.push_back(hw);
+        }
+        std::sort(options.counts.begin(), options.counts.end()); // peak RSS is only meaningful in increasing N
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) return 1;
+    TaskScheduler::setPinning(options.pin);
+    Parallel::setDeterministic(options.deterministic);
+    if (!options.statsPath.empty()) Profiler::openStatsStream(options.statsPath);
+    if (options.counters && !PerfCounters::open()) {
+        std::cerr << "Continuing without hardware counters\n";
+    }
+    if (!options.tracePath.empty()) {
+        Trace::setThreadName("bench");
+        Trace::start();
+    }
+
+    std::vector<Result> results;
+    std::cout << std::left << std::setw(9) << "N" << std::setw(9) << "dist" << std::setw(9) << "order" << std::setw(10) << "calc" << std::setw(5) << "thr"
+              << std::setw(12) << "force ms" << std::setw(10) << "ns/int" << std::setw(13) << "bodies/s"
+              << std::setw(22) << "build/fin/walk ms" << "peak MB\n";
+
+    for (size_t n : options.counts) {
+        for (const std::string& distribution : options.distributions) {
+            Parallel::setThreadCount(0);
+            const std::vector<MassObject> generated = generateBodies(distribution, n, options.seed);
+
+            for (const std::string& order : options.orders) {
+                std::vector<MassObject> bodies = generated;
+                orderBodies(bodies, order);
+
+                for (const std::string& calculator : options.calculators) {
+                    // Belt bodies are test particles, brute force is linear in N there
+                    if (isQuadratic(calculator) && n > options.bruteMax && distribution != "belt") continue;
+
+                    const size_t firstThreadCase = results.size();
+                    for (unsigned threads : options.threads) {
+                        Result r = runCase(bodies, distribution, order, calculator, threads, options.reps, options.advance);
+                        results.push_back(r);
+                        if (r.forceHash != results[firstThreadCase].forceHash) {
+                            std::cerr << "Forces of " << calculator << " on " << threads << " threads differ from "
+                                      << results[firstThreadCase].threads << " threads\n";
+                        }
+
+                        std::ostringstream split;
+                        split << std::fixed << std::setprecision(1) << r.buildSeconds * 1e3 << "/" << r.finalizeSeconds * 1e3 << "/" << r.walkSeconds * 1e3;
+                        std::cout << std::left << std::setw(9) << r.n << std::setw(9) << r.distribution << std::setw(9) << r.order << std::setw(10) << r.calculator
+                                  << std::setw(5) << r.threads << std::setw(12) << std::fixed << std::setprecision(3) << r.forceSeconds * 1e3
+                                  << std::setw(10) << std::setprecision(2) << r.nsPerInteraction
+                                  << std::setw(13) << std::scientific << std::setprecision(3) << r.bodiesPerSecond << std::fixed
+                                  << std::setw(22) << (r.treeNodes ? split.str() : "-")
+                                  << std::setprecision(1) << static_cast<double>(r.peakRssBytes) / (1024.0 * 1024.0) << "\n";
+                        if (r.hasCounters) {
+                            std::cout << "    forces     " << summarizeCounters(r.forceCounters) << "\n";
+                            if (r.treeNodes) {
+                                std::cout << "    tree_build " << summarizeCounters(r.buildCounters) << "\n"
+                                          << "    force_walk " << summarizeCounters(r.walkCounters) << "\n";
+                            }
+                            std::cout << "    integrate  " << summarizeCounters(r.integrateCounters) << "\n";
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (!options.tracePath.empty()) {
+        Trace::stop();
+        Trace::writeChromeJson(options.tracePath);
+    }
+    if (!options.jsonPath.empty()) writeJson(options.jsonPath, results);
+    if (!options.csvPath.empty()) writeCsv(options.csvPath, results);
+    return 0;
+}
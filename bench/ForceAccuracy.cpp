@@ -0,0 +1,290 @@
+// nbody-accuracy: force accuracy versus cost of approximate calculators.
+// Every candidate is compared against a compensated (Kahan) double-precision direct sum using the same
+// softening law; relative force-error percentiles, wall time and interaction counts are reported
+// together and the Pareto-optimal configurations are marked per (N, distribution).
+//
+// usage: nbody-accuracy [--n 1000,10000] [--dist uniform,plummer,disk,belt] [--calc brute,bh0.1,...,bh1.0]
+//                       [--sample 4096] [--ref-softening 0.001] [--reps 3] [--seed 1]
+//                       [--metric p50|p90|p99|max] [--cost time|interactions] [--budget 1e-3]
+//                       [--json accuracy.json] [--csv accuracy.csv]
+#include "BenchCommon.h"
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+using namespace Bench;
+
+namespace {
+    struct Options {
+        std::vector<size_t> counts = { 1000, 10000 };
+        std::vector<std::string> distributions = { "uniform", "plummer", "disk" };
+        std::vector<std::string> calculators = { "brute", "bh0.1", "bh0.2", "bh0.3", "bh0.4", "bh0.5",
+                                                 "bh0.6", "bh0.7", "bh0.8", "bh0.9", "bh1.0" };
+        size_t sample = 4096;        // bodies checked against the reference (all if N is smaller)
+        double referenceSoftening = kDefaultSoftening;
+        unsigned reps = 3;
+        uint64_t seed = 1;
+        std::string metric = "p99"; // error axis of the Pareto front
+        std::string cost = "time";  // cost axis: wall time or interaction count
+        double budget = -1.0;       // report the cheapest configuration with metric <= budget
+        std::string jsonPath;
+        std::string csvPath;
+    };
+
+    struct Result {
+        size_t n = 0;
+        std::string distribution;
+        std::string calculator;
+        double seconds = 0.0; // median wall time of calculateForces
+        uint64_t interactions = 0;
+        double errP50 = 0.0, errP90 = 0.0, errP99 = 0.0, errMax = 0.0;
+        bool pareto = false;
+    };
+
+    // Compensated summation, the reference must be far more accurate than the float calculators
+    struct KahanSum {
+        double sum = 0.0;
+        double compensation = 0.0;
+        void add(double value) {
+            double y = value - compensation;
+            double t = sum + y;
+            compensation = (t - sum) - y;
+            sum = t;
+        }
+    };
+
+    // Direct-sum force on each sampled body with the calculators' softening law |F| = G*m_i*m_j / max(r, eps)²
+    std::vector<glm::dvec2> referenceForces(const std::vector<MassObject>& bodies, const std::vector<size_t>& sample, double softening) {
+        std::vector<glm::dvec2> forces(sample.size());
+        Parallel::parallelFor(0, sample.size(), 16, [&](size_t begin, size_t end) {
+            for (size_t s = begin; s < end; ++s) {
+                const size_t i = sample[s];
+                const double xi = bodies[i].getPosition().x, yi = bodies[i].getPosition().y;
+                KahanSum fx, fy;
+                for (size_t j = 0; j < bodies.size(); ++j) {
+                    if (j == i || bodies[j].isTestParticle()) continue; // test particles are not sources
+                    double dx = bodies[j].getPosition().x - xi;
+                    double dy = bodies[j].getPosition().y - yi;
+                    double r = std::sqrt(dx * dx + dy * dy);
+                    if (r == 0.0) continue; // coincident bodies exert no force
+                    double soft = std::max(r, softening);
+                    double scale = bodies[j].getMass() / (soft * soft * r);
+                    fx.add(dx * scale);
+                    fy.add(dy * scale);
+                }
+                const double gm = G * bodies[i].getMass();
+                forces[s] = { gm * fx.sum, gm * fy.sum };
+            }
+        });
+        return forces;
+    }
+
+    // Evenly strided subset, deterministic and spread over the whole distribution
+    std::vector<size_t> chooseSample(size_t n, size_t sampleSize) {
+        std::vector<size_t> sample;
+        if (sampleSize == 0 || sampleSize >= n) {
+            sample.resize(n);
+            for (size_t i = 0; i < n; ++i) sample[i] = i;
+            return sample;
+        }
+        sample.reserve(sampleSize);
+        for (size_t k = 0; k < sampleSize; ++k) sample.push_back(k * n / sampleSize);
+        return sample;
+    }
+
+    double percentile(const std::vector<double>& sorted, double p) {
+        if (sorted.empty()) return 0.0;
+        size_t rank = static_cast<size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+        return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+    }
+
+    Result evaluate(const std::vector<MassObject>& bodies, const std::vector<size_t>& sample,
+                    const std::vector<glm::dvec2>& reference, const std::string& name, unsigned reps) {
+        using clock = std::chrono::steady_clock;
+        Result r;
+        r.n = bodies.size();
+        r.calculator = name;
+
+        std::unique_ptr<ForceCalculator> calculator = makeCalculator(name);
+        std::vector<glm::vec2> forces = calculator->calculateForces(bodies); // warm-up
+        std::vector<double> times;
+        for (unsigned rep = 0; rep < reps; ++rep) {
+            auto start = clock::now();
+            forces = calculator->calculateForces(bodies);
+            times.push_back(std::chrono::duration<double>(clock::now() - start).count());
+        }
+        r.seconds = median(times);
+        r.interactions = calculator->getLastInteractionCount();
+
+        std::vector<double> errors;
+        errors.reserve(sample.size());
+        for (size_t s = 0; s < sample.size(); ++s) {
+            const double refNorm = glm::length(reference[s]);
+            if (refNorm <= 0.0) continue;
+            const glm::dvec2 approx(forces[sample[s]]);
+            double error = glm::length(approx - reference[s]) / refNorm;
+            errors.push_back(std::isfinite(error) ? error : std::numeric_limits<double>::infinity());
+        }
+        std::sort(errors.begin(), errors.end());
+        r.errP50 = percentile(errors, 0.50);
+        r.errP90 = percentile(errors, 0.90);
+        r.errP99 = percentile(errors, 0.99);
+        r.errMax = errors.empty() ? 0.0 : errors.back();
+        return r;
+    }
+
+    double errorMetric(const Result& r, const std::string& metric) {
+        if (metric == "p50") return r.errP50;
+        if (metric == "p90") return r.errP90;
+        if (metric == "max") return r.errMax;
+        return r.errP99;
+    }
+
+    double costMetric(const Result& r, const std::string& cost) {
+        return cost == "interactions" ? static_cast<double>(r.interactions) : r.seconds;
+    }
+
+    // A configuration is Pareto-optimal if nothing else is both cheaper and more accurate
+    void markPareto(std::vector<Result>& group, const Options& options) {
+        std::vector<Result*> order;
+        for (Result& r : group) order.push_back(&r);
+        std::sort(order.begin(), order.end(), [&](const Result* a, const Result* b) {
+            double ca = costMetric(*a, options.cost), cb = costMetric(*b, options.cost);
+            if (ca != cb) return ca < cb;
+            return errorMetric(*a, options.metric) < errorMetric(*b, options.metric);
+        });
+        double bestError = std::numeric_limits<double>::infinity();
+        for (Result* r : order) {
+            double error = errorMetric(*r, options.metric);
+            if (error < bestError) {
+                r->pareto = true;
+                bestError = error;
+            }
+        }
+    }
+
+    void writeCsv(const std::string& path, const std::vector<Result>& results) {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Failed to open " << path << "\n";
+            return;
+        }
+        out << std::setprecision(9);
+        out << "n,distribution,calculator,seconds,interactions,err_p50,err_p90,err_p99,err_max,pareto\n";
+        for (const Result& r : results) {
+            out << r.n << ',' << r.distribution << ',' << r.calculator << ',' << r.seconds << ',' << r.interactions << ','
+                << r.errP50 << ',' << r.errP90 << ',' << r.errP99 << ',' << r.errMax << ',' << (r.pareto ? 1 : 0) << '\n';
+        }
+    }
+
+    void writeJson(const std::string& path, const std::vector<Result>& results, const Options& options) {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Failed to open " << path << "\n";
+            return;
+        }
+        out << std::setprecision(9);
+        out << "{\n  \"timestamp\": \"" << timestamp() << "\",\n"
+            << "  \"compiler\": \"" << compilerName() << "\",\n"
+            << "  \"referenceSoftening\": " << options.referenceSoftening << ",\n"
+            << "  \"paretoMetric\": \"" << options.metric << "\",\n"
+            << "  \"paretoCost\": \"" << options.cost << "\",\n"
+            << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            out << "    {\"n\": " << r.n << ", \"distribution\": \"" << r.distribution << "\", \"calculator\": \"" << r.calculator
+                << "\", \"seconds\": " << r.seconds << ", \"interactions\": " << r.interactions
+                << ", \"errP50\": " << r.errP50 << ", \"errP90\": " << r.errP90 << ", \"errP99\": " << r.errP99
+                << ", \"errMax\": " << r.errMax << ", \"pareto\": " << (r.pareto ? "true" : "false") << "}"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--n" && hasValue) options.counts = parseCounts(argv[++i]);
+            else if (arg == "--dist" && hasValue) options.distributions = parseNames(argv[++i]);
+            else if (arg == "--calc" && hasValue) options.calculators = parseNames(argv[++i]);
+            else if (arg == "--sample" && hasValue) options.sample = static_cast<size_t>(std::stod(argv[++i]));
+            else if (arg == "--ref-softening" && hasValue) options.referenceSoftening = std::stod(argv[++i]);
+            else if (arg == "--reps" && hasValue) options.reps = std::max(1u, static_cast<unsigned>(std::stoul(argv[++i])));
+            else if (arg == "--seed" && hasValue) options.seed = std::stoull(argv[++i]);
+            else if (arg == "--metric" && hasValue) options.metric = argv[++i];
+            else if (arg == "--cost" && hasValue) options.cost = argv[++i];
+            else if (arg == "--budget" && hasValue) options.budget = std::stod(argv[++i]);
+            else if (arg == "--json" && hasValue) options.jsonPath = argv[++i];
+            else if (arg == "--csv" && hasValue) options.csvPath = argv[++i];
+            else {
+                std::cerr << "Unknown option " << arg << "\n"
+                          << "usage: nbody-accuracy [--n list] [--dist list] [--calc list] [--sample k] [--ref-softening eps]\n"
+                          << "                      [--reps k] [--seed s] [--metric p50|p90|p99|max] [--cost time|interactions]\n"
+                          << "                      [--budget err] [--json file] [--csv file]\n";
+                return false;
+            }
+        }
+        for (const std::string& name : options.calculators) {
+            if (!makeCalculator(name)) {
+                std::cerr << "Unknown calculator " << name << "\n";
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) return 1;
+
+    std::vector<Result> results;
+    for (size_t n : options.counts) {
+        for (const std::string& distribution : options.distributions) {
+            const std::vector<MassObject> bodies = generateBodies(distribution, n, options.seed);
+            const std::vector<size_t> sample = chooseSample(n, options.sample);
+            const std::vector<glm::dvec2> reference = referenceForces(bodies, sample, options.referenceSoftening);
+
+            std::vector<Result> group;
+            for (const std::string& name : options.calculators) {
+                Result r = evaluate(bodies, sample, reference, name, options.reps);
+                r.distribution = distribution;
+                group.push_back(r);
+            }
+            markPareto(group, options);
+
+            std::cout << "\nN = " << n << ", " << distribution << " (" << sample.size() << " bodies checked)\n";
+            std::cout << std::left << std::setw(16) << "calc" << std::setw(12) << "ms" << std::setw(14) << "interactions"
+                      << std::setw(11) << "p50" << std::setw(11) << "p90" << std::setw(11) << "p99" << std::setw(11) << "max" << "pareto\n";
+            for (const Result& r : group) {
+                std::cout << std::left << std::setw(16) << r.calculator << std::setw(12) << std::fixed << std::setprecision(3) << r.seconds * 1e3
+                          << std::setw(14) << r.interactions << std::scientific << std::setprecision(2)
+                          << std::setw(11) << r.errP50 << std::setw(11) << r.errP90 << std::setw(11) << r.errP99 << std::setw(11) << r.errMax
+                          << (r.pareto ? "*" : "") << std::defaultfloat << "\n";
+            }
+
+            if (options.budget >= 0.0) {
+                const Result* best = nullptr;
+                for (const Result& r : group) {
+                    if (errorMetric(r, options.metric) > options.budget) continue;
+                    if (!best || costMetric(r, options.cost) < costMetric(*best, options.cost)) best = &r;
+                }
+                if (best) {
+                    std::cout << "Cheapest with " << options.metric << " <= " << options.budget << ": " << best->calculator << "\n";
+                }
+                else {
+                    std::cout << "No configuration meets " << options.metric << " <= " << options.budget << "\n";
+                }
+            }
+            results.insert(results.end(), group.begin(), group.end());
+        }
+    }
+
+    if (!options.jsonPath.empty()) writeJson(options.jsonPath, results, options);
+    if (!options.csvPath.empty()) writeCsv(options.csvPath, results);
+    return 0;
+}
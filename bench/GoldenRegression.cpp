@@ -0,0 +1,361 @@
+// nbody-regress: golden-trajectory regression check for the force calculators and integrators.
+// Each canonical scenario is run through PhysicsEngine for a fixed number of steps, and the final
+// masses, positions and velocities and the relative energy drift are compared against a golden file.
+// A scenario passes when every position and velocity component is within --ulps float ULPs of the
+// golden value or within the scenario's relative tolerance (|difference| / |golden vector|), and
+// the energy drift is within --energy of the golden drift. Milliseconds per step and interactions
+// per step are reported next to the ones recorded with the golden file; --max-slowdown turns a
+// slower run into a failure. The exit code is 1 if any scenario fails.
+//
+// usage: nbody-regress [--golden dir] [--record] [--scenario solar,plummer,...] [--threads 1,4]
+//                      [--ulps 16] [--rel x] [--energy 1e-6] [--max-slowdown 0] [--json regress.json]
+//
+// --record (re)writes the golden files from this build instead of comparing. The default golden
+// directory is bench/golden in the source tree.
+#include "BenchCommon.h"
+#include "Diagnostics.h"
+#include "Integrator.h"
+#include "PhysicsEngine.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+#ifndef NBODY_GOLDEN_DIR
+#define NBODY_GOLDEN_DIR "bench/golden"
+#endif
+
+using namespace Bench;
+
+namespace {
+    struct Scenario {
+        std::string name;
+        std::function<std::vector<MassObject>()> bodies;
+        std::string calculator;     // makeCalculator() name
+        std::string integrator;     // "verlet" or "euler"
+        double timestep = 0.0;      // years
+        unsigned steps = 0;
+        double relativeTolerance = 0.0;
+    };
+
+    // The belt with a massless test particle on a circular orbit at 2.7 AU, which only stays finite
+    // if its acceleration is never divided by its mass
+    std::vector<MassObject> beltWithDust() {
+        std::vector<MassObject> bodies = generateBodies("belt", 2006, 3);
+        MassObject dust(0.0, glm::vec2(2.7f, 0.0f), glm::vec2(0.0f, static_cast<float>(std::sqrt(G / 2.7))));
+        dust.setTestParticle(true);
+        bodies.push_back(dust);
+        return bodies;
+    }
+
+    // Short runs of each kernel on a system it is used for; chaotic systems get looser tolerances.
+    // The clusters use a larger softening so close encounters stay resolved at their timestep
+    std::vector<Scenario> canonicalScenarios() {
+        return {
+            { "solar", [] { return InitialConditions::exampleSolarSystem(); }, "brute", "verlet", 1e-4, 20000, 1e-5 },
+            { "solar-euler", [] { return InitialConditions::exampleSolarSystem(); }, "brute", "euler", 1e-4, 20000, 1e-5 },
+            { "solar-belt", [] {
+                  std::vector<MassObject> bodies = InitialConditions::exampleSolarSystem();
+                  std::vector<MassObject> belt = InitialConditions::generateKeplerBelt(500);
+                  bodies.insert(bodies.end(), belt.begin(), belt.end());
+                  return bodies;
+              }, "bh0.7a0.002xf8", "verlet", 1e-4, 2000, 1e-5 },
+            { "plummer", [] { return generateBodies("plummer", 1000, 1); }, "bh0.5@0.05", "verlet", 1e-3, 300, 1e-3 },
+            { "plummer-flat", [] { return generateBodies("plummer", 1000, 1); }, "bh0.5f8@0.05", "verlet", 1e-3, 300, 1e-3 },
+            { "disk", [] { return generateBodies("disk", 2000, 2); }, "bh0.5d8@0.05", "verlet", 1e-4, 300, 1e-4 },
+            { "belt-test", beltWithDust, "brute", "verlet", 1e-4, 2000, 1e-5 },
+            { "belt-test-flat", beltWithDust, "bh0.5f8", "verlet", 1e-4, 2000, 1e-5 },
+        };
+    }
+
+    struct Options {
+        std::string goldenDir = NBODY_GOLDEN_DIR;
+        bool record = false;
+        std::vector<std::string> scenarios; // empty: all
+        std::vector<unsigned> threads = { 1, 4 }; // the results must not depend on the thread count
+        int64_t ulps = 16;
+        double relativeTolerance = -1.0;    // < 0: per scenario
+        double energyTolerance = 1e-6;      // absolute, on the relative drift
+        double maxSlowdown = 0.0;           // 0: performance is reported only
+        std::string jsonPath;
+    };
+
+    // Final state and cost of one run
+    struct Run {
+        std::vector<MassObject> bodies;
+        double energyDrift = 0.0;  // (E_end - E_0) / |E_0|
+        double msPerStep = 0.0;
+        uint64_t interactionsPerStep = 0;
+    };
+
+    struct Golden {
+        std::string calculator, integrator;
+        double timestep = 0.0;
+        unsigned steps = 0;
+        double energyDrift = 0.0;
+        double msPerStep = 0.0;
+        std::vector<MassObject> bodies;
+    };
+
+    struct Result {
+        std::string scenario;
+        unsigned threads = 0;
+        std::string status;         // "pass", "fail", "recorded", "missing" or "stale"
+        int64_t maxUlps = 0;        // over all position and velocity components
+        double maxRelative = 0.0;   // |difference| / |golden vector|, worst body
+        double energyDrift = 0.0;
+        double goldenEnergyDrift = 0.0;
+        double msPerStep = 0.0;
+        double goldenMsPerStep = 0.0;
+        uint64_t interactionsPerStep = 0;
+    };
+
+    double energyOf(const std::vector<MassObject>& bodies, double softening) {
+        BruteForceCalculator reference(G); // exact potential, independent of the scenario's approximation
+        reference.setSofteningParameter(softening);
+        return Diagnostics::compute(bodies, reference).totalEnergy;
+    }
+
+    Run runScenario(const Scenario& scenario) {
+        using clock = std::chrono::steady_clock;
+        Run run;
+        run.bodies = scenario.bodies();
+
+        PhysicsEngine engine;
+        engine.setForceCalculator(makeCalculator(scenario.calculator));
+        if (scenario.integrator == "euler") engine.setIntegrator(std::make_unique<EulerIntegrator>());
+        else engine.setIntegrator(std::make_unique<VerletIntegrator>());
+        engine.setPhysicsTimestep(scenario.timestep);
+
+        const double softening = engine.getForceCalculator()->getSoftening();
+        const double initialEnergy = energyOf(run.bodies, softening);
+        uint64_t interactions = 0;
+        auto start = clock::now();
+        for (unsigned step = 0; step < scenario.steps; ++step) {
+            engine.update(run.bodies, scenario.timestep); // exactly one substep
+            interactions += engine.getForceCalculator()->getLastInteractionCount();
+        }
+        const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+        run.energyDrift = (energyOf(run.bodies, softening) - initialEnergy) / std::abs(initialEnergy);
+        run.msPerStep = seconds * 1e3 / scenario.steps;
+        run.interactionsPerStep = interactions / scenario.steps;
+        return run;
+    }
+
+    std::string goldenPath(const Options& options, const Scenario& scenario) {
+        return options.goldenDir + "/" + scenario.name + ".txt";
+    }
+
+    // Floats with 9 significant digits and doubles with 17 read back bit for bit
+    bool writeGolden(const std::string& path, const Scenario& scenario, const Run& run) {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Cannot write " << path << "\n";
+            return false;
+        }
+        out << "# nbody-regress golden file, rewrite with nbody-regress --record\n"
+            << "calculator " << scenario.calculator << "\n"
+            << "integrator " << scenario.integrator << "\n"
+            << std::setprecision(17) << "timestep " << scenario.timestep << "\n"
+            << "steps " << scenario.steps << "\n"
+            << "energy_drift " << run.energyDrift << "\n"
+            << std::setprecision(6) << "ms_per_step " << run.msPerStep << "\n"
+            << "bodies " << run.bodies.size() << "\n";
+        for (const MassObject& body : run.bodies) {
+            out << std::setprecision(17) << body.getMass() << std::setprecision(9)
+                << ' ' << body.getPosition().x << ' ' << body.getPosition().y
+                << ' ' << body.getVelocity().x << ' ' << body.getVelocity().y << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+
+    bool readGolden(const std::string& path, Golden& golden) {
+        std::ifstream in(path);
+        if (!in) return false;
+        std::string line;
+        std::getline(in, line); // comment
+        std::string key;
+        size_t count = 0;
+        in >> key >> golden.calculator >> key >> golden.integrator >> key >> golden.timestep >> key >> golden.steps
+           >> key >> golden.energyDrift >> key >> golden.msPerStep >> key >> count;
+        if (!in || key != "bodies") return false;
+        golden.bodies.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            double mass = 0.0;
+            float x = 0.0f, y = 0.0f, vx = 0.0f, vy = 0.0f;
+            if (!(in >> mass >> x >> y >> vx >> vy)) return false;
+            golden.bodies.emplace_back(mass, glm::vec2(x, y), glm::vec2(vx, vy));
+        }
+        return true;
+    }
+
+    // Distance in representable floats, NaN is infinitely far
+    int64_t ulpDistance(float a, float b) {
+        if (std::isnan(a) || std::isnan(b)) return std::numeric_limits<int64_t>::max();
+        auto ordered = [](float f) {
+            int32_t i;
+            std::memcpy(&i, &f, sizeof(i));
+            return i < 0 ? static_cast<int64_t>(INT32_MIN) - i : static_cast<int64_t>(i);
+        };
+        return std::abs(ordered(a) - ordered(b));
+    }
+
+    double relativeDifference(glm::vec2 value, glm::vec2 golden) {
+        const double difference = glm::length(glm::dvec2(value) - glm::dvec2(golden));
+        const double scale = glm::length(glm::dvec2(golden));
+        if (!std::isfinite(difference)) return std::numeric_limits<double>::infinity();
+        return scale > 0.0 ? difference / scale : difference;
+    }
+
+    // Fills maxUlps/maxRelative and returns whether every component is within tolerance
+    bool compareStates(const std::vector<MassObject>& bodies, const std::vector<MassObject>& golden,
+                       int64_t ulps, double relativeTolerance, Result& r) {
+        bool pass = true;
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            const glm::vec2 vectors[2][2] = { { bodies[i].getPosition(), golden[i].getPosition() },
+                                              { bodies[i].getVelocity(), golden[i].getVelocity() } };
+            for (const auto& [value, expected] : vectors) {
+                const int64_t distance = std::max(ulpDistance(value.x, expected.x), ulpDistance(value.y, expected.y));
+                const double relative = relativeDifference(value, expected);
+                r.maxUlps = std::max(r.maxUlps, distance);
+                r.maxRelative = std::max(r.maxRelative, relative);
+                if (distance > ulps && !(relative <= relativeTolerance)) pass = false;
+            }
+            if (bodies[i].getMass() != golden[i].getMass()) pass = false;
+        }
+        return pass;
+    }
+
+    void writeJson(const std::string& path, const std::vector<Result>& results) {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Cannot write " << path << "\n";
+            return;
+        }
+        out << "{\n  \"compiler\": \"" << compilerName() << "\",\n"
+            << "  \"timestamp\": \"" << timestamp() << "\",\n"
+            << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            out << "    {\"scenario\": \"" << r.scenario << "\", \"threads\": " << r.threads << ", \"status\": \"" << r.status << '"'
+                << ", \"maxUlps\": " << r.maxUlps << ", \"maxRelative\": " << r.maxRelative
+                << ", \"energyDrift\": " << r.energyDrift << ", \"goldenEnergyDrift\": " << r.goldenEnergyDrift
+                << ", \"msPerStep\": " << r.msPerStep << ", \"goldenMsPerStep\": " << r.goldenMsPerStep
+                << ", \"interactionsPerStep\": " << r.interactionsPerStep << "}"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--golden" && hasValue) options.goldenDir = argv[++i];
+            else if (arg == "--record") options.record = true;
+            else if (arg == "--scenario" && hasValue) options.scenarios = parseNames(argv[++i]);
+            else if (arg == "--threads" && hasValue) {
+                options.threads = parseList<unsigned>(argv[++i], [](const std::string& s) {
+                    return std::max(1u, static_cast<unsigned>(std::stoul(s)));
+                });
+            }
+            else if (arg == "--ulps" && hasValue) options.ulps = std::stoll(argv[++i]);
+            else if (arg == "--rel" && hasValue) options.relativeTolerance = std::stod(argv[++i]);
+            else if (arg == "--energy" && hasValue) options.energyTolerance = std::stod(argv[++i]);
+            else if (arg == "--max-slowdown" && hasValue) options.maxSlowdown = std::stod(argv[++i]);
+            else if (arg == "--json" && hasValue) options.jsonPath = argv[++i];
+            else {
+                std::cerr << "Unknown option " << arg << "\n"
+                          << "usage: nbody-regress [--golden dir] [--record] [--scenario list] [--threads list]\n"
+                          << "                     [--ulps n] [--rel x] [--energy x] [--max-slowdown f] [--json file]\n";
+                return false;
+            }
+        }
+        for (const std::string& name : options.scenarios) {
+            bool known = false;
+            for (const Scenario& scenario : canonicalScenarios()) known = known || scenario.name == name;
+            if (!known) {
+                std::cerr << "Unknown scenario " << name << "\n";
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) return 1;
+
+    std::cout << std::left << std::setw(16) << "scenario" << std::setw(5) << "thr" << std::setw(10) << "status"
+              << std::setw(10) << "max ulps" << std::setw(11) << "max rel" << std::setw(12) << "drift"
+              << std::setw(12) << "golden" << std::setw(10) << "ms/step" << std::setw(10) << "golden" << "interactions\n";
+
+    std::vector<Result> results;
+    bool allPassed = true;
+    for (const Scenario& scenario : canonicalScenarios()) {
+        if (!options.scenarios.empty() &&
+            std::find(options.scenarios.begin(), options.scenarios.end(), scenario.name) == options.scenarios.end()) continue;
+
+        const std::string path = goldenPath(options, scenario);
+        Golden golden;
+        bool haveGolden = !options.record && readGolden(path, golden);
+        const double relativeTolerance = options.relativeTolerance >= 0.0 ? options.relativeTolerance : scenario.relativeTolerance;
+
+        for (unsigned threads : options.threads) {
+            Parallel::setThreadCount(threads);
+            const Run run = runScenario(scenario);
+
+            Result r;
+            r.scenario = scenario.name;
+            r.threads = threads;
+            r.energyDrift = run.energyDrift;
+            r.msPerStep = run.msPerStep;
+            r.interactionsPerStep = run.interactionsPerStep;
+
+            if (options.record && !haveGolden) {
+                // The first thread count defines the golden state, the others are compared against it
+                haveGolden = writeGolden(path, scenario, run) && readGolden(path, golden);
+                r.status = haveGolden ? "recorded" : "fail";
+                r.goldenEnergyDrift = golden.energyDrift;
+                r.goldenMsPerStep = golden.msPerStep;
+            }
+            else if (!haveGolden) {
+                r.status = "missing";
+            }
+            else if (golden.calculator != scenario.calculator || golden.integrator != scenario.integrator ||
+                     golden.timestep != scenario.timestep || golden.steps != scenario.steps || golden.bodies.size() != run.bodies.size()) {
+                r.status = "stale"; // the scenario changed since recording
+            }
+            else {
+                r.goldenEnergyDrift = golden.energyDrift;
+                r.goldenMsPerStep = golden.msPerStep;
+                bool pass = compareStates(run.bodies, golden.bodies, options.ulps, relativeTolerance, r);
+                pass = pass && std::abs(run.energyDrift - golden.energyDrift) <= options.energyTolerance;
+                if (options.maxSlowdown > 0.0 && run.msPerStep > options.maxSlowdown * golden.msPerStep) pass = false;
+                r.status = pass ? "pass" : "fail";
+            }
+            if (r.status != "pass" && r.status != "recorded") allPassed = false;
+            results.push_back(r);
+
+            std::cout << std::left << std::setw(16) << r.scenario << std::setw(5) << r.threads << std::setw(10) << r.status
+                      << std::setw(10) << r.maxUlps << std::setw(11) << std::scientific << std::setprecision(2) << r.maxRelative
+                      << std::setw(12) << r.energyDrift << std::setw(12) << r.goldenEnergyDrift
+                      << std::setw(10) << std::fixed << std::setprecision(3) << r.msPerStep << std::setw(10) << r.goldenMsPerStep
+                      << r.interactionsPerStep << std::defaultfloat << "\n";
+        }
+    }
+
+    if (!options.jsonPath.empty()) writeJson(options.jsonPath, results);
+    if (!allPassed) {
+        std::cerr << "Regression check failed (record new golden files with --record once a change is intended)\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,380 @@
+#include "AutoCalculator.h"
+#include "BarnesHutCalculator.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+namespace {
+    constexpr size_t kSampleBodies = 256;  // bodies checked against the direct sum
+    constexpr size_t kMinTunedBodies = 64; // below this brute force is exact and fastest
+    constexpr double kMinTimedSeconds = 0.01;
+    constexpr unsigned kMaxRuns = 5;       // short evaluations are repeated, the fastest run counts
+    constexpr unsigned kLeafSizes[] = { 4, 16 }; // tried on a flat or dual tree winner, candidates use 8
+
+    int bodyRange(size_t n) {
+        return n == 0 ? 0 : static_cast<int>(std::floor(std::log2(static_cast<double>(n))));
+    }
+
+    std::vector<size_t> chooseSample(size_t n) {
+        std::vector<size_t> sample;
+        const size_t count = std::min(n, kSampleBodies);
+        sample.reserve(count);
+        for (size_t k = 0; k < count; ++k) sample.push_back(k * n / count);
+        return sample;
+    }
+
+    // Double-precision direct sum on the sampled bodies, same softening law as the calculators
+    std::vector<glm::dvec2> referenceForces(const std::vector<MassObject>& bodies, const std::vector<size_t>& sample, double G, double softening) {
+        std::vector<glm::dvec2> forces(sample.size());
+        Parallel::parallelFor(0, sample.size(), 16, [&](size_t begin, size_t end) {
+            for (size_t s = begin; s < end; ++s) {
+                const size_t i = sample[s];
+                const double xi = bodies[i].getPosition().x, yi = bodies[i].getPosition().y;
+                double fx = 0.0, fy = 0.0;
+                for (size_t j = 0; j < bodies.size(); ++j) {
+                    double dx = bodies[j].getPosition().x - xi;
+                    double dy = bodies[j].getPosition().y - yi;
+                    double r = std::sqrt(dx * dx + dy * dy);
+                    if (j == i || r == 0.0 || bodies[j].isTestParticle()) continue; // test particles are not sources
+                    double soft = std::max(r, softening);
+                    double scale = bodies[j].getMass() / (soft * soft * r);
+                    fx += dx * scale;
+                    fy += dy * scale;
+                }
+                const double gm = G * bodies[i].getMass();
+                forces[s] = { gm * fx, gm * fy };
+            }
+        });
+        return forces;
+    }
+
+    double p99Error(const std::vector<glm::vec2>& forces, const std::vector<size_t>& sample, const std::vector<glm::dvec2>& reference) {
+        std::vector<double> errors;
+        errors.reserve(sample.size());
+        for (size_t s = 0; s < sample.size(); ++s) {
+            const double refNorm = glm::length(reference[s]);
+            if (refNorm <= 0.0) continue;
+            double error = glm::length(glm::dvec2(forces[sample[s]]) - reference[s]) / refNorm;
+            errors.push_back(std::isfinite(error) ? error : std::numeric_limits<double>::infinity());
+        }
+        if (errors.empty()) return 0.0;
+        std::sort(errors.begin(), errors.end());
+        size_t rank = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(errors.size())));
+        return errors[std::max<size_t>(rank, 1) - 1];
+    }
+
+    // Fastest of up to kMaxRuns evaluations. 'forces' and 'interactions' come from the first run, the
+    // run count depends on timings and calculators with state (relative criterion) change between runs
+    double timeEvaluation(const ForceCalculator& calculator, const std::vector<MassObject>& bodies, unsigned threads,
+                          std::vector<glm::vec2>& forces, uint64_t& interactions) {
+        using clock = std::chrono::steady_clock;
+        Parallel::ScopedThreadCount threadScope(threads);
+        double best = std::numeric_limits<double>::infinity();
+        double total = 0.0;
+        for (unsigned run = 0; run < kMaxRuns && (run == 0 || total < kMinTimedSeconds); ++run) {
+            auto start = clock::now();
+            if (run == 0) {
+                forces = calculator.calculateForces(bodies);
+                interactions = calculator.getLastInteractionCount();
+            }
+            else {
+                calculator.calculateForces(bodies);
+            }
+            double seconds = std::chrono::duration<double>(clock::now() - start).count();
+            best = std::min(best, seconds);
+            total += seconds;
+        }
+        return best;
+    }
+
+    // The relative opening criterion needs the accelerations of a previous call
+    void prime(const ForceCalculator& calculator, const std::vector<MassObject>& bodies) {
+        const auto* tree = dynamic_cast<const BarnesHutCalculator*>(&calculator);
+        if (tree && tree->getOpeningCriterion().type == OpeningCriterion::Type::RelativeAcceleration) tree->calculateForces(bodies);
+    }
+
+    // Better = meets the target and cheaper, or closer to the target when nothing meets it.
+    // The cost is the time, or the interaction count in deterministic mode
+    bool isBetter(const TuningResult& a, const TuningResult& b) {
+        const bool deterministic = Parallel::isDeterministic();
+        auto cheaper = [deterministic](const TuningResult& x, const TuningResult& y) {
+            return deterministic ? x.interactions < y.interactions : x.seconds < y.seconds;
+        };
+        if (a.meetsTarget != b.meetsTarget) return a.meetsTarget;
+        if (a.meetsTarget) return cheaper(a, b);
+        if (a.error != b.error) return a.error < b.error;
+        return cheaper(a, b);
+    }
+
+    // "bh0.5f8" -> "bh0.5f16": the flat or dual tree candidate with another leaf size, empty for other kinds
+    std::string withLeafSize(const std::string& name, unsigned leafSize) {
+        const size_t option = name.find_last_of("fd");
+        if (name.rfind("bh", 0) != 0 || option == std::string::npos) return "";
+        if (name.find_first_not_of("0123456789", option + 1) != std::string::npos) return "";
+        return name.substr(0, option + 1) + std::to_string(leafSize);
+    }
+
+    std::string sanitize(std::string text) {
+        std::replace(text.begin(), text.end(), '\t', ' ');
+        std::replace(text.begin(), text.end(), '|', '/');
+        return text;
+    }
+}
+
+AutoCalculator::AutoCalculator(double gravitationalConstant, double softening, double errorTarget)
+    : G(gravitationalConstant), softening(softening), errorTarget(errorTarget),
+      candidates{ "brute", "bh0.3f8", "bh0.5f8", "bh0.7f8", "bh0.9f8", "bh0.5d8", "bh0.7d8", "bh0.5a0.002xf8" } {}
+
+std::unique_ptr<ForceCalculator> AutoCalculator::createCandidate(const std::string& name, double G, double softening) {
+    if (name == "brute") {
+        auto calculator = std::make_unique<BruteForceCalculator>(G);
+        calculator->setSofteningParameter(softening);
+        return calculator;
+    }
+    if (name.rfind("bh", 0) == 0) {
+        char* suffix = nullptr;
+        double theta = name.size() > 2 ? std::strtod(name.c_str() + 2, &suffix) : 0.5;
+        if (theta <= 0.0) return nullptr;
+        auto calculator = std::make_unique<BarnesHutCalculator>(G, theta, softening);
+        // Opening criterion modifiers come first: b (bmax), a<alpha> (relative acceleration), x (box check)
+        OpeningCriterion mac = calculator->getOpeningCriterion();
+        const char* cursor = suffix ? suffix : "";
+        while (*cursor == 'b' || *cursor == 'a' || *cursor == 'x') {
+            const char option = *cursor++;
+            if (option == 'b') mac.type = OpeningCriterion::Type::Bmax;
+            else if (option == 'x') mac.boxCheck = true;
+            else {
+                char* end = nullptr;
+                mac.type = OpeningCriterion::Type::RelativeAcceleration;
+                mac.alpha = std::strtod(cursor, &end);
+                if (end == cursor || mac.alpha <= 0.0) return nullptr;
+                cursor = end;
+            }
+        }
+        calculator->setOpeningCriterion(mac);
+        const std::string options = cursor;
+        if (options == "r") calculator->setTreeReuse(true);
+        else if (!options.empty() && (options[0] == 'f' || options[0] == 'd')) {
+            const int leafSize = options.size() > 1 ? std::atoi(options.c_str() + 1) : 8;
+            if (leafSize <= 0) return nullptr;
+            calculator->setFlatTree(true, static_cast<unsigned>(leafSize));
+            calculator->setDualTree(options[0] == 'd');
+        }
+        else if (!options.empty()) return nullptr;
+        return calculator;
+    }
+    return nullptr;
+}
+
+std::string AutoCalculator::machineId() {
+    std::string model = "unknown cpu";
+#if defined(_WIN32)
+    if (const char* identifier = std::getenv("PROCESSOR_IDENTIFIER")) model = identifier;
+#else
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.rfind("model name", 0) == 0) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) model = line.substr(line.find_first_not_of(' ', colon + 1));
+            break;
+        }
+    }
+#endif
+    return sanitize(model) + " x" + std::to_string(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+std::vector<glm::vec2> AutoCalculator::calculateForces(const std::vector<MassObject>& massObjects) const {
+    update(massObjects);
+    Parallel::ScopedThreadCount threadScope(selection.threads);
+    return active->calculateForces(massObjects);
+}
+
+std::vector<glm::vec2> AutoCalculator::calculateAccelerations(const std::vector<MassObject>& massObjects) const {
+    update(massObjects);
+    Parallel::ScopedThreadCount threadScope(selection.threads);
+    return active->calculateAccelerations(massObjects);
+}
+
+void AutoCalculator::update(const std::vector<MassObject>& massObjects) const {
+    const size_t n = massObjects.size();
+    const int range = bodyRange(n);
+    const bool periodic = retuneInterval > 0 && evaluationsSinceTune >= retuneInterval;
+
+    if (!active || retuneRequested || periodic || range != tunedRange) {
+        if (n < kMinTunedBodies) {
+            TuningResult exact;
+            exact.calculator = "brute";
+            exact.meetsTarget = true;
+            select(exact);
+            lastTuning.clear();
+            selectionCached = false;
+        }
+        else if (retuneRequested || periodic || !loadCached(n)) {
+            tune(massObjects);
+        }
+        tunedRange = range;
+        evaluationsSinceTune = 0;
+        retuneRequested = false;
+    }
+
+    ++evaluationsSinceTune;
+}
+
+std::unique_ptr<PotentialEvaluator> AutoCalculator::preparePotential(const std::vector<MassObject>& massObjects) const {
+    if (active) return active->preparePotential(massObjects);
+    return ForceCalculator::preparePotential(massObjects);
+}
+
+uint64_t AutoCalculator::getLastInteractionCount() const {
+    return active ? active->getLastInteractionCount() : 0;
+}
+
+std::unique_ptr<ForceCalculator> AutoCalculator::clone() const {
+    if (active) return active->clone();
+    return std::make_unique<BarnesHutCalculator>(G, 0.5, softening);
+}
+
+void AutoCalculator::select(const TuningResult& result) const {
+    active = createCandidate(result.calculator, G, softening);
+    selection = result;
+    // Candidates are timed on one state, the live calculator also keeps its tree between substeps
+    if (auto* tree = dynamic_cast<BarnesHutCalculator*>(active.get())) tree->setTreeReuse(true);
+}
+
+void AutoCalculator::tune(const std::vector<MassObject>& bodies) const {
+    NBODY_TRACE_SCOPE("autotune");
+    const size_t n = bodies.size();
+    // The pool follows --threads / Parallel::setThreadCount, larger scoped counts add no parallelism
+    const unsigned maxThreads = std::max(1u, Parallel::getThreadCount());
+
+    const std::vector<size_t> sample = chooseSample(n);
+    const std::vector<glm::dvec2> reference = referenceForces(bodies, sample, G, softening);
+
+    // Calculator kind and theta at the full thread count
+    lastTuning.clear();
+    std::vector<glm::vec2> forces;
+    size_t best = 0;
+    auto measure = [&](const std::string& name) {
+        std::unique_ptr<ForceCalculator> calculator = createCandidate(name, G, softening);
+        if (!calculator) return;
+        prime(*calculator, bodies);
+
+        TuningResult r;
+        r.calculator = name;
+        r.threads = maxThreads;
+        r.seconds = timeEvaluation(*calculator, bodies, maxThreads, forces, r.interactions);
+        r.error = p99Error(forces, sample, reference);
+        r.meetsTarget = r.error <= errorTarget;
+        lastTuning.push_back(r);
+        if (isBetter(r, lastTuning[best])) best = lastTuning.size() - 1;
+    };
+    for (const std::string& name : candidates) {
+        if (name == "brute" && n > bruteForceLimit) continue;
+        measure(name);
+    }
+    if (lastTuning.empty()) {
+        std::cerr << "AutoCalculator: no usable candidate, falling back to Barnes-Hut\n";
+        TuningResult fallback;
+        fallback.calculator = "bh0.5f8";
+        fallback.threads = maxThreads;
+        select(fallback);
+        return;
+    }
+
+    // Leaf size for a flat or dual tree winner: larger leaves trade tree depth for direct pairs
+    const std::string kind = lastTuning[best].calculator;
+    for (unsigned leafSize : kLeafSizes) {
+        const std::string name = withLeafSize(kind, leafSize);
+        if (!name.empty() && name != kind) measure(name);
+    }
+
+    // Thread count for the winner, fewer threads can win at small N. Only time can rank thread
+    // counts, the interaction count does not change with them, so deterministic mode keeps the
+    // full count; its forces do not depend on the thread count either way
+    if (!Parallel::isDeterministic()) {
+        const TuningResult winner = lastTuning[best];
+        std::unique_ptr<ForceCalculator> calculator = createCandidate(winner.calculator, G, softening);
+        prime(*calculator, bodies);
+        for (unsigned threads = 1; threads < maxThreads; threads *= 2) {
+            TuningResult r = winner;
+            r.threads = threads;
+            r.seconds = timeEvaluation(*calculator, bodies, threads, forces, r.interactions);
+            lastTuning.push_back(r);
+            if (r.seconds < lastTuning[best].seconds) best = lastTuning.size() - 1;
+        }
+    }
+
+    select(lastTuning[best]);
+    selectionCached = false;
+    saveCached(n);
+    std::ostringstream message;
+    message << "AutoCalculator: " << selection.calculator << " on " << selection.threads << " thread(s) for N=" << n
+            << " (" << selection.seconds * 1e3 << " ms, p99 error " << selection.error << ")\n";
+    std::cout << message.str();
+}
+
+std::string AutoCalculator::cacheKey(size_t bodyCount) const {
+    std::ostringstream key;
+    key << machineId() << '|' << Parallel::getThreadCount() << '|' << bodyRange(bodyCount) << '|' << errorTarget << '|' << softening;
+    if (Parallel::isDeterministic()) key << "|deterministic"; // a timed selection would differ per machine
+    return key.str();
+}
+
+// One line per key: key \t calculator \t threads \t seconds \t error
+bool AutoCalculator::loadCached(size_t bodyCount) const {
+    if (cachePath.empty()) return false;
+    std::ifstream in(cachePath);
+    if (!in.is_open()) return false;
+
+    const std::string key = cacheKey(bodyCount);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#' || line.compare(0, key.size(), key) != 0 || line.size() <= key.size() || line[key.size()] != '\t') continue;
+
+        std::istringstream fields(line.substr(key.size() + 1));
+        TuningResult r;
+        if (!(fields >> r.calculator >> r.threads >> r.seconds >> r.error)) continue;
+        if (!createCandidate(r.calculator, G, softening)) continue;
+        r.meetsTarget = r.error <= errorTarget;
+        select(r);
+        lastTuning.clear();
+        selectionCached = true;
+        return true;
+    }
+    return false;
+}
+
+void AutoCalculator::saveCached(size_t bodyCount) const {
+    if (cachePath.empty()) return;
+
+    const std::string key = cacheKey(bodyCount);
+    std::vector<std::string> lines;
+    {
+        std::ifstream in(cachePath);
+        std::string line;
+        while (std::getline(in, line)) {
+            bool sameKey = line.compare(0, key.size(), key) == 0 && line.size() > key.size() && line[key.size()] == '\t';
+            if (!line.empty() && line[0] != '#' && !sameKey) lines.push_back(line);
+        }
+    }
+    std::ostringstream entry;
+    entry << key << '\t' << selection.calculator << '\t' << selection.threads << '\t' << selection.seconds << '\t' << selection.error;
+    lines.push_back(entry.str());
+
+    std::ofstream out(cachePath, std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Failed to write autotune cache " << cachePath << "\n";
+        return;
+    }
+    out << "# nbody autotune cache: machine|thread limit|log2(N)|error target|softening, calculator, threads, seconds, p99 error\n";
+    for (const std::string& l : lines) out << l << '\n';
+}
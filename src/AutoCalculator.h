@@ -0,0 +1,104 @@
+#pragma once
+#include "ForceCalculator.h"
+#include <string>
+#include <vector>
+
+// One measured (or cached) calculator configuration
+struct TuningResult {
+    std::string calculator; // candidate name, see createCandidate()
+    unsigned threads = 1;
+    double seconds = 0.0;   // one force evaluation
+    double error = 0.0;     // p99 relative force error on the sampled bodies
+    uint64_t interactions = 0; // one force evaluation, the cost in deterministic mode
+    bool meetsTarget = false;
+};
+
+// Picks the fastest calculator configuration whose force error stays below a target
+// (p99 relative error, 0.1 keeps the monopole Barnes-Hut at theta 0.5 eligible): the calculator
+// kind and theta, then the leaf size of a flat or dual tree winner, then the thread count.
+// SIMD width is not a tuning dimension: each kernel has one width per build.
+// Candidates are timed on the live state on the first call, whenever the body count leaves
+// the tuned power-of-two range, and every 'retuneInterval' evaluations. Thread counts are tried
+// up to Parallel::getThreadCount(). Selections are persisted per machine, thread limit,
+// body-count range, error target and softening.
+// In deterministic mode (Parallel::setDeterministic) candidates are ranked by interaction count
+// instead of time, so every machine and run picks the same calculator for the same state, and
+// the thread count is not tuned: the selection runs on Parallel::getThreadCount() threads.
+class AutoCalculator : public ForceCalculator {
+public:
+    static constexpr const char* kDefaultCachePath = "nbody_autotune.txt";
+
+    AutoCalculator(double gravitationalConstant = 39.478, double softening = 0.001, double errorTarget = 0.1);
+
+    std::vector<glm::vec2> calculateForces(const std::vector<MassObject>& massObjects) const override;
+    std::vector<glm::vec2> calculateAccelerations(const std::vector<MassObject>& massObjects) const override;
+    std::unique_ptr<PotentialEvaluator> preparePotential(const std::vector<MassObject>& massObjects) const override;
+
+    double getGravitationalConstant() const override { return G; }
+    double getSoftening() const override { return softening; }
+    uint64_t getLastInteractionCount() const override;
+
+    // Background threads get a copy of the selected calculator, they do not tune
+    std::unique_ptr<ForceCalculator> clone() const override;
+    void permute(const std::vector<size_t>& order) override { if (active) active->permute(order); }
+
+    void setErrorTarget(double target) { errorTarget = target; requestRetune(); }
+    double getErrorTarget() const { return errorTarget; }
+
+    // Names understood by createCandidate(), default brute, the flat tree at theta 0.3, 0.5, 0.7, 0.9,
+    // the dual tree at theta 0.5, 0.7 and the flat tree with the relative criterion at alpha 0.002
+    void setCandidates(const std::vector<std::string>& names) { candidates = names; requestRetune(); }
+    const std::vector<std::string>& getCandidates() const { return candidates; }
+
+    // Brute force is not timed above this body count
+    void setBruteForceLimit(size_t bodies) { bruteForceLimit = bodies; }
+
+    // 0 = retune only when the body count changes range
+    void setRetuneInterval(uint64_t evaluations) { retuneInterval = evaluations; }
+    uint64_t getRetuneInterval() const { return retuneInterval; }
+
+    // Empty path disables persistence; the cache is only read before the first measurement
+    void setCachePath(const std::string& path) { cachePath = path; }
+    const std::string& getCachePath() const { return cachePath; }
+
+    // Measure again on the next call, ignoring the cache
+    void requestRetune() { retuneRequested = true; }
+
+    const TuningResult& getSelection() const { return selection; }
+    // Every configuration timed by the last measurement (empty if the selection came from the cache)
+    const std::vector<TuningResult>& getLastTuning() const { return lastTuning; }
+    bool isSelectionCached() const { return selectionCached; }
+
+    // "brute", "bh<theta>", "bh<theta>r" (tree reuse), "bh<theta>f[leafSize]" (flat tree, default
+    // 8 bodies per leaf) or "bh<theta>d[leafSize]" (dual-tree traversal on the flat tree)
+    // with the given G and softening, nullptr for unknown names. The opening criterion can follow
+    // theta: "b" (bmax), "a<alpha>" (relative acceleration), "x" (box check), e.g. "bh0.5a0.001xf8"
+    static std::unique_ptr<ForceCalculator> createCandidate(const std::string& name, double G, double softening);
+    // CPU model and hardware thread count, the cache key's machine part
+    static std::string machineId();
+
+private:
+    // Select a calculator for this state: cached, retuned or kept, counts the evaluation
+    void update(const std::vector<MassObject>& bodies) const;
+    void tune(const std::vector<MassObject>& bodies) const;
+    bool loadCached(size_t bodyCount) const;
+    void saveCached(size_t bodyCount) const;
+    std::string cacheKey(size_t bodyCount) const;
+    void select(const TuningResult& result) const;
+
+    double G;
+    double softening;
+    double errorTarget;
+    std::vector<std::string> candidates;
+    size_t bruteForceLimit = 20000;
+    uint64_t retuneInterval = 20000;
+    std::string cachePath = kDefaultCachePath;
+
+    mutable std::unique_ptr<ForceCalculator> active;
+    mutable TuningResult selection;
+    mutable std::vector<TuningResult> lastTuning;
+    mutable bool selectionCached = false;
+    mutable bool retuneRequested = false;
+    mutable int tunedRange = -1; // floor(log2(N)) of the tuned state
+    mutable uint64_t evaluationsSinceTune = 0;
+};
@@ -2,40 +2,288 @@
 #include <limits>
 #include <algorithm>
 #include "QuadTree.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "Trace.h"
+#include <chrono>
+#include <mutex>
+
+namespace {
+    constexpr float kRootPadding = 0.05f;  // reused roots get some room before bodies escape
+    constexpr float kMaxLooseness = 2.0f;  // rebuild once the root is this much wider than the bodies
+
+    // Axis-aligned extent of all bodies (AU)
+    void computeExtent(const std::vector<MassObject>& bodies, glm::vec2& lo, glm::vec2& hi) {
+        lo = glm::vec2(std::numeric_limits<float>::infinity());
+        hi = glm::vec2(-std::numeric_limits<float>::infinity());
+        for (const auto& b : bodies) {
+            glm::vec2 p = b.getPosition();
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+    }
+
+    // Square root cell covering every body (AU)
+    // Previous |a| of a body, 0 (unknown) when the body count changed since
+    float accelerationOf(const std::vector<float>& accelerations, size_t index) {
+        return index < accelerations.size() ? accelerations[index] : 0.0f;
+    }
+
+    AABB computeRootBounds(const std::vector<MassObject>& bodies) {
+        glm::vec2 lo, hi;
+        computeExtent(bodies, lo, hi);
+
+        float width = std::max(hi.x - lo.x, 1e-3f);
+        float height = std::max(hi.y - lo.y, 1e-3f);
+        float half = 0.5f * std::max(width, height);
+        AABB box = { (lo + hi) * 0.5f, {half, half} };
+        // Grow past the rounding of the centre, the extreme bodies must be inside
+        while (!box.contains(lo) || !box.contains(hi)) box.halfSize *= 1.0001f;
+        return box;
+    }
+
+    // Owns a tree built once for the state being measured
+    class TreePotentialEvaluator : public PotentialEvaluator {
+    public:
+        TreePotentialEvaluator(const std::vector<MassObject>& bodies, double G, const OpeningCriterion& mac, double softening,
+                               const std::vector<float>& accelerations)
+            : bodies(bodies), root(computeRootBounds(bodies)), G(G), mac(mac), softening(softening), accelerations(accelerations) {
+            for (const auto& b : bodies) root.insert(b);
+            root.finalize();
+        }
+
+        double potentialAt(size_t index) const override {
+            return root.computePotentialAt(bodies[index].getPosition(), mac, accelerationOf(accelerations, index), G, softening);
+        }
+
+    private:
+        const std::vector<MassObject>& bodies;
+        QuadNode root;
+        double G;
+        OpeningCriterion mac;
+        double softening;
+        std::vector<float> accelerations;
+    };
+
+    class FlatTreePotentialEvaluator : public PotentialEvaluator {
+    public:
+        FlatTreePotentialEvaluator(const std::vector<MassObject>& bodies, double G, const OpeningCriterion& mac, double softening,
+                                   unsigned leafSize, const std::vector<float>& accelerations)
+            : bodies(bodies), G(G), mac(mac), softening(softening), accelerations(accelerations) {
+            tree.build(bodies, computeRootBounds(bodies), leafSize);
+            tree.computeMoments();
+        }
+
+        double potentialAt(size_t index) const override {
+            return tree.computePotentialAt(bodies[index].getPosition(), mac, accelerationOf(accelerations, index), G, static_cast<float>(softening));
+        }
+
+    private:
+        const std::vector<MassObject>& bodies;
+        FlatQuadTree tree;
+        double G;
+        OpeningCriterion mac;
+        double softening;
+        std::vector<float> accelerations;
+    };
+}
 
 BarnesHutCalculator::BarnesHutCalculator(double gravitationalConstant, double theta, double softening)
-    : G(gravitationalConstant), theta(theta), softening(softening) {}
+    : G(gravitationalConstant), softening(softening) {
+    mac.theta = theta;
+}
 
-std::vector<glm::vec2> BarnesHutCalculator::calculateForces(const std::vector<MassObject>& bodies) const {
+void BarnesHutCalculator::setTreeReuse(bool reuse, double maxFraction) {
+    treeReuse = reuse;
+    maxReinsertFraction = maxFraction;
+    treeCache.reset();
+}
+
+void BarnesHutCalculator::permute(const std::vector<size_t>& order) {
+    if (lastAccelerations.size() == order.size()) {
+        std::vector<float> accelerations(order.size());
+        for (size_t i = 0; i < order.size(); ++i) accelerations[i] = lastAccelerations[order[i]];
+        lastAccelerations.swap(accelerations);
+    }
+    else lastAccelerations.clear();
+
+    BarnesHutTreeCache& cache = treeCache;
+    if (!cache.root || cache.leafOf.size() != order.size()) {
+        cache.reset();
+        return;
+    }
+    std::vector<QuadNode*> leafOf(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        leafOf[i] = cache.leafOf[order[i]];
+        if (leafOf[i]) leafOf[i]->body = cache.base + i;
+    }
+    cache.leafOf.swap(leafOf);
+}
+
+void BarnesHutCalculator::updateCachedTree(const std::vector<MassObject>& bodies) const {
     const size_t n = bodies.size();
-    std::vector<glm::vec2> forces(n, { 0.0f, 0.0f });
-    if (n == 0) return forces;
+    BarnesHutTreeCache& cache = treeCache;
+    bool rebuild = !cache.root || cache.base != bodies.data() || cache.leafOf.size() != n;
+
+    if (!rebuild) {
+        // Quality: every body still inside the root, and the root not much looser than the bodies
+        glm::vec2 lo, hi;
+        computeExtent(bodies, lo, hi);
+        const AABB& root = cache.root->bounds;
+        float extent = 0.5f * std::max(std::max(hi.x - lo.x, hi.y - lo.y), 1e-3f);
+        rebuild = !root.contains(lo) || !root.contains(hi) || root.halfSize.x > kMaxLooseness * extent;
+    }
+
+    std::vector<size_t> moved;
+    if (!rebuild) {
+        std::mutex movedMutex;
+        Parallel::parallelFor(0, n, 4096, [&](size_t begin, size_t end) {
+            std::vector<size_t> local;
+            for (size_t i = begin; i < end; ++i) {
+                if (!cache.leafOf[i]->bounds.contains(bodies[i].getPosition())) local.push_back(i);
+            }
+            std::lock_guard<std::mutex> lock(movedMutex);
+            moved.insert(moved.end(), local.begin(), local.end());
+        });
+        rebuild = static_cast<double>(moved.size()) > maxReinsertFraction * static_cast<double>(n);
+    }
+
+    if (rebuild) {
+        AABB bounds = computeRootBounds(bodies);
+        bounds.halfSize *= 1.0f + kRootPadding;
+        cache.root = std::make_unique<QuadNode>(bounds);
+        if (parallelBuild) cache.root->build(bodies, taskCutoff);
+        else for (const auto& b : bodies) cache.root->insert(b);
+        cache.leafOf.assign(n, nullptr);
+        cache.base = bodies.data();
+        lastStats.treeRebuilt = true;
+        lastStats.reinsertedBodies = 0;
+        return;
+    }
+
+    // Empty all vacated leaves first, so no reinsert lands on a body that is about to move
+    std::sort(moved.begin(), moved.end()); // thread-count independent insert order
+    for (size_t i : moved) cache.leafOf[i]->body = nullptr;
+    for (size_t i : moved) cache.root->insert(bodies[i]);
+    lastStats.treeRebuilt = false;
+    lastStats.reinsertedBodies = moved.size();
+}
 
-    // Compute bounding box (AU)
-    float minX = std::numeric_limits<float>::infinity();
-    float minY = std::numeric_limits<float>::infinity();
-    float maxX = -std::numeric_limits<float>::infinity();
-    float maxY = -std::numeric_limits<float>::infinity();
+std::vector<glm::vec2> BarnesHutCalculator::calculateForces(const std::vector<MassObject>& bodies) const {
+    std::vector<glm::vec2> forces;
+    if (calculateWithTestParticles(bodies, forces)) return forces; // the tree holds the massive bodies only
 
-    for (const auto& b : bodies) {
-        glm::vec2 p = b.getPosition();
-        minX = std::min(minX, p.x); maxX = std::max(maxX, p.x);
-        minY = std::min(minY, p.y); maxY = std::max(maxY, p.y);
+    const size_t n = bodies.size();
+    forces.assign(n, { 0.0f, 0.0f });
+    if (n == 0) {
+        treeCache.reset();
+        return forces;
     }
 
-    float width = std::max(maxX - minX, 1e-3f);
-    float height = std::max(maxY - minY, 1e-3f);
-    float half = 0.5f * std::max(width, height);
-    glm::vec2 center = { (minX + maxX) * 0.5f, (minY + maxY) * 0.5f };
+    using clock = std::chrono::steady_clock;
+    auto t0 = clock::now();
 
-    QuadNode root({ center, {half, half} });
-    for (const auto& b : bodies) root.insert(b);
-    root.finalize();
+    const bool flatLayout = flatTree || dualTree;
+    const bool reuse = treeReuse && !flatLayout;
+    FlatQuadTree& flat = treeCache.flat;
+    std::unique_ptr<QuadNode> ownedRoot;
+    if (!reuse && !flatLayout) ownedRoot = std::make_unique<QuadNode>(computeRootBounds(bodies));
+    {
+        NBODY_TRACE_SCOPE("tree_build");
+        Profiler::CounterScope counters(Profiler::Phase::TreeBuild);
+        if (flatLayout) flat.build(bodies, computeRootBounds(bodies), leafSize, parallelBuild ? taskCutoff : 0);
+        else if (reuse) updateCachedTree(bodies);
+        else if (parallelBuild) ownedRoot->build(bodies, taskCutoff);
+        else for (const auto& b : bodies) ownedRoot->insert(b);
+    }
+    const QuadNode* root = flatLayout ? nullptr : (reuse ? treeCache.root.get() : ownedRoot.get());
+    auto t1 = clock::now();
+    {
+        NBODY_TRACE_SCOPE("tree_finalize");
+        Profiler::CounterScope counters(Profiler::Phase::TreeFinalize);
+        if (flatLayout) flat.computeMoments();
+        else if (reuse) treeCache.root->refit(bodies.data(), treeCache.leafOf);
+        else if (!parallelBuild) ownedRoot->finalize();
+    }
+    auto t2 = clock::now();
 
-    for (size_t i = 0; i < n; ++i) {
-        forces[i] = root.computeForceAt(bodies[i].getPosition(), theta, G, softening) * static_cast<float>(bodies[i].getMass());
+    // The tree is read-only from here, every body is independent
+    WalkCounters walk;
+    uint64_t maxBodyNodesVisited = 0;
+    std::mutex walkMutex;
+    if (recordBodyCounters && !dualTree) lastBodyCounters.assign(n, WalkCounters{});
+    else lastBodyCounters.clear();
+    if (dualTree) {
+        lastAccelerations.clear();
+        // Cell pairs are shared by many bodies, there are no per-body counters
+        Profiler::CounterScope counters(Profiler::Phase::ForceWalk);
+        std::vector<glm::vec2> accelerations;
+        flat.computeDualTreeForces(static_cast<float>(mac.theta), G, static_cast<float>(softening), accelerations, &walk);
+        const std::vector<FlatBody>& order = flat.getBodies();
+        for (size_t k = 0; k < n; ++k) {
+            const size_t i = order[k].index;
+            forces[i] = accelerations[k] * static_cast<float>(bodies[i].getMass());
+        }
+    }
+    else {
+        Profiler::CounterScope counters(Profiler::Phase::ForceWalk); // workers are counted through inherit
+        // Each walk reads its body's previous |a| and then replaces it, 0 = unknown
+        const bool relative = mac.type == OpeningCriterion::Type::RelativeAcceleration;
+        if (!relative || lastAccelerations.size() != n) lastAccelerations.clear();
+        if (relative) lastAccelerations.resize(n, 0.0f);
+        Parallel::parallelFor(0, n, 256, [&](size_t begin, size_t end) {
+            NBODY_TRACE_SCOPE("force_walk");
+            WalkCounters local;
+            uint64_t localMaxVisited = 0;
+            for (size_t k = begin; k < end; ++k) {
+                // The flat tree is walked in its own body order, neighbouring walks share their nodes
+                const size_t i = flatTree ? flat.getBodies()[k].index : k;
+                WalkCounters body;
+                const float acceleration = accelerationOf(lastAccelerations, i);
+                const glm::vec2 pull = flatTree
+                    ? flat.computeForceAt(bodies[i].getPosition(), mac, acceleration, G, static_cast<float>(softening), &body)
+                    : root->computeForceAt(bodies[i].getPosition(), mac, acceleration, G, softening, &body);
+                forces[i] = pull * static_cast<float>(bodies[i].getMass());
+                if (relative) lastAccelerations[i] = glm::length(pull);
+                localMaxVisited = std::max(localMaxVisited, body.nodesVisited);
+                local.merge(body);
+                if (recordBodyCounters) lastBodyCounters[i] = body;
+            }
+            std::lock_guard<std::mutex> lock(walkMutex);
+            walk.merge(local);
+            maxBodyNodesVisited = std::max(maxBodyNodesVisited, localMaxVisited);
+        });
     }
+    auto t3 = clock::now();
+
+    lastStats.buildSeconds = std::chrono::duration<double>(t1 - t0).count();
+    lastStats.finalizeSeconds = std::chrono::duration<double>(t2 - t1).count();
+    lastStats.walkSeconds = std::chrono::duration<double>(t3 - t2).count();
+    lastStats.interactions = walk.interactions();
+    lastStats.nodeCount = flatLayout ? flat.getNodes().size() : root->countNodes();
+    lastStats.treeBytes = flatLayout ? flat.getByteSize() : lastStats.nodeCount * sizeof(QuadNode);
+    if (!reuse) {
+        lastStats.treeRebuilt = true;
+        lastStats.reinsertedBodies = 0;
+    }
+    lastStats.nodeBodyInteractions = walk.nodeBody;
+    lastStats.bodyBodyInteractions = walk.bodyBody;
+    lastStats.cellCellInteractions = walk.cellCell;
+    lastStats.nodesVisited = walk.nodesVisited;
+    lastStats.maxDepth = walk.maxDepth;
+    lastStats.maxBodyNodesVisited = maxBodyNodesVisited;
+
+    Profiler::record(Profiler::Phase::TreeBuild, lastStats.buildSeconds);
+    Profiler::record(Profiler::Phase::TreeFinalize, lastStats.finalizeSeconds);
+    Profiler::record(Profiler::Phase::ForceWalk, lastStats.walkSeconds);
+    Profiler::recordWalk({ 1, n, walk.nodeBody, walk.bodyBody, walk.nodesVisited, walk.maxDepth, maxBodyNodesVisited, walk.cellCell });
 
     return forces;
     //return std::vector<glm::vec2>(n, { 0.0f, 0.0f });
-}
\ No newline at end of file
+}
+
+std::unique_ptr<PotentialEvaluator> BarnesHutCalculator::preparePotential(const std::vector<MassObject>& bodies) const {
+    if (bodies.empty()) return ForceCalculator::preparePotential(bodies);
+    if (flatTree) return std::make_unique<FlatTreePotentialEvaluator>(bodies, G, mac, softening, leafSize, lastAccelerations);
+    return std::make_unique<TreePotentialEvaluator>(bodies, G, mac, softening, lastAccelerations);
+}
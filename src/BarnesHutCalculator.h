@@ -1,5 +1,46 @@
 #pragma once
 #include "ForceCalculator.h"
+#include "QuadTree.h"
+#include "FlatQuadTree.h"
+#include <algorithm>
+#include <memory>
+
+// Phase split of the last calculateForces call
+struct BarnesHutStats {
+    double buildSeconds = 0.0;    // bounds + inserts (tree reuse: leaf checks + reinserts)
+    double finalizeSeconds = 0.0; // mass/COM aggregation (tree reuse: bottom-up refit, parallel pointer tree build: none)
+    double walkSeconds = 0.0;     // force evaluation
+    uint64_t interactions = 0;    // body-body and body-cell interactions
+    size_t nodeCount = 0;
+    size_t treeBytes = 0;         // nodes (and the flat tree's body copies)
+
+    // Opening statistics summed over all bodies (see WalkCounters)
+    uint64_t nodeBodyInteractions = 0;
+    uint64_t bodyBodyInteractions = 0;
+    uint64_t cellCellInteractions = 0; // dual-tree traversal only
+    uint64_t nodesVisited = 0;
+    uint32_t maxDepth = 0;
+    uint64_t maxBodyNodesVisited = 0; // most expensive body, compare with nodesVisited / N for imbalance
+
+    // Tree reuse only
+    bool treeRebuilt = true;      // false when the previous tree was refitted
+    size_t reinsertedBodies = 0;  // bodies that had left their leaf
+};
+
+// Trees kept between calls (the reused pointer tree, the flat tree's storage). Copies (clone())
+// start empty, a tree only ever belongs to the calculator and body storage it was built for
+struct BarnesHutTreeCache {
+    std::unique_ptr<QuadNode> root;
+    std::vector<QuadNode*> leafOf; // leaf holding each body
+    const MassObject* base = nullptr;
+    FlatQuadTree flat;             // rebuilt every call, kept for its allocations
+
+    BarnesHutTreeCache() = default;
+    BarnesHutTreeCache(const BarnesHutTreeCache&) {}
+    BarnesHutTreeCache& operator=(const BarnesHutTreeCache&) { reset(); return *this; }
+    void reset() { root.reset(); leafOf.clear(); base = nullptr; flat.clear(); }
+};
+
 class BarnesHutCalculator : public ForceCalculator
 {
 public:
@@ -7,15 +48,81 @@ public:
 
     std::vector<glm::vec2> calculateForces(const std::vector<MassObject>& massObjects) const override;
 
-    void setTheta(double t) { theta = t; }
-    double getTheta() const { return theta; }
+    // Builds a tree once, potentials are then evaluated with the same opening criterion as the forces
+    std::unique_ptr<PotentialEvaluator> preparePotential(const std::vector<MassObject>& massObjects) const override;
+
+    void setTheta(double t) { mac.theta = t; }
+    double getTheta() const { return mac.theta; }
+
+    // Cell acceptance of the per-body walks (theta included), Geometric by default. The relative
+    // criterion uses each body's |a| from the previous call and falls back to theta while there
+    // is none. The dual tree keeps its own size-sum criterion with theta
+    void setOpeningCriterion(const OpeningCriterion& criterion) { mac = criterion; }
+    const OpeningCriterion& getOpeningCriterion() const { return mac; }
 
     void setSoftening(double s) { softening = s; }
-    double getSoftening() const { return softening; }
+    double getSoftening() const override { return softening; }
+
+    double getGravitationalConstant() const override { return G; }
+
+    std::unique_ptr<ForceCalculator> clone() const override { return std::make_unique<BarnesHutCalculator>(*this); }
+
+    // Tree interactions of the massive bodies plus test particles times massive bodies (the stats
+    // and per-body counters cover the massive bodies only)
+    uint64_t getLastInteractionCount() const override { return lastStats.interactions + lastTestParticleInteractions; }
+    const BarnesHutStats& getLastStats() const { return lastStats; }
+
+    // Keep the tree across calls: bodies that left their leaf are reinserted and the moments are
+    // refitted bottom-up. The tree is rebuilt when the body storage changes, a body leaves the
+    // root, the root grows looser than 2x the bodies' extent, or more than 'maxReinsertFraction'
+    // of the bodies moved to another leaf
+    void setTreeReuse(bool reuse, double maxReinsertFraction = 0.1);
+    bool getTreeReuse() const { return treeReuse; }
+
+    // Walk a flattened depth-first node array with leaf buckets of up to 'leafSize' bodies
+    // instead of the pointer tree (see FlatQuadTree). Rebuilt every call, tree reuse is ignored
+    void setFlatTree(bool flat, unsigned leafSize = 8) { flatTree = flat; this->leafSize = std::max(1u, leafSize); }
+    bool getFlatTree() const { return flatTree; }
+    unsigned getLeafSize() const { return leafSize; }
+
+    // Dual-tree (cell-cell) traversal on the flat tree, see FlatQuadTree::computeDualTreeForces.
+    // A pair is accepted when the two cells' sizes add up to less than theta times their distance
+    void setDualTree(bool dual) { dualTree = dual; }
+    bool getDualTree() const { return dualTree; }
+
+    // Top-down tree build: the top levels are split with parallel partition passes, subtrees of
+    // at most 'taskCutoff' bodies are built as parallel tasks (the pointer tree's with their
+    // moments, the finalize phase is then empty). Same pointer tree as the inserts, results do not
+    // depend on the thread count. On by default, off = serial inserts and partitions
+    void setParallelBuild(bool parallel, size_t taskCutoff = 4096) { parallelBuild = parallel; this->taskCutoff = std::max<size_t>(1, taskCutoff); }
+    bool getParallelBuild() const { return parallelBuild; }
+    size_t getTaskCutoff() const { return taskCutoff; }
+
+    // The kept tree and the previous accelerations follow a reordering of the same storage
+    void permute(const std::vector<size_t>& order) override;
+
+    // Keep the walk counters of every body from the next calculateForces calls (off by default)
+    void setRecordBodyCounters(bool record) { recordBodyCounters = record; }
+    const std::vector<WalkCounters>& getLastBodyCounters() const { return lastBodyCounters; }
 
 private:
     double G;
-    double theta;
+    OpeningCriterion mac;
     double softening;
+    // Brings the cached tree up to date with 'bodies' (inserts and reinserts, not the moments)
+    void updateCachedTree(const std::vector<MassObject>& bodies) const;
+
+    bool recordBodyCounters = false;
+    bool treeReuse = false;
+    bool flatTree = false;
+    bool dualTree = false;
+    unsigned leafSize = 8;
+    bool parallelBuild = true;
+    size_t taskCutoff = 4096;
+    double maxReinsertFraction = 0.1;
+    mutable BarnesHutTreeCache treeCache;
+    mutable BarnesHutStats lastStats;
+    mutable std::vector<WalkCounters> lastBodyCounters;
+    mutable std::vector<float> lastAccelerations; // |a| per body, RelativeAcceleration only
 };
 
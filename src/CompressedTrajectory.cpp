@@ -0,0 +1,514 @@
+#include "CompressedTrajectory.h"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    constexpr char kMagic[4] = { 'N', 'B', 'T', 'Z' };
+    constexpr char kIndexMagic[4] = { 'N', 'B', 'T', 'I' };
+    constexpr uint32_t kVersion = 2;
+
+    constexpr uint8_t kMethodStored = 0;
+    constexpr uint8_t kMethodLZ = 1;
+
+    constexpr size_t kBlockHeaderSize = 4 + 4 + 1 + 1 + 8 + 8 + 4;
+    constexpr size_t kIndexEntrySize = 8 + 8 + 8 + 4 + 1;
+    constexpr size_t kTrailerSize = 8 + 4 + 4;
+
+    constexpr size_t kMinMatch = 4;
+    constexpr size_t kMaxOffset = 65535;
+    constexpr int kHashBits = 16;
+
+    template <typename T>
+    void put(std::vector<uint8_t>& out, const T& value) {
+        const size_t offset = out.size();
+        out.resize(offset + sizeof(T));
+        std::memcpy(out.data() + offset, &value, sizeof(T));
+    }
+
+    template <typename T>
+    T get(const uint8_t* p) {
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        return value;
+    }
+
+    inline uint32_t read32(const uint8_t* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t hash32(uint32_t v) {
+        return (v * 2654435761u) >> (32 - kHashBits);
+    }
+
+    void putLength(std::vector<uint8_t>& out, size_t length) {
+        while (length >= 255) {
+            out.push_back(255);
+            length -= 255;
+        }
+        out.push_back(static_cast<uint8_t>(length));
+    }
+
+    inline uint64_t zigzag(int64_t v) {
+        return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+    }
+
+    inline int64_t unzigzag(uint64_t v) {
+        return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+    }
+
+    inline int64_t quantize(float x, double invStep) {
+        if (!std::isfinite(x)) return 0;
+        double q = std::nearbyint(static_cast<double>(x) * invStep);
+        q = std::clamp(q, -4.0e18, 4.0e18);
+        return static_cast<int64_t>(q);
+    }
+
+    inline float fieldValue(const TrajectoryFrame& f, int field, size_t i) {
+        switch (field) {
+        case 0: return f.positions[i].x;
+        case 1: return f.positions[i].y;
+        case 2: return f.velocities[i].x;
+        default: return f.velocities[i].y;
+        }
+    }
+
+    inline void setFieldValue(TrajectoryFrame& f, int field, size_t i, float v) {
+        switch (field) {
+        case 0: f.positions[i].x = v; break;
+        case 1: f.positions[i].y = v; break;
+        case 2: f.velocities[i].x = v; break;
+        default: f.velocities[i].y = v; break;
+        }
+    }
+}
+
+// --- Codec stages ---
+
+void TrajectoryCodec::lzCompress(const uint8_t* src, size_t size, std::vector<uint8_t>& out) {
+    std::vector<uint32_t> table(size_t(1) << kHashBits, UINT32_MAX);
+
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + kMinMatch <= size) {
+        uint32_t seq = read32(src + i);
+        uint32_t h = hash32(seq);
+        uint32_t candidate = table[h];
+        table[h] = static_cast<uint32_t>(i);
+
+        if (candidate != UINT32_MAX && i - candidate <= kMaxOffset && read32(src + candidate) == seq) {
+            size_t length = kMinMatch;
+            while (i + length < size && src[candidate + length] == src[i + length]) ++length;
+
+            size_t literals = i - anchor;
+            size_t extra = length - kMinMatch;
+            out.push_back(static_cast<uint8_t>((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(extra, 15)));
+            if (literals >= 15) putLength(out, literals - 15);
+            out.insert(out.end(), src + anchor, src + i);
+            uint16_t offset = static_cast<uint16_t>(i - candidate);
+            put(out, offset);
+            if (extra >= 15) putLength(out, extra - 15);
+
+            i += length;
+            anchor = i;
+        }
+        else {
+            ++i;
+        }
+    }
+
+    // Trailing literals (a sequence without a match)
+    size_t literals = size - anchor;
+    out.push_back(static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4));
+    if (literals >= 15) putLength(out, literals - 15);
+    out.insert(out.end(), src + anchor, src + size);
+}
+
+bool TrajectoryCodec::lzDecompress(const uint8_t* src, size_t size, uint8_t* out, size_t outSize) {
+    size_t ip = 0;
+    size_t op = 0;
+    while (ip < size) {
+        uint8_t token = src[ip++];
+
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            uint8_t b;
+            do {
+                if (ip >= size) return false;
+                b = src[ip++];
+                literals += b;
+            } while (b == 255);
+        }
+        if (ip + literals > size || op + literals > outSize) return false;
+        std::memcpy(out + op, src + ip, literals);
+        ip += literals;
+        op += literals;
+
+        if (ip == size) break; // last sequence has no match
+
+        if (ip + 2 > size) return false;
+        size_t offset = get<uint16_t>(src + ip);
+        ip += 2;
+
+        size_t length = token & 0x0F;
+        if (length == 15) {
+            uint8_t b;
+            do {
+                if (ip >= size) return false;
+                b = src[ip++];
+                length += b;
+            } while (b == 255);
+        }
+        length += kMinMatch;
+
+        if (offset == 0 || offset > op || op + length > outSize) return false;
+        // Byte copy, matches may overlap their own output
+        const uint8_t* match = out + op - offset;
+        for (size_t k = 0; k < length; ++k) out[op + k] = match[k];
+        op += length;
+    }
+    return op == outSize;
+}
+
+void TrajectoryCodec::shuffle(const uint8_t* src, size_t count, size_t elementSize, uint8_t* dst) {
+    for (size_t b = 0; b < elementSize; ++b) {
+        uint8_t* plane = dst + b * count;
+        for (size_t i = 0; i < count; ++i) plane[i] = src[i * elementSize + b];
+    }
+}
+
+void TrajectoryCodec::unshuffle(const uint8_t* src, size_t count, size_t elementSize, uint8_t* dst) {
+    for (size_t b = 0; b < elementSize; ++b) {
+        const uint8_t* plane = src + b * count;
+        for (size_t i = 0; i < count; ++i) dst[i * elementSize + b] = plane[i];
+    }
+}
+
+void TrajectoryCodecState::reset(size_t count) {
+    for (int f = 0; f < 4; ++f) {
+        prevBits[f].assign(count, 0u);
+        prevQuant[f].assign(count, 0);
+    }
+    prevIds.assign(count, 0);
+}
+
+// --- Writer ---
+
+CompressedTrajectorySink::CompressedTrajectorySink(const std::string& path, const CompressionOptions& options)
+    : file(path, std::ios::binary | std::ios::trunc), options(options) {
+    if (!file.is_open()) {
+        std::cerr << "Failed to open trajectory file " << path << "\n";
+        return;
+    }
+    this->options.keyframeInterval = std::max(1u, options.keyframeInterval);
+    this->options.positionTolerance = std::max(0.0, options.positionTolerance);
+    this->options.velocityTolerance = std::max(0.0, options.velocityTolerance);
+
+    std::vector<uint8_t> header;
+    header.insert(header.end(), kMagic, kMagic + 4);
+    put(header, kVersion);
+    put(header, this->options.positionTolerance);
+    put(header, this->options.velocityTolerance);
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+    storedBytes += header.size();
+}
+
+CompressedTrajectorySink::~CompressedTrajectorySink() {
+    close();
+}
+
+size_t CompressedTrajectorySink::writeFrame(const TrajectoryFrame& frame) {
+    if (!file.is_open()) return 0;
+
+    const size_t n = frame.positions.size();
+    const bool keyframe = index.empty() || framesSinceKeyframe >= options.keyframeInterval ||
+                          index.back().count != n;
+    if (keyframe) {
+        state.reset(n);
+        framesSinceKeyframe = 0;
+    }
+    ++framesSinceKeyframe;
+
+    // Delta + shuffle each column into the raw block
+    block.clear();
+    for (int field = 0; field < 4; ++field) {
+        const double tolerance = (field < 2) ? options.positionTolerance : options.velocityTolerance;
+        if (tolerance > 0.0) {
+            // Rounding to a grid of 2*tolerance keeps every value within +-tolerance
+            const double invStep = 1.0 / (2.0 * tolerance);
+            columnBuffer.resize(n * sizeof(uint64_t));
+            for (size_t i = 0; i < n; ++i) {
+                int64_t q = quantize(fieldValue(frame, field, i), invStep);
+                uint64_t d = zigzag(static_cast<int64_t>(static_cast<uint64_t>(q) - static_cast<uint64_t>(state.prevQuant[field][i])));
+                state.prevQuant[field][i] = q;
+                std::memcpy(columnBuffer.data() + i * sizeof(uint64_t), &d, sizeof(d));
+            }
+            shuffled.resize(columnBuffer.size());
+            TrajectoryCodec::shuffle(columnBuffer.data(), n, sizeof(uint64_t), shuffled.data());
+        }
+        else {
+            columnBuffer.resize(n * sizeof(uint32_t));
+            for (size_t i = 0; i < n; ++i) {
+                uint32_t bits;
+                float v = fieldValue(frame, field, i);
+                std::memcpy(&bits, &v, sizeof(bits));
+                uint32_t d = bits ^ state.prevBits[field][i];
+                state.prevBits[field][i] = bits;
+                std::memcpy(columnBuffer.data() + i * sizeof(uint32_t), &d, sizeof(d));
+            }
+            shuffled.resize(columnBuffer.size());
+            TrajectoryCodec::shuffle(columnBuffer.data(), n, sizeof(uint32_t), shuffled.data());
+        }
+        block.insert(block.end(), shuffled.begin(), shuffled.end());
+    }
+
+    // IDs only change when bodies are added or removed, so the XOR delta is almost always zero
+    columnBuffer.resize(n * sizeof(uint64_t));
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t id = (i < frame.ids.size()) ? frame.ids[i] : 0;
+        uint64_t d = id ^ state.prevIds[i];
+        state.prevIds[i] = id;
+        std::memcpy(columnBuffer.data() + i * sizeof(uint64_t), &d, sizeof(d));
+    }
+    shuffled.resize(columnBuffer.size());
+    TrajectoryCodec::shuffle(columnBuffer.data(), n, sizeof(uint64_t), shuffled.data());
+    block.insert(block.end(), shuffled.begin(), shuffled.end());
+
+    // LZ stage, fall back to storing the block if it does not shrink
+    compressed.clear();
+    TrajectoryCodec::lzCompress(block.data(), block.size(), compressed);
+    uint8_t method = kMethodLZ;
+    const std::vector<uint8_t>* payload = &compressed;
+    if (compressed.size() >= block.size()) {
+        method = kMethodStored;
+        payload = &block;
+    }
+
+    IndexEntry entry{ static_cast<uint64_t>(file.tellp()), frame.step, frame.time, static_cast<uint32_t>(n), static_cast<uint8_t>(keyframe ? 1 : 0) };
+
+    std::vector<uint8_t> header;
+    header.reserve(kBlockHeaderSize);
+    put(header, static_cast<uint32_t>(payload->size()));
+    put(header, static_cast<uint32_t>(block.size()));
+    put(header, method);
+    put(header, entry.keyframe);
+    put(header, entry.step);
+    put(header, entry.time);
+    put(header, entry.count);
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+    file.write(reinterpret_cast<const char*>(payload->data()), payload->size());
+    if (!file) return 0;
+
+    index.push_back(entry);
+    rawBytes += block.size();
+    size_t written = header.size() + payload->size();
+    storedBytes += written;
+    return written;
+}
+
+void CompressedTrajectorySink::flush() {
+    if (file.is_open()) file.flush();
+}
+
+void CompressedTrajectorySink::close() {
+    if (!file.is_open()) return;
+
+    std::vector<uint8_t> footer;
+    footer.reserve(index.size() * kIndexEntrySize + kTrailerSize);
+    uint64_t indexOffset = static_cast<uint64_t>(file.tellp());
+    for (const IndexEntry& e : index) {
+        put(footer, e.offset);
+        put(footer, e.step);
+        put(footer, e.time);
+        put(footer, e.count);
+        put(footer, e.keyframe);
+    }
+    put(footer, indexOffset);
+    put(footer, static_cast<uint32_t>(index.size()));
+    footer.insert(footer.end(), kIndexMagic, kIndexMagic + 4);
+    file.write(reinterpret_cast<const char*>(footer.data()), footer.size());
+    storedBytes += footer.size();
+    file.close();
+}
+
+// --- Reader ---
+
+CompressedTrajectoryReader::CompressedTrajectoryReader(const std::string& path)
+    : file(path, std::ios::binary) {
+    if (!file.is_open()) {
+        std::cerr << "Failed to open trajectory file " << path << "\n";
+        return;
+    }
+
+    uint8_t header[4 + 4 + 8 + 8];
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!file || std::memcmp(header, kMagic, 4) != 0 || get<uint32_t>(header + 4) != kVersion) {
+        std::cerr << "Not a compressed trajectory file: " << path << "\n";
+        file.close();
+        return;
+    }
+    positionTolerance = get<double>(header + 8);
+    velocityTolerance = get<double>(header + 16);
+
+    if (!readIndexFooter()) {
+        rebuildIndexByScanning();
+    }
+}
+
+bool CompressedTrajectoryReader::readIndexFooter() {
+    file.clear();
+    file.seekg(0, std::ios::end);
+    const uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    if (fileSize < 24 + kTrailerSize) return false;
+
+    uint8_t trailer[kTrailerSize];
+    file.seekg(static_cast<std::streamoff>(fileSize - kTrailerSize));
+    file.read(reinterpret_cast<char*>(trailer), kTrailerSize);
+    if (!file || std::memcmp(trailer + 12, kIndexMagic, 4) != 0) return false;
+
+    const uint64_t indexOffset = get<uint64_t>(trailer);
+    const uint32_t frameCount = get<uint32_t>(trailer + 8);
+    if (indexOffset + uint64_t(frameCount) * kIndexEntrySize + kTrailerSize != fileSize) return false;
+
+    std::vector<uint8_t> raw(size_t(frameCount) * kIndexEntrySize);
+    file.seekg(static_cast<std::streamoff>(indexOffset));
+    file.read(reinterpret_cast<char*>(raw.data()), raw.size());
+    if (!file) return false;
+
+    index.resize(frameCount);
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        const uint8_t* p = raw.data() + size_t(i) * kIndexEntrySize;
+        index[i] = { get<uint64_t>(p), get<uint64_t>(p + 8), get<double>(p + 16), get<uint32_t>(p + 24), p[28] };
+    }
+    return true;
+}
+
+void CompressedTrajectoryReader::rebuildIndexByScanning() {
+    index.clear();
+    file.clear();
+    file.seekg(0, std::ios::end);
+    const uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+
+    uint64_t offset = 24;
+    uint8_t header[kBlockHeaderSize];
+    while (offset + kBlockHeaderSize <= fileSize) {
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(reinterpret_cast<char*>(header), kBlockHeaderSize);
+        if (!file) break;
+
+        uint32_t storedSize = get<uint32_t>(header);
+        if (offset + kBlockHeaderSize + storedSize > fileSize) break; // truncated last block
+        index.push_back({ offset, get<uint64_t>(header + 10), get<double>(header + 18), get<uint32_t>(header + 26), header[9] });
+        offset += kBlockHeaderSize + storedSize;
+    }
+    file.clear();
+}
+
+size_t CompressedTrajectoryReader::findFrameAtTime(double t) const {
+    auto it = std::upper_bound(index.begin(), index.end(), t,
+        [](double value, const IndexEntry& e) { return value < e.time; });
+    return (it == index.begin()) ? 0 : static_cast<size_t>(it - index.begin()) - 1;
+}
+
+bool CompressedTrajectoryReader::readFrame(size_t frame, TrajectoryFrame& out) {
+    if (!file.is_open() || frame >= index.size()) return false;
+
+    // Continue from the last decoded frame when possible, otherwise restart at the keyframe
+    size_t start = frame;
+    while (start > 0 && !index[start].keyframe) --start;
+    if (lastDecoded != static_cast<size_t>(-1) && lastDecoded >= start && lastDecoded < frame) {
+        start = lastDecoded + 1;
+    }
+
+    for (size_t f = start; f <= frame; ++f) {
+        if (!decodeBlock(f, out)) {
+            lastDecoded = static_cast<size_t>(-1);
+            return false;
+        }
+        lastDecoded = f;
+    }
+    return true;
+}
+
+bool CompressedTrajectoryReader::decodeBlock(size_t frame, TrajectoryFrame& out) {
+    const IndexEntry& entry = index[frame];
+
+    uint8_t header[kBlockHeaderSize];
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(entry.offset));
+    file.read(reinterpret_cast<char*>(header), kBlockHeaderSize);
+    if (!file) return false;
+
+    const uint32_t storedSize = get<uint32_t>(header);
+    const uint32_t rawSize = get<uint32_t>(header + 4);
+    const uint8_t method = header[8];
+    const size_t n = entry.count;
+
+    stored.resize(storedSize);
+    file.read(reinterpret_cast<char*>(stored.data()), storedSize);
+    if (!file) return false;
+
+    if (method == kMethodLZ) {
+        block.resize(rawSize);
+        if (!TrajectoryCodec::lzDecompress(stored.data(), stored.size(), block.data(), block.size())) return false;
+    }
+    else {
+        block.swap(stored);
+    }
+
+    if (entry.keyframe) state.reset(n);
+    if (state.prevBits[0].size() != n) return false;
+
+    out.step = entry.step;
+    out.time = entry.time;
+    out.positions.resize(n);
+    out.velocities.resize(n);
+
+    size_t offset = 0;
+    for (int field = 0; field < 4; ++field) {
+        const double tolerance = (field < 2) ? positionTolerance : velocityTolerance;
+        const size_t elementSize = (tolerance > 0.0) ? sizeof(uint64_t) : sizeof(uint32_t);
+        if (offset + n * elementSize > block.size()) return false;
+
+        column.resize(n * elementSize);
+        TrajectoryCodec::unshuffle(block.data() + offset, n, elementSize, column.data());
+        offset += n * elementSize;
+
+        if (tolerance > 0.0) {
+            const double step = 2.0 * tolerance;
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t d;
+                std::memcpy(&d, column.data() + i * sizeof(uint64_t), sizeof(d));
+                int64_t q = static_cast<int64_t>(static_cast<uint64_t>(state.prevQuant[field][i]) + static_cast<uint64_t>(unzigzag(d)));
+                state.prevQuant[field][i] = q;
+                setFieldValue(out, field, i, static_cast<float>(static_cast<double>(q) * step));
+            }
+        }
+        else {
+            for (size_t i = 0; i < n; ++i) {
+                uint32_t d;
+                std::memcpy(&d, column.data() + i * sizeof(uint32_t), sizeof(d));
+                uint32_t bits = d ^ state.prevBits[field][i];
+                state.prevBits[field][i] = bits;
+                float v;
+                std::memcpy(&v, &bits, sizeof(v));
+                setFieldValue(out, field, i, v);
+            }
+        }
+    }
+
+    if (offset + n * sizeof(uint64_t) > block.size()) return false;
+    column.resize(n * sizeof(uint64_t));
+    TrajectoryCodec::unshuffle(block.data() + offset, n, sizeof(uint64_t), column.data());
+    out.ids.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t d;
+        std::memcpy(&d, column.data() + i * sizeof(uint64_t), sizeof(d));
+        state.prevIds[i] ^= d;
+        out.ids[i] = state.prevIds[i];
+    }
+    return true;
+}
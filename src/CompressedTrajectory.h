@@ -0,0 +1,130 @@
+#pragma once
+#include "TrajectoryWriter.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+
+// Self-contained compressed trajectory format (.nbtz)
+//
+// Every frame is stored column by column (px, py, vx, vy, id). Each column is
+//   1. delta-encoded against the previous frame (XOR of the float bits when lossless,
+//      zigzag difference of the quantized integers when a tolerance is set, XOR for IDs)
+//   2. byte-shuffled so the mostly-zero high bytes of the deltas end up next to each other
+//   3. passed through a small LZ77 stage (LZ4-style tokens, 64 KiB window)
+// Keyframes (no delta) are written every keyframeInterval frames so any frame can be
+// decoded by seeking to the preceding keyframe through the index footer.
+//
+// File layout:
+//   header:  "NBTZ", uint32 version, double positionTolerance, double velocityTolerance
+//   block:   uint32 storedSize, uint32 rawSize, uint8 method, uint8 keyframe,
+//            uint64 step, double time, uint32 count, storedSize bytes of payload
+//   index:   frameCount * { uint64 offset, uint64 step, double time, uint32 count, uint8 keyframe }
+//   trailer: uint64 indexOffset, uint32 frameCount, "NBTI"
+namespace TrajectoryCodec {
+    // LZ stage, returns compressed bytes appended to 'out'
+    void lzCompress(const uint8_t* src, size_t size, std::vector<uint8_t>& out);
+    // Returns false on corrupt input, 'out' must already have the decompressed size
+    bool lzDecompress(const uint8_t* src, size_t size, uint8_t* out, size_t outSize);
+
+    // Byte shuffle of 'count' elements of 'elementSize' bytes
+    void shuffle(const uint8_t* src, size_t count, size_t elementSize, uint8_t* dst);
+    void unshuffle(const uint8_t* src, size_t count, size_t elementSize, uint8_t* dst);
+}
+
+struct CompressionOptions {
+    double positionTolerance = 0.0; // max absolute position error in AU, 0 = lossless
+    double velocityTolerance = 0.0; // max absolute velocity error in AU/year, 0 = lossless
+    unsigned keyframeInterval = 32; // frames between full (non-delta) frames
+};
+
+// Per-column delta/quantization state shared by the encoder and the decoder
+struct TrajectoryCodecState {
+    std::vector<uint32_t> prevBits[4];  // lossless columns
+    std::vector<int64_t> prevQuant[4];  // quantized columns
+    std::vector<uint64_t> prevIds;
+    void reset(size_t count);
+};
+
+class CompressedTrajectorySink : public TrajectorySink {
+public:
+    CompressedTrajectorySink(const std::string& path, const CompressionOptions& options = CompressionOptions());
+    ~CompressedTrajectorySink() override; // writes the index footer
+
+    bool isOpen() const override { return file.is_open(); }
+
+    size_t writeFrame(const TrajectoryFrame& frame) override;
+    void flush() override;
+
+    // Write the index footer and close the file
+    void close();
+
+    uint64_t getRawBytes() const { return rawBytes; }       // uncompressed frame payload
+    uint64_t getStoredBytes() const { return storedBytes; } // bytes written to disk
+
+private:
+    struct IndexEntry {
+        uint64_t offset;
+        uint64_t step;
+        double time;
+        uint32_t count;
+        uint8_t keyframe;
+    };
+
+    std::ofstream file;
+    CompressionOptions options;
+    TrajectoryCodecState state;
+    std::vector<IndexEntry> index;
+    uint64_t framesSinceKeyframe = 0;
+    uint64_t rawBytes = 0;
+    uint64_t storedBytes = 0;
+
+    // Scratch buffers reused across frames
+    std::vector<uint8_t> columnBuffer;
+    std::vector<uint8_t> shuffled;
+    std::vector<uint8_t> block;
+    std::vector<uint8_t> compressed;
+};
+
+// Random-access reader for .nbtz files
+class CompressedTrajectoryReader {
+public:
+    CompressedTrajectoryReader(const std::string& path);
+
+    bool isOpen() const { return file.is_open(); }
+
+    size_t getFrameCount() const { return index.size(); }
+    uint64_t getFrameStep(size_t frame) const { return index[frame].step; }
+    double getFrameTime(size_t frame) const { return index[frame].time; }
+
+    // Decode frame 'frame' (seeks to the preceding keyframe unless reading sequentially)
+    bool readFrame(size_t frame, TrajectoryFrame& out);
+
+    // Index of the last frame with time <= t
+    size_t findFrameAtTime(double t) const;
+
+private:
+    struct IndexEntry {
+        uint64_t offset;
+        uint64_t step;
+        double time;
+        uint32_t count;
+        uint8_t keyframe;
+    };
+
+    bool readIndexFooter();
+    void rebuildIndexByScanning(); // for files whose writer never closed
+    bool decodeBlock(size_t frame, TrajectoryFrame& out);
+
+    std::ifstream file;
+    double positionTolerance = 0.0;
+    double velocityTolerance = 0.0;
+    std::vector<IndexEntry> index;
+
+    TrajectoryCodecState state;
+    size_t lastDecoded = static_cast<size_t>(-1);
+
+    std::vector<uint8_t> stored;
+    std::vector<uint8_t> block;
+    std::vector<uint8_t> column;
+};
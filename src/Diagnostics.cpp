@@ -0,0 +1,104 @@
+#include "Diagnostics.h"
+#include "ForceCalculator.h"
+#include "Parallel.h"
+#include "TestParticles.h"
+#include <cmath>
+#include <cstring>
+
+namespace {
+    constexpr size_t kReduceBlock = 1 << 12; // potential queries are expensive, keep blocks small enough to balance
+
+    struct Sums {
+        double mass = 0.0;
+        double kinetic = 0.0;
+        double potential = 0.0;
+        double px = 0.0, py = 0.0;
+        double angular = 0.0;
+        double mx = 0.0, my = 0.0;
+        uint64_t hash = 0;
+    };
+
+    uint64_t mixHash(uint64_t h, uint64_t value) {
+        return h ^ (value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+    }
+
+    template <typename T>
+    uint64_t bitsOf(const T& value) {
+        static_assert(sizeof(T) == sizeof(uint64_t), "hashed fields are 8 bytes");
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    Sums combine(const Sums& a, const Sums& b) {
+        Sums s;
+        s.mass = a.mass + b.mass;
+        s.kinetic = a.kinetic + b.kinetic;
+        s.potential = a.potential + b.potential;
+        s.px = a.px + b.px; s.py = a.py + b.py;
+        s.angular = a.angular + b.angular;
+        s.mx = a.mx + b.mx; s.my = a.my + b.my;
+        s.hash = mixHash(a.hash, b.hash);
+        return s;
+    }
+}
+
+SystemDiagnostics Diagnostics::compute(const std::vector<MassObject>& massObjects, const ForceCalculator& calculator) {
+    SystemDiagnostics d;
+    d.bodyCount = massObjects.size();
+    if (massObjects.empty()) return d;
+
+    // Test particles are not sources: the calculator sees the massive bodies, the test particles
+    // get their potential from those directly. slotIndex maps a slot to its place in either list
+    std::vector<size_t> tests, sources, slotIndex;
+    std::vector<MassObject> massiveBodies;
+    std::vector<double> testPotentials;
+    const bool hasTestParticles = TestParticles::split(massObjects, tests, sources);
+    if (hasTestParticles) {
+        slotIndex.resize(massObjects.size());
+        massiveBodies.reserve(sources.size());
+        for (size_t k = 0; k < sources.size(); ++k) {
+            slotIndex[sources[k]] = k;
+            massiveBodies.push_back(massObjects[sources[k]]);
+        }
+        for (size_t k = 0; k < tests.size(); ++k) slotIndex[tests[k]] = k;
+        testPotentials = TestParticles::computePotentials(massObjects, tests, sources,
+                                                          calculator.getGravitationalConstant(), calculator.getSoftening());
+    }
+    std::unique_ptr<PotentialEvaluator> potential = calculator.preparePotential(hasTestParticles ? massiveBodies : massObjects);
+
+    Sums total = Parallel::parallelReduce(0, massObjects.size(), kReduceBlock, Sums{},
+        [&](size_t begin, size_t end) {
+            Sums s;
+            for (size_t i = begin; i < end; ++i) {
+                const MassObject& o = massObjects[i];
+                const double m = o.getMass();
+                const double x = o.getPosition().x, y = o.getPosition().y;
+                const double vx = o.getVelocity().x, vy = o.getVelocity().y;
+
+                s.mass += m;
+                s.kinetic += 0.5 * m * (vx * vx + vy * vy);
+                // Every pair of massive bodies is seen twice, a test particle's pairs once
+                if (!hasTestParticles) s.potential += 0.5 * m * potential->potentialAt(i);
+                else if (o.isTestParticle()) s.potential += m * testPotentials[slotIndex[i]];
+                else s.potential += 0.5 * m * potential->potentialAt(slotIndex[i]);
+                s.px += m * vx; s.py += m * vy;
+                s.angular += m * (x * vy - y * vx);
+                s.mx += m * x; s.my += m * y;
+                s.hash = mixHash(mixHash(mixHash(s.hash, bitsOf(m)), bitsOf(o.getPosition())), bitsOf(o.getVelocity()));
+            }
+            return s;
+        },
+        combine);
+
+    d.totalMass = total.mass;
+    d.kineticEnergy = total.kinetic;
+    d.potentialEnergy = total.potential;
+    d.totalEnergy = total.kinetic + total.potential;
+    d.linearMomentum = { total.px, total.py };
+    d.angularMomentum = total.angular;
+    if (total.mass > 0.0) d.centreOfMass = { total.mx / total.mass, total.my / total.mass };
+    if (total.potential != 0.0) d.virialRatio = 2.0 * total.kinetic / std::abs(total.potential);
+    d.stateHash = total.hash;
+    return d;
+}
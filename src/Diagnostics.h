@@ -0,0 +1,32 @@
+#pragma once
+#include "MassObject.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+class ForceCalculator;
+
+// Conserved quantities and global state of the system at one instant
+struct SystemDiagnostics {
+    double time = 0.0;            // simulated years (filled in by the caller)
+    size_t bodyCount = 0;
+    double totalMass = 0.0;       // M☉
+    double kineticEnergy = 0.0;   // M☉·AU²/year²
+    double potentialEnergy = 0.0; // M☉·AU²/year², same approximation as the forces
+    double totalEnergy = 0.0;
+    glm::dvec2 linearMomentum{ 0.0 }; // M☉·AU/year
+    double angularMomentum = 0.0;     // z component about the origin, M☉·AU²/year
+    glm::dvec2 centreOfMass{ 0.0 };   // AU
+    double virialRatio = 0.0;         // 2K/|W|, ~1 for a relaxed self-gravitating system
+    uint64_t stateHash = 0;           // masses, positions and velocities bit for bit, in slot order
+};
+
+namespace Diagnostics {
+    // One fused parallel pass over the bodies, the potential is evaluated through
+    // calculator.preparePotential() so tree calculators cost O(N log N) instead of O(N²).
+    // Test particles only feel the massive bodies' potential (see TestParticles.h).
+    // Sums are reduced over fixed blocks, the result does not depend on the thread count.
+    // Equal state hashes of two runs at the same step mean bitwise identical trajectories so far.
+    SystemDiagnostics compute(const std::vector<MassObject>& massObjects, const ForceCalculator& calculator);
+}
@@ -0,0 +1,136 @@
+#include "DiagnosticsMonitor.h"
+#include "ForceCalculator.h"
+#include "Trace.h"
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+DiagnosticsHistory::DiagnosticsHistory(size_t capacity)
+    : ring(std::max<size_t>(capacity, 1)) {}
+
+void DiagnosticsHistory::push(const DiagnosticsSample& sample) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ring[head] = sample;
+    head = (head + 1) % ring.size();
+    count = std::min(count + 1, ring.size());
+}
+
+void DiagnosticsHistory::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    head = 0;
+    count = 0;
+}
+
+std::vector<DiagnosticsSample> DiagnosticsHistory::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<DiagnosticsSample> out;
+    out.reserve(count);
+    size_t first = (head + ring.size() - count) % ring.size();
+    for (size_t i = 0; i < count; ++i) {
+        out.push_back(ring[(first + i) % ring.size()]);
+    }
+    return out;
+}
+
+bool DiagnosticsHistory::latest(DiagnosticsSample& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (count == 0) return false;
+    out = ring[(head + ring.size() - 1) % ring.size()];
+    return true;
+}
+
+size_t DiagnosticsHistory::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return count;
+}
+
+DiagnosticsMonitor::DiagnosticsMonitor(size_t historyCapacity)
+    : history(historyCapacity),
+      back(std::make_unique<Snapshot>()),
+      pending(std::make_unique<Snapshot>()),
+      front(std::make_unique<Snapshot>()) {
+    worker = std::thread(&DiagnosticsMonitor::monitorLoop, this);
+}
+
+DiagnosticsMonitor::~DiagnosticsMonitor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    snapshotReady.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+void DiagnosticsMonitor::publish(const std::vector<MassObject>& massObjects, const ForceCalculator& calculator, uint64_t step, double time) {
+    publish(massObjects, calculator.clone(), step, time);
+}
+
+void DiagnosticsMonitor::publish(const std::vector<MassObject>& massObjects, std::unique_ptr<ForceCalculator> calculator, uint64_t step, double time) {
+    // 'back' belongs to the caller, fill it without holding the lock
+    NBODY_TRACE_SCOPE("diagnostics_publish");
+    back->bodies.assign(massObjects.begin(), massObjects.end());
+    back->calculator = std::move(calculator);
+    back->step = step;
+    back->time = time;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(back, pending);
+        if (hasPending) snapshotsSkipped.fetch_add(1, std::memory_order_relaxed);
+        hasPending = true;
+    }
+    snapshotsPublished.fetch_add(1, std::memory_order_relaxed);
+    snapshotReady.notify_one();
+}
+
+bool DiagnosticsMonitor::setLogFile(const std::string& path) {
+    std::lock_guard<std::mutex> lock(logMutex);
+    if (log.is_open()) log.close();
+    if (path.empty()) return true;
+
+    log.open(path, std::ios::trunc);
+    if (!log.is_open()) {
+        std::cerr << "Failed to open diagnostics log " << path << "\n";
+        return false;
+    }
+    log << "step,time,bodies,kinetic,potential,total,energy_drift,px,py,angular_momentum,com_x,com_y,virial_ratio,compute_seconds,state_hash\n";
+    return true;
+}
+
+void DiagnosticsMonitor::monitorLoop() {
+    Trace::setThreadName("diagnostics");
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            snapshotReady.wait(lock, [this] { return hasPending || stopping; });
+            if (stopping) break;
+            std::swap(front, pending);
+            hasPending = false;
+        }
+
+        NBODY_TRACE_SCOPE("diagnostics_sample");
+        auto start = std::chrono::steady_clock::now();
+        DiagnosticsSample sample;
+        sample.step = front->step;
+        sample.diagnostics = Diagnostics::compute(front->bodies, *front->calculator);
+        sample.diagnostics.time = front->time;
+        sample.computeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const double energy = sample.diagnostics.totalEnergy;
+        if (baselineResetRequested.exchange(false)) baselineEnergy = energy;
+        sample.energyDrift = (baselineEnergy != 0.0) ? (energy - baselineEnergy) / std::abs(baselineEnergy) : 0.0;
+
+        history.push(sample);
+
+        std::lock_guard<std::mutex> lock(logMutex);
+        if (log.is_open()) {
+            const SystemDiagnostics& d = sample.diagnostics;
+            log << sample.step << ',' << d.time << ',' << d.bodyCount << ','
+                << d.kineticEnergy << ',' << d.potentialEnergy << ',' << d.totalEnergy << ',' << sample.energyDrift << ','
+                << d.linearMomentum.x << ',' << d.linearMomentum.y << ',' << d.angularMomentum << ','
+                << d.centreOfMass.x << ',' << d.centreOfMass.y << ',' << d.virialRatio << ','
+                << sample.computeSeconds << ',' << std::hex << d.stateHash << std::dec << '\n';
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "Diagnostics.h"
+#include "MassObject.h"
+#include <vector>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+class ForceCalculator;
+
+// One measurement taken by the monitor thread
+struct DiagnosticsSample {
+    uint64_t step = 0;              // physics substep the snapshot was published at
+    SystemDiagnostics diagnostics;  // diagnostics.time = simulated years
+    double energyDrift = 0.0;       // (E - E0) / |E0|, E0 = first sample since the last baseline reset
+    double computeSeconds = 0.0;    // time the monitor spent on this sample
+};
+
+// Fixed-capacity time series, the oldest samples are overwritten
+// Written by the monitor thread, read by the UI and anything else that wants a copy
+class DiagnosticsHistory {
+public:
+    explicit DiagnosticsHistory(size_t capacity = 1024);
+
+    void push(const DiagnosticsSample& sample);
+    void clear();
+
+    // Copy of every stored sample, oldest first
+    std::vector<DiagnosticsSample> snapshot() const;
+    // Returns false when empty
+    bool latest(DiagnosticsSample& out) const;
+
+    size_t size() const;
+    size_t capacity() const { return ring.size(); }
+
+private:
+    mutable std::mutex mutex;
+    std::vector<DiagnosticsSample> ring;
+    size_t head = 0;  // next slot to write
+    size_t count = 0;
+};
+
+// Runs Diagnostics::compute on a background thread.
+// The stepping path publishes a copy of the bodies (triple-buffered, latest wins), so it never
+// waits for a measurement; a snapshot that is replaced before the thread picks it up is skipped.
+class DiagnosticsMonitor {
+public:
+    explicit DiagnosticsMonitor(size_t historyCapacity = 1024);
+    ~DiagnosticsMonitor(); // finishes the current sample and joins the thread
+
+    DiagnosticsMonitor(const DiagnosticsMonitor&) = delete;
+    DiagnosticsMonitor& operator=(const DiagnosticsMonitor&) = delete;
+
+    // Copy the state and wake the monitor thread (the calculator is cloned so it may be swapped afterwards)
+    void publish(const std::vector<MassObject>& massObjects, const ForceCalculator& calculator, uint64_t step, double time);
+    // Same with a calculator cloned earlier, so the copy can overlap with the next force pass
+    void publish(const std::vector<MassObject>& massObjects, std::unique_ptr<ForceCalculator> calculator, uint64_t step, double time);
+
+    // Append every sample as a CSV line (empty path closes the log)
+    bool setLogFile(const std::string& path);
+
+    // The next sample becomes the energy reference, e.g. after bodies were added or removed
+    void resetBaseline() { baselineResetRequested = true; }
+
+    const DiagnosticsHistory& getHistory() const { return history; }
+
+    uint64_t getSnapshotsPublished() const { return snapshotsPublished.load(std::memory_order_relaxed); }
+    uint64_t getSnapshotsSkipped() const { return snapshotsSkipped.load(std::memory_order_relaxed); }
+
+private:
+    struct Snapshot {
+        std::vector<MassObject> bodies;
+        std::unique_ptr<ForceCalculator> calculator;
+        uint64_t step = 0;
+        double time = 0.0;
+    };
+
+    void monitorLoop();
+
+    DiagnosticsHistory history;
+
+    // Triple buffer: 'back' is filled by publish(), 'front' is measured by the thread,
+    // 'pending' is handed over under the mutex
+    std::unique_ptr<Snapshot> back;
+    std::unique_ptr<Snapshot> pending;
+    std::unique_ptr<Snapshot> front;
+    bool hasPending = false;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable snapshotReady;
+
+    std::mutex logMutex;
+    std::ofstream log;
+
+    std::atomic<bool> baselineResetRequested{ true };
+    double baselineEnergy = 0.0; // monitor thread only
+
+    std::atomic<uint64_t> snapshotsPublished{ 0 };
+    std::atomic<uint64_t> snapshotsSkipped{ 0 };
+
+    std::thread worker;
+};
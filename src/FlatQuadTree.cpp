@@ -0,0 +1,453 @@
+#include "FlatQuadTree.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <utility>
+
+namespace {
+    // Coincident bodies would split forever, below this they share a leaf
+    constexpr uint32_t kMaxDepth = 30;
+    // Dual-tree tasks are the subtrees at this depth, up to 64
+    constexpr uint32_t kDualSplitDepth = 3;
+
+    // f += m * r / (max(|r|, softening)^2 * |r|), nothing for r = 0
+    inline void addPull(glm::vec2& f, const glm::vec2& r, float mass, float softening2) {
+        const float r2 = r.x * r.x + r.y * r.y;
+        if (r2 <= 0.0f) return;
+        const float scale = mass / (std::max(r2, softening2) * std::sqrt(r2));
+        f += r * scale;
+    }
+
+    // Stackless walk over the node array, 'accept' decides for every cell that is not a single body
+    template <typename Accept>
+    glm::vec2 walkForce(const FlatNode* node, uint32_t count, const FlatBody* body, const glm::vec2& point, float softening2,
+                        WalkCounters* counters, Accept&& accept) {
+        glm::vec2 f{ 0.0f, 0.0f };
+        uint32_t i = 0;
+        while (i < count) {
+            const FlatNode& n = node[i];
+            if (counters) {
+                ++counters->nodesVisited;
+                counters->maxDepth = std::max(counters->maxDepth, n.depth);
+            }
+            if (n.mass <= 0.0f) {
+                i = n.next;
+                continue;
+            }
+
+            const glm::vec2 r = n.com - point;
+            if (n.bodyCount != 1) {
+                const float d2 = std::max(r.x * r.x + r.y * r.y, softening2);
+                if (accept(i, n, r, d2)) {
+                    if (counters) ++counters->nodeBody;
+                    addPull(f, r, n.mass, softening2);
+                    i = n.next;
+                    continue;
+                }
+                if (n.bodyCount == 0) {
+                    ++i; // open: first child follows
+                    continue;
+                }
+            }
+
+            // Leaf bucket, every body directly
+            for (uint32_t b = n.firstBody; b < n.firstBody + n.bodyCount; ++b) {
+                const glm::vec2 rb = body[b].position - point;
+                if (rb.x == 0.0f && rb.y == 0.0f) continue;
+                if (counters) ++counters->bodyBody;
+                addPull(f, rb, body[b].mass, softening2);
+            }
+            i = n.next;
+        }
+        return f;
+    }
+
+    // State of one dual-tree task, only nodes and bodies below the task's target are written
+    struct DualWalk {
+        const FlatNode* nodes;
+        const FlatBody* bodies;
+        glm::dvec2* field;
+        glm::dvec3* tidal;
+        glm::dvec4* curvature;
+        glm::vec2* accelerations;
+        float theta2;
+        float softening2;
+        WalkCounters counters;
+
+        // Single bodies are points, the expansion about them is exact
+        float extent(const FlatNode& n) const { return n.bodyCount == 1 ? 0.0f : n.size; }
+
+        template <typename Fn>
+        void forEachChild(uint32_t parent, Fn&& fn) const {
+            for (uint32_t child = parent + 1; child < nodes[parent].next; child = nodes[child].next) fn(child);
+        }
+
+        void directSum(uint32_t target, uint32_t source) {
+            const FlatNode& a = nodes[target];
+            const FlatNode& b = nodes[source];
+            for (uint32_t i = a.firstBody; i < a.firstBody + a.bodyCount; ++i) {
+                const glm::vec2 p = bodies[i].position;
+                glm::vec2 f{ 0.0f, 0.0f };
+                for (uint32_t j = b.firstBody; j < b.firstBody + b.bodyCount; ++j) {
+                    const glm::vec2 r = bodies[j].position - p;
+                    if (r.x == 0.0f && r.y == 0.0f) continue;
+                    ++counters.bodyBody;
+                    addPull(f, r, bodies[j].mass, softening2);
+                }
+                accelerations[i] += f;
+            }
+        }
+
+        // Source monopole into the target's expansion, r from the target's centre to the source:
+        // g = m r / R^3, dg_i/dx_j = m (3 r_i r_j - R^2 d_ij) / R^5,
+        // d2g_i/dx_j dx_k = m (15 r_i r_j r_k / R^7 - 3 (d_ij r_k + d_ik r_j + d_jk r_i) / R^5)
+        void addExpansion(uint32_t target, const FlatNode& source) {
+            const glm::dvec2 r = glm::dvec2(source.com) - glm::dvec2(nodes[target].com);
+            const double r2 = r.x * r.x + r.y * r.y;
+            const double inv2 = 1.0 / r2;
+            const double m3 = source.mass * inv2 / std::sqrt(r2);
+            const double m5 = m3 * inv2;
+            const double m7 = m5 * inv2;
+            field[target] += r * m3;
+            tidal[target] += glm::dvec3(m5 * (3.0 * r.x * r.x - r2), m5 * 3.0 * r.x * r.y, m5 * (3.0 * r.y * r.y - r2));
+            curvature[target] += glm::dvec4(15.0 * m7 * r.x * r.x * r.x - 9.0 * m5 * r.x,
+                                            15.0 * m7 * r.x * r.x * r.y - 3.0 * m5 * r.y,
+                                            15.0 * m7 * r.x * r.y * r.y - 3.0 * m5 * r.x,
+                                            15.0 * m7 * r.y * r.y * r.y - 9.0 * m5 * r.y);
+            ++counters.cellCell;
+        }
+
+        void interact(uint32_t target, uint32_t source) {
+            const FlatNode& a = nodes[target];
+            const FlatNode& b = nodes[source];
+            ++counters.nodesVisited;
+            counters.maxDepth = std::max(counters.maxDepth, std::max(a.depth, b.depth));
+            if (b.mass <= 0.0f) return;
+
+            if (target == source) {
+                if (a.bodyCount > 0) directSum(target, source);
+                else forEachChild(target, [&](uint32_t ta) { forEachChild(source, [&](uint32_t sb) { interact(ta, sb); }); });
+                return;
+            }
+
+            const glm::vec2 r = b.com - a.com;
+            const float d2 = r.x * r.x + r.y * r.y;
+            const float s = extent(a) + extent(b);
+            if (s * s < theta2 * d2 && d2 > softening2) {
+                addExpansion(target, b);
+                return;
+            }
+
+            const bool targetLeaf = a.bodyCount > 0;
+            const bool sourceLeaf = b.bodyCount > 0;
+            if (targetLeaf && sourceLeaf) directSum(target, source);
+            else if (sourceLeaf || (!targetLeaf && a.size >= b.size)) forEachChild(target, [&](uint32_t ta) { interact(ta, source); });
+            else forEachChild(source, [&](uint32_t sb) { interact(target, sb); });
+        }
+    };
+
+    // Local expansion g + J dx + K[dx, dx] / 2 evaluated at offset dx, K = (xxx, xxy, xyy, yyy)
+    glm::dvec2 evaluateExpansion(const glm::dvec2& g, const glm::dvec3& j, const glm::dvec4& k, const glm::dvec2& dx) {
+        return g + glm::dvec2(j.x * dx.x + j.y * dx.y, j.y * dx.x + j.z * dx.y)
+                 + 0.5 * glm::dvec2(k.x * dx.x * dx.x + 2.0 * k.y * dx.x * dx.y + k.z * dx.y * dx.y,
+                                    k.y * dx.x * dx.x + 2.0 * k.z * dx.x * dx.y + k.w * dx.y * dx.y);
+    }
+}
+
+void FlatQuadTree::clear() {
+    nodes.clear();
+    centres.clear();
+    bodies.clear();
+    taskRanges.clear();
+    topNodes.clear();
+}
+
+void FlatQuadTree::build(const std::vector<MassObject>& input, const AABB& root, unsigned bucketSize, size_t taskCutoff) {
+    leafSize = std::max(1u, bucketSize);
+    const uint32_t n = static_cast<uint32_t>(input.size());
+    bodies.resize(n);
+    Parallel::parallelFor(0, n, 16384, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            bodies[i] = { input[i].getPosition(), static_cast<float>(input[i].getMass()), static_cast<uint32_t>(i) };
+        }
+    });
+    nodes.clear();
+    centres.clear();
+    taskRanges.clear();
+    topNodes.clear();
+    if (n == 0) return;
+    if (taskCutoff == 0 || n <= taskCutoff) {
+        nodes.reserve(2 * (n / leafSize + 1));
+        centres.reserve(nodes.capacity());
+        buildNode(nodes, centres, 0, n, root, 0);
+        return;
+    }
+
+    // Top levels in depth-first order: split nodes, and subtrees at or below the cutoff as tasks
+    struct Entry {
+        AABB box;
+        uint32_t begin, end, depth;
+        uint32_t skip; // split nodes: the entry after the subtree
+        bool task;
+    };
+    std::vector<Entry> entries;
+    std::vector<FlatBody> scratch(n);
+    auto plan = [&](auto&& self, uint32_t begin, uint32_t end, const AABB& box, uint32_t depth) -> void {
+        const uint32_t index = static_cast<uint32_t>(entries.size());
+        const bool task = end - begin <= taskCutoff || end - begin <= leafSize || depth >= kMaxDepth;
+        entries.push_back({ box, begin, end, depth, 0, task });
+        if (task) return;
+
+        const glm::vec2 c = box.center;
+        const auto quadrants = Parallel::stablePartition<4>(bodies.data() + begin, scratch.data() + begin, end - begin,
+            [c](const FlatBody& b) -> size_t { return (b.position.y >= c.y ? 0 : 2) + (b.position.x <= c.x ? 0 : 1); });
+        const glm::vec2 hs = box.halfSize * 0.5f;
+        const AABB boxes[4] = {
+            { { c.x - hs.x, c.y + hs.y }, hs }, // nw
+            { { c.x + hs.x, c.y + hs.y }, hs }, // ne
+            { { c.x - hs.x, c.y - hs.y }, hs }, // sw
+            { { c.x + hs.x, c.y - hs.y }, hs }, // se
+        };
+        for (int q = 0; q < 4; ++q) {
+            const uint32_t first = begin + static_cast<uint32_t>(quadrants[q]);
+            const uint32_t last = begin + static_cast<uint32_t>(quadrants[q + 1]);
+            if (first < last) self(self, first, last, boxes[q], depth + 1);
+        }
+        entries[index].skip = static_cast<uint32_t>(entries.size());
+    };
+    plan(plan, 0, n, root, 0);
+
+    // Subtrees into their own arrays, largest first
+    std::vector<std::vector<FlatNode>> parts(entries.size());
+    std::vector<std::vector<glm::vec2>> partCentres(entries.size());
+    std::vector<uint32_t> tasks;
+    for (uint32_t e = 0; e < entries.size(); ++e) {
+        if (entries[e].task) tasks.push_back(e);
+    }
+    std::sort(tasks.begin(), tasks.end(), [&](uint32_t a, uint32_t b) {
+        return entries[a].end - entries[a].begin > entries[b].end - entries[b].begin;
+    });
+    Parallel::parallelForDynamic(0, tasks.size(), [&](size_t t) {
+        NBODY_TRACE_SCOPE("tree_build_task");
+        const Entry& entry = entries[tasks[t]];
+        buildNode(parts[tasks[t]], partCentres[tasks[t]], entry.begin, entry.end, entry.box, entry.depth);
+    });
+
+    // Splice in depth-first order, task nodes shift by their subtree's offset
+    std::vector<uint32_t> offset(entries.size() + 1);
+    for (size_t e = 0; e < entries.size(); ++e) {
+        offset[e + 1] = offset[e] + (entries[e].task ? static_cast<uint32_t>(parts[e].size()) : 1);
+    }
+    nodes.resize(offset.back());
+    centres.resize(offset.back());
+    for (uint32_t e = 0; e < entries.size(); ++e) {
+        const Entry& entry = entries[e];
+        if (entry.task) {
+            taskRanges.push_back({ offset[e], offset[e + 1] });
+            continue;
+        }
+        nodes[offset[e]] = { entry.box.center, 0.0f, entry.box.halfSize.x + entry.box.halfSize.y, offset[entry.skip], 0, 0, entry.depth };
+        centres[offset[e]] = entry.box.center;
+        topNodes.push_back(offset[e]);
+    }
+    Parallel::parallelForDynamic(0, tasks.size(), [&](size_t t) {
+        const uint32_t e = tasks[t];
+        const uint32_t base = offset[e];
+        for (size_t i = 0; i < parts[e].size(); ++i) {
+            nodes[base + i] = parts[e][i];
+            nodes[base + i].next += base;
+            centres[base + i] = partCentres[e][i];
+        }
+    });
+}
+
+void FlatQuadTree::buildNode(std::vector<FlatNode>& out, std::vector<glm::vec2>& outCentres, uint32_t begin, uint32_t end, const AABB& box, uint32_t depth) {
+    const uint32_t self = static_cast<uint32_t>(out.size());
+    out.push_back({ box.center, 0.0f, box.halfSize.x + box.halfSize.y, self + 1, 0, 0, depth });
+    outCentres.push_back(box.center);
+
+    if (end - begin <= leafSize || depth >= kMaxDepth) {
+        out[self].firstBody = begin;
+        out[self].bodyCount = end - begin;
+        return;
+    }
+
+    // Same split as QuadNode::childFor: the centre lines belong to the west and north children
+    const glm::vec2 c = box.center;
+    auto first = bodies.begin() + begin;
+    auto last = bodies.begin() + end;
+    auto southBegin = std::partition(first, last, [c](const FlatBody& b) { return b.position.y >= c.y; });
+    auto neBegin = std::partition(first, southBegin, [c](const FlatBody& b) { return b.position.x <= c.x; });
+    auto seBegin = std::partition(southBegin, last, [c](const FlatBody& b) { return b.position.x <= c.x; });
+
+    const glm::vec2 hs = box.halfSize * 0.5f;
+    const auto offset = [&](auto it) { return static_cast<uint32_t>(it - bodies.begin()); };
+    const uint32_t bounds[5] = { begin, offset(neBegin), offset(southBegin), offset(seBegin), end };
+    const AABB boxes[4] = {
+        { { c.x - hs.x, c.y + hs.y }, hs }, // nw
+        { { c.x + hs.x, c.y + hs.y }, hs }, // ne
+        { { c.x - hs.x, c.y - hs.y }, hs }, // sw
+        { { c.x + hs.x, c.y - hs.y }, hs }, // se
+    };
+    for (int q = 0; q < 4; ++q) {
+        if (bounds[q] < bounds[q + 1]) buildNode(out, outCentres, bounds[q], bounds[q + 1], boxes[q], depth + 1);
+    }
+    out[self].next = static_cast<uint32_t>(out.size());
+}
+
+void FlatQuadTree::computeNodeMoments(uint32_t i) {
+    FlatNode& node = nodes[i];
+    double mass = 0.0;
+    double cx = 0.0, cy = 0.0;
+    if (node.bodyCount > 0) {
+        for (uint32_t b = node.firstBody; b < node.firstBody + node.bodyCount; ++b) {
+            mass += bodies[b].mass;
+            cx += static_cast<double>(bodies[b].mass) * bodies[b].position.x;
+            cy += static_cast<double>(bodies[b].mass) * bodies[b].position.y;
+        }
+    }
+    else {
+        for (uint32_t child = i + 1; child < node.next; child = nodes[child].next) {
+            mass += nodes[child].mass;
+            cx += static_cast<double>(nodes[child].mass) * nodes[child].com.x;
+            cy += static_cast<double>(nodes[child].mass) * nodes[child].com.y;
+        }
+    }
+    node.mass = static_cast<float>(mass);
+    if (mass > 0.0) node.com = { static_cast<float>(cx / mass), static_cast<float>(cy / mass) };
+}
+
+void FlatQuadTree::computeMoments() {
+    // Children come after their parent, so a reverse pass sees them first
+    if (taskRanges.empty()) {
+        for (size_t i = nodes.size(); i-- > 0;) computeNodeMoments(static_cast<uint32_t>(i));
+        return;
+    }
+    Parallel::parallelForDynamic(0, taskRanges.size(), [&](size_t t) {
+        for (uint32_t i = taskRanges[t].second; i-- > taskRanges[t].first;) computeNodeMoments(i);
+    });
+    for (auto it = topNodes.rbegin(); it != topNodes.rend(); ++it) computeNodeMoments(*it);
+}
+
+glm::vec2 FlatQuadTree::computeForceAt(const glm::vec2& point, const OpeningCriterion& mac, float acceleration, double G, float softening,
+                                       WalkCounters* counters) const {
+    const uint32_t count = static_cast<uint32_t>(nodes.size());
+    const float softening2 = softening * softening;
+    glm::vec2 f;
+    if (mac.type == OpeningCriterion::Type::Geometric && !mac.boxCheck) {
+        // s / max(d, softening) < theta, compared squared
+        const float theta2 = static_cast<float>(mac.theta * mac.theta);
+        f = walkForce(nodes.data(), count, bodies.data(), point, softening2, counters,
+                      [theta2](uint32_t, const FlatNode& n, const glm::vec2&, float d2) { return n.size * n.size < theta2 * d2; });
+    }
+    else {
+        const glm::vec2* centre = centres.data();
+        f = walkForce(nodes.data(), count, bodies.data(), point, softening2, counters,
+                      [&](uint32_t i, const FlatNode& n, const glm::vec2& r, float d2) {
+                          return mac.accepts(r, d2, n.mass, n.size, acceleration, G, centre[i], point);
+                      });
+    }
+    return f * static_cast<float>(G);
+}
+
+void FlatQuadTree::computeDualTreeForces(float theta, double G, float softening, std::vector<glm::vec2>& accelerations, WalkCounters* counters) {
+    accelerations.assign(bodies.size(), glm::vec2{ 0.0f, 0.0f });
+    if (nodes.empty()) return;
+    localField.assign(nodes.size(), glm::dvec2(0.0));
+    localTidal.assign(nodes.size(), glm::dvec3(0.0));
+    localCurvature.assign(nodes.size(), glm::dvec4(0.0));
+
+    DualWalk prototype{ nodes.data(), bodies.data(), localField.data(), localTidal.data(), localCurvature.data(), accelerations.data(),
+                        theta * theta, softening * softening, {} };
+
+    // Split the top levels into jobs whose targets are disjoint subtrees, one task per target.
+    // Splitting a target is always allowed, it only costs acceptances in the few top levels.
+    // The depth is fixed so the pairs, and the result, do not depend on the thread count
+    std::vector<std::pair<uint32_t, uint32_t>> jobs; // target, source
+    auto expand = [&](auto&& self, uint32_t target, uint32_t source) -> void {
+        if (nodes[target].depth >= kDualSplitDepth || nodes[target].bodyCount > 0) {
+            jobs.push_back({ target, source });
+            return;
+        }
+        prototype.forEachChild(target, [&](uint32_t ta) {
+            if (target == source) prototype.forEachChild(source, [&](uint32_t sb) { self(self, ta, sb); });
+            else self(self, ta, source);
+        });
+    };
+    expand(expand, 0, 0);
+    std::stable_sort(jobs.begin(), jobs.end(), [](const auto& x, const auto& y) { return x.first < y.first; });
+    std::vector<size_t> taskBegin;
+    for (size_t j = 0; j < jobs.size(); ++j) {
+        if (j == 0 || jobs[j].first != jobs[j - 1].first) taskBegin.push_back(j);
+    }
+    taskBegin.push_back(jobs.size());
+
+    std::mutex counterMutex;
+    WalkCounters total;
+    Parallel::parallelFor(0, taskBegin.size() - 1, 1, [&](size_t begin, size_t end) {
+        NBODY_TRACE_SCOPE("force_walk");
+        DualWalk walk = prototype;
+        for (size_t t = begin; t < end; ++t) {
+            for (size_t j = taskBegin[t]; j < taskBegin[t + 1]; ++j) walk.interact(jobs[j].first, jobs[j].second);
+        }
+        std::lock_guard<std::mutex> lock(counterMutex);
+        total.merge(walk.counters);
+    });
+
+    // Downward pass: parents come first, shift each expansion to the children's centres of mass
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        const FlatNode& n = nodes[i];
+        const glm::dvec2 g = localField[i];
+        const glm::dvec3 j = localTidal[i];
+        const glm::dvec4 k = localCurvature[i];
+        const glm::dvec2 c(n.com);
+        if (n.bodyCount == 0) {
+            prototype.forEachChild(i, [&](uint32_t child) {
+                const glm::dvec2 dx = glm::dvec2(nodes[child].com) - c;
+                localField[child] += evaluateExpansion(g, j, k, dx);
+                localTidal[child] += j + glm::dvec3(k.x * dx.x + k.y * dx.y, k.y * dx.x + k.z * dx.y, k.z * dx.x + k.w * dx.y);
+                localCurvature[child] += k;
+            });
+            continue;
+        }
+        for (uint32_t b = n.firstBody; b < n.firstBody + n.bodyCount; ++b) {
+            const glm::dvec2 far = evaluateExpansion(g, j, k, glm::dvec2(bodies[b].position) - c);
+            accelerations[b] = (accelerations[b] + glm::vec2(far)) * static_cast<float>(G);
+        }
+    }
+    if (counters) counters->merge(total);
+}
+
+double FlatQuadTree::computePotentialAt(const glm::vec2& point, const OpeningCriterion& mac, float acceleration, double G, float softening) const {
+    const double soft = softening;
+    const bool geometric = mac.type == OpeningCriterion::Type::Geometric && !mac.boxCheck;
+    double phi = 0.0;
+    uint32_t i = 0;
+    while (i < nodes.size()) {
+        const FlatNode& n = nodes[i];
+        if (n.mass <= 0.0f) {
+            i = n.next;
+            continue;
+        }
+        const double d = std::max(static_cast<double>(glm::length(n.com - point)), soft);
+        if (n.bodyCount != 1 && (geometric ? n.size < mac.theta * d
+                                 : mac.accepts(n.com - point, static_cast<float>(d * d), n.mass, n.size, acceleration, G, centres[i], point))) {
+            phi -= n.mass / d;
+            i = n.next;
+            continue;
+        }
+        if (n.bodyCount == 0) {
+            ++i;
+            continue;
+        }
+        for (uint32_t b = n.firstBody; b < n.firstBody + n.bodyCount; ++b) {
+            const glm::vec2 rb = bodies[b].position - point;
+            if (rb.x == 0.0f && rb.y == 0.0f) continue;
+            phi -= bodies[b].mass / std::max(static_cast<double>(glm::length(rb)), soft);
+        }
+        i = n.next;
+    }
+    return G * phi;
+}
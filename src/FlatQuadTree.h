@@ -0,0 +1,79 @@
+#pragma once
+#include "QuadTree.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// One node of the flattened tree, half a cache line
+struct FlatNode {
+    glm::vec2 com;       // center of mass (AU)
+    float mass;          // M☉
+    float size;          // halfSize.x + halfSize.y, the opening-criterion size
+    uint32_t next;       // first node after this subtree, the walk's skip target
+    uint32_t firstBody;  // leaf bucket in bodies(), 0 for internal nodes
+    uint32_t bodyCount;  // 0 for internal nodes
+    uint32_t depth;      // root = 0
+};
+static_assert(sizeof(FlatNode) == 32, "FlatNode must stay half a cache line");
+
+// Body copy stored in tree order, leaf buckets are contiguous ranges
+struct FlatBody {
+    glm::vec2 position;
+    float mass;
+    uint32_t index; // slot in the input vector
+};
+static_assert(sizeof(FlatBody) == 16, "FlatBody must stay 16 bytes");
+
+// Quadtree stored as an array in depth-first order: a node's first child is the next node,
+// 'next' skips its subtree. Walks are a single loop without recursion or a stack, and
+// neighbouring bodies in bodies() have nearly identical walks. Leaves hold up to 'leafSize'
+// bodies, empty quadrants get no node. Same quadrant rule and opening criterion as QuadNode.
+class FlatQuadTree {
+public:
+    // Partition the bodies into nodes (topology only), 'root' must contain every body.
+    // taskCutoff > 0 splits the top levels with parallel partition passes until subtrees hold at
+    // most 'taskCutoff' bodies, those are built as parallel tasks. The result does not depend on
+    // the thread count
+    void build(const std::vector<MassObject>& bodies, const AABB& root, unsigned leafSize = 8, size_t taskCutoff = 0);
+    // Masses and centres of mass, bottom-up over the node array (per build task in parallel)
+    void computeMoments();
+
+    // Sum of G*m*r/max(|r|, softening)^2/|r| over the tree, bodies at 'point' are skipped.
+    // 'acceleration' is the point's |a| from the previous evaluation, 0 if unknown (RelativeAcceleration only)
+    glm::vec2 computeForceAt(const glm::vec2& point, const OpeningCriterion& mac, float acceleration, double G, float softening,
+                             WalkCounters* counters = nullptr) const;
+    // Same walk for the potential -G*m/max(r, softening)
+    double computePotentialAt(const glm::vec2& point, const OpeningCriterion& mac, float acceleration, double G, float softening) const;
+
+    // Dual-tree traversal: target and source cells are paired recursively, pairs with
+    // (size_a + size_b) < theta * d add the source's monopole to the target's second-order local
+    // expansion (field and its first two derivatives about its centre of mass), close leaf pairs are summed
+    // directly, and a downward pass hands the expansions to the bodies. Single-body cells count
+    // as size 0. 'accelerations' receives the same sum as computeForceAt for every body, in
+    // getBodies() order. Counters: cellCell = accepted pairs, nodesVisited = pairs visited
+    void computeDualTreeForces(float theta, double G, float softening, std::vector<glm::vec2>& accelerations,
+                               WalkCounters* counters = nullptr);
+
+    const std::vector<FlatNode>& getNodes() const { return nodes; }
+    const std::vector<FlatBody>& getBodies() const { return bodies; }
+    size_t getByteSize() const { return nodes.size() * (sizeof(FlatNode) + sizeof(glm::vec2)) + bodies.size() * sizeof(FlatBody); }
+    void clear();
+
+private:
+    // Appends the subtree to 'out', indices relative to out's start
+    void buildNode(std::vector<FlatNode>& out, std::vector<glm::vec2>& outCentres, uint32_t begin, uint32_t end, const AABB& box, uint32_t depth);
+    void computeNodeMoments(uint32_t node);
+
+    std::vector<FlatNode> nodes;
+    std::vector<glm::vec2> centres; // box centre per node, only read by the non-geometric criteria
+    std::vector<FlatBody> bodies;
+    unsigned leafSize = 8;
+    // Parallel build: node ranges of the task subtrees, and the nodes above them
+    std::vector<std::pair<uint32_t, uint32_t>> taskRanges;
+    std::vector<uint32_t> topNodes;
+
+    // Dual-tree local expansions per node
+    std::vector<glm::dvec2> localField;
+    std::vector<glm::dvec3> localTidal;     // xx, xy, yy
+    std::vector<glm::dvec4> localCurvature; // xxx, xxy, xyy, yyy
+};
@@ -1,13 +1,90 @@
 #include "ForceCalculator.h"
+#include "TestParticles.h"
+#include "Trace.h"
 #include <glm/glm.hpp>
+#include <cmath>
 #include <algorithm>
 
+namespace {
+    // O(n) per query, only used for calculators without a tree
+    class DirectPotentialEvaluator : public PotentialEvaluator {
+    public:
+        DirectPotentialEvaluator(const std::vector<MassObject>& bodies, double G, double softening)
+            : bodies(bodies), G(G), softening(softening) {}
+
+        double potentialAt(size_t index) const override {
+            const glm::vec2 p = bodies[index].getPosition();
+            double phi = 0.0;
+            for (size_t j = 0; j < bodies.size(); ++j) {
+                if (j == index) continue;
+                glm::vec2 r = bodies[j].getPosition() - p;
+                double dist = std::max(std::sqrt(static_cast<double>(r.x) * r.x + static_cast<double>(r.y) * r.y), softening);
+                phi -= bodies[j].getMass() / dist;
+            }
+            return G * phi;
+        }
+
+    private:
+        const std::vector<MassObject>& bodies;
+        double G;
+        double softening;
+    };
+}
+
+std::unique_ptr<PotentialEvaluator> ForceCalculator::preparePotential(const std::vector<MassObject>& massObjects) const {
+    return std::make_unique<DirectPotentialEvaluator>(massObjects, getGravitationalConstant(), getSoftening());
+}
+
+std::vector<glm::vec2> ForceCalculator::calculateAccelerations(const std::vector<MassObject>& massObjects) const {
+    std::vector<size_t> tests, sources;
+    std::vector<glm::vec2> accelerations;
+    if (TestParticles::split(massObjects, tests, sources)) {
+        splitEvaluation(massObjects, tests, sources, accelerations);
+        for (size_t j : sources) accelerations[j] /= static_cast<float>(massObjects[j].getMass());
+    }
+    else {
+        accelerations = calculateForces(massObjects);
+        for (size_t i = 0; i < massObjects.size(); ++i) accelerations[i] /= static_cast<float>(massObjects[i].getMass());
+    }
+    return accelerations;
+}
+
+bool ForceCalculator::calculateWithTestParticles(const std::vector<MassObject>& massObjects, std::vector<glm::vec2>& forces) const {
+    std::vector<size_t> tests, sources;
+    if (!TestParticles::split(massObjects, tests, sources)) {
+        lastTestParticleInteractions = 0;
+        return false;
+    }
+    splitEvaluation(massObjects, tests, sources, forces);
+    for (size_t i : tests) forces[i] *= static_cast<float>(massObjects[i].getMass());
+    return true;
+}
+
+void ForceCalculator::splitEvaluation(const std::vector<MassObject>& massObjects, const std::vector<size_t>& tests,
+                                      const std::vector<size_t>& sources, std::vector<glm::vec2>& out) const {
+    massiveBodies.clear();
+    for (size_t j : sources) massiveBodies.push_back(massObjects[j]);
+    const std::vector<glm::vec2> massiveForces = calculateForces(massiveBodies);
+
+    out.assign(massObjects.size(), glm::vec2(0.0f));
+    for (size_t k = 0; k < sources.size(); ++k) out[sources[k]] = massiveForces[k];
+    {
+        NBODY_TRACE_SCOPE("test_particles");
+        TestParticles::computeAccelerations(massObjects, tests, sources, getGravitationalConstant(), getSoftening(), out);
+    }
+    lastTestParticleInteractions = static_cast<uint64_t>(tests.size()) * sources.size();
+}
+
 BruteForceCalculator::BruteForceCalculator(double gravitationalConstant)
     : customG(gravitationalConstant), softeningParameter(0.001) {} // 0.001 AU = 150,000 km (prevents close-encounter instabilities)
 
 std::vector<glm::vec2> BruteForceCalculator::calculateForces(const std::vector<MassObject>& massObjects) const {
+    std::vector<glm::vec2> forces;
+    if (calculateWithTestParticles(massObjects, forces)) return forces;
+
     const size_t numObjects = massObjects.size();
-    std::vector<glm::vec2> forces(numObjects, glm::vec2(0.0, 0.0));
+    forces.assign(numObjects, glm::vec2(0.0, 0.0));
+    lastInteractionCount = numObjects > 1 ? static_cast<uint64_t>(numObjects) * (numObjects - 1) / 2 : 0;
     
     // Calculate forces between all pairs (O(n²))
     for (size_t i = 0; i < numObjects; ++i) {
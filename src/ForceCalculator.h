@@ -1,8 +1,18 @@
 #pragma once
 #include "MassObject.h"
 #include <vector>
+#include <memory>
+#include <cstdint>
 #include <glm/glm.hpp>
 
+// Gravitational potential phi_i = -sum_j G*m_j / max(r_ij, softening) at each body (per unit mass),
+// prepared once for a given state so diagnostics can query bodies from parallel loops
+class PotentialEvaluator {
+public:
+    virtual ~PotentialEvaluator() = default;
+    virtual double potentialAt(size_t index) const = 0;
+};
+
 // Abstract base class for different force calculation methods
 class ForceCalculator {
 public:
@@ -11,13 +21,48 @@ public:
     // Calculate forces for all mass objects
     // Returns vector of net forces (same size and order as input)
     virtual std::vector<glm::vec2> calculateForces(const std::vector<MassObject>& massObjects) const = 0;
+
+    // Net force per unit mass of every body (same size and order as input), what the integrators
+    // advance. Test particles get theirs from the test-particle kernel, so they may be massless
+    virtual std::vector<glm::vec2> calculateAccelerations(const std::vector<MassObject>& massObjects) const;
+
+    // Potential evaluation using the same approximation as the forces
+    // Default is the direct sum, tree calculators walk their own tree
+    // 'massObjects' must outlive the returned evaluator
+    virtual std::unique_ptr<PotentialEvaluator> preparePotential(const std::vector<MassObject>& massObjects) const;
+
+    virtual double getGravitationalConstant() const = 0;
+    virtual double getSoftening() const = 0;
+
+    // Pair/cell interactions evaluated by the last calculateForces call (0 if not tracked)
+    virtual uint64_t getLastInteractionCount() const { return 0; }
+
+    // Copy with the same settings, used to hand the calculator to background threads
+    virtual std::unique_ptr<ForceCalculator> clone() const = 0;
+
+    // Bodies were reordered in place: new slot i holds the body from old slot order[i]
+    // Calculators that keep per-body state between calls (tree reuse) remap it
+    virtual void permute(const std::vector<size_t>& /*order*/) {}
     
 protected:
+    // Test particles (see TestParticles.h) are not sources: if there are any, the massive bodies'
+    // forces come from calculateForces on those alone and the test particles' from the direct
+    // test-particle kernel. Calculators call this first, false if there are no test particles
+    bool calculateWithTestParticles(const std::vector<MassObject>& massObjects, std::vector<glm::vec2>& forces) const;
+    mutable uint64_t lastTestParticleInteractions = 0; // N_test * N_massive of the last call
+
     // Gravitational constant in astronomical units
     // G = 4π² AU³/(M☉·year²) ≈ 39.48 AU³/(M☉·year²)
     // For simulation, we use a scaled version for better visual timing
     static constexpr double G_REAL = 39.478; // Real G in AU³/(M☉·year²)
     static constexpr double G_SIMULATION = 1.0; // Scaled for simulation timing
+
+private:
+    // Forces of the massive bodies and accelerations of the test particles, in slot order
+    void splitEvaluation(const std::vector<MassObject>& massObjects, const std::vector<size_t>& tests,
+                         const std::vector<size_t>& sources, std::vector<glm::vec2>& out) const;
+
+    mutable std::vector<MassObject> massiveBodies; // reused, a kept tree sees the same storage every call
 };
 
 // Brute force O(n²) implementation
@@ -30,6 +75,14 @@ public:
     // Set minimum distance to avoid singularities
     void setSofteningParameter(double softening) { softeningParameter = softening; }
     double getSofteningParameter() const { return softeningParameter; }
+
+    double getGravitationalConstant() const override { return customG; }
+    double getSoftening() const override { return softeningParameter; }
+
+    std::unique_ptr<ForceCalculator> clone() const override { return std::make_unique<BruteForceCalculator>(*this); }
+
+    // n(n-1)/2, every pair is evaluated once, plus test particles times massive bodies
+    uint64_t getLastInteractionCount() const override { return lastInteractionCount + lastTestParticleInteractions; }
     
     // Calculate gravitational field at a point (for grid visualization)
     glm::vec2 calculateGravitationalField(const glm::vec2& point, const std::vector<MassObject>& massObjects) const;
@@ -37,6 +90,7 @@ public:
 private:
     double customG; // Allow custom gravitational constant
     double softeningParameter; // Prevent division by zero when objects are very close
+    mutable uint64_t lastInteractionCount = 0;
     
     // Calculate gravitational force between two mass objects
     glm::vec2 calculateGravitationalForce(const MassObject& obj1, const MassObject& obj2) const;
@@ -1,6 +1,8 @@
 #include "GridGenerator.h"
 #include "MassObject.h"
 #include "ForceCalculator.h"
+#include "Profiler.h"
+#include "Trace.h"
 
 GridGenerator::GridGenerator() {
 }
@@ -22,6 +24,8 @@ std::vector<float> GridGenerator::generateGridVertices(int size, float spacing)
 }
 
 std::vector<float> GridGenerator::generateGridVertices(int size, float spacing, const std::vector<MassObject>& massObjects) { // only creates the edge verticies rn must also have intersections
+    Profiler::ScopedTimer timer(Profiler::Phase::Grid);
+    NBODY_TRACE_SCOPE("grid");
     std::vector<float> vertices;
 
     // Initialize lastMatrix if it's empty or wrong size
@@ -0,0 +1,194 @@
+#include "InitialConditions.h"
+#include "Parallel.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+    constexpr size_t kGrain = 1 << 14;      // bodies per parallel task
+    constexpr size_t kReduceBlock = 1 << 16; // fixed block size keeps the reduction order thread-count independent
+
+    // Shift to the centre-of-mass frame so generated systems do not drift
+    void removeCentreOfMassMotion(std::vector<MassObject>& bodies, size_t first) {
+        const size_t n = bodies.size() - first;
+        if (n == 0) return;
+
+        struct Sums { double m = 0.0, px = 0.0, py = 0.0, vx = 0.0, vy = 0.0; };
+        std::vector<Sums> partial((n + kReduceBlock - 1) / kReduceBlock);
+        Parallel::parallelFor(0, partial.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; ++b) {
+                Sums s;
+                size_t last = std::min(n, (b + 1) * kReduceBlock);
+                for (size_t i = b * kReduceBlock; i < last; ++i) {
+                    const MassObject& o = bodies[first + i];
+                    double m = o.getMass();
+                    s.m += m;
+                    s.px += m * o.getPosition().x; s.py += m * o.getPosition().y;
+                    s.vx += m * o.getVelocity().x; s.vy += m * o.getVelocity().y;
+                }
+                partial[b] = s;
+            }
+        });
+
+        Sums total;
+        for (const Sums& s : partial) {
+            total.m += s.m;
+            total.px += s.px; total.py += s.py;
+            total.vx += s.vx; total.vy += s.vy;
+        }
+        if (total.m <= 0.0) return;
+
+        const glm::vec2 com(static_cast<float>(total.px / total.m), static_cast<float>(total.py / total.m));
+        const glm::vec2 vcom(static_cast<float>(total.vx / total.m), static_cast<float>(total.vy / total.m));
+        Parallel::parallelFor(first, bodies.size(), kGrain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                bodies[i].setPosition(bodies[i].getPosition() - com);
+                bodies[i].setVelocity(bodies[i].getVelocity() - vcom);
+            }
+        });
+    }
+}
+
+std::vector<MassObject> InitialConditions::generatePlummer(size_t count, double totalMass, double scaleRadius, double G, uint64_t seed) {
+    std::vector<MassObject> bodies(count);
+    if (count == 0) return bodies;
+
+    const double mass = totalMass / static_cast<double>(count);
+    const double velocityScale = std::sqrt(G * totalMass / scaleRadius);
+    const double twoPi = glm::two_pi<double>();
+
+    Parallel::parallelFor(0, count, kGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            CounterRng rng(seed, i);
+
+            // Radius from the inverted cumulative mass profile, truncated at ~22 scale radii
+            double x1 = std::clamp(rng.uniformPositive(), 1e-10, 0.999);
+            double r = scaleRadius / std::sqrt(std::pow(x1, -2.0 / 3.0) - 1.0);
+
+            // Speed as a fraction of the local escape speed, von Neumann rejection on q²(1-q²)^3.5
+            double q;
+            while (true) {
+                double x4 = rng.uniform();
+                double x5 = rng.uniform();
+                if (0.1 * x5 < x4 * x4 * std::pow(1.0 - x4 * x4, 3.5)) { q = x4; break; }
+            }
+            double v = q * std::sqrt(2.0) * std::pow(1.0 + (r * r) / (scaleRadius * scaleRadius), -0.25) * velocityScale;
+
+            // Isotropic directions in 3D, keep the xy projection
+            double cosT = 2.0 * rng.uniform() - 1.0;
+            double sinT = std::sqrt(std::max(0.0, 1.0 - cosT * cosT));
+            double phi = twoPi * rng.uniform();
+            glm::vec2 pos(static_cast<float>(r * sinT * std::cos(phi)), static_cast<float>(r * sinT * std::sin(phi)));
+
+            cosT = 2.0 * rng.uniform() - 1.0;
+            sinT = std::sqrt(std::max(0.0, 1.0 - cosT * cosT));
+            phi = twoPi * rng.uniform();
+            glm::vec2 vel(static_cast<float>(v * sinT * std::cos(phi)), static_cast<float>(v * sinT * std::sin(phi)));
+
+            bodies[i] = MassObject(mass, pos, vel);
+        }
+    });
+
+    removeCentreOfMassMotion(bodies, 0);
+    return bodies;
+}
+
+std::vector<MassObject> InitialConditions::generateExponentialDisk(size_t count, double diskMass, double scaleLength, double centralMass, double G, uint64_t seed) {
+    std::vector<MassObject> bodies(count);
+    if (count == 0) return bodies;
+
+    bodies[0] = MassObject(centralMass, glm::vec2(0.0f, 0.0f), glm::vec2(0.0f, 0.0f));
+    const size_t diskCount = count - 1;
+    if (diskCount == 0) return bodies;
+
+    const double mass = diskMass / static_cast<double>(diskCount);
+    const double twoPi = glm::two_pi<double>();
+
+    Parallel::parallelFor(1, count, kGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            CounterRng rng(seed, i);
+
+            // r / scaleLength follows Gamma(2, 1) for an exponential surface density, truncate at 10 scale lengths
+            double x;
+            do {
+                x = -std::log(rng.uniformPositive() * rng.uniformPositive());
+            } while (x > 10.0);
+            double r = std::max(x * scaleLength, 1e-3);
+            double angle = twoPi * rng.uniform();
+
+            // Circular speed from the central mass plus the disk mass enclosed (spherical approximation)
+            double enclosed = centralMass + diskMass * (1.0 - (1.0 + x) * std::exp(-x));
+            double v = std::sqrt(G * enclosed / r);
+
+            float c = static_cast<float>(std::cos(angle));
+            float s = static_cast<float>(std::sin(angle));
+            bodies[i] = MassObject(mass,
+                glm::vec2(static_cast<float>(r) * c, static_cast<float>(r) * s),
+                glm::vec2(-static_cast<float>(v) * s, static_cast<float>(v) * c)); // counter-clockwise
+        }
+    });
+
+    removeCentreOfMassMotion(bodies, 0);
+    return bodies;
+}
+
+std::vector<MassObject> InitialConditions::exampleSolarSystem() {
+    // All masses in solar masses (MS), distances in AU, velocities in AU/year
+    // 
+    // REAL-WORLD ORBITAL VELOCITIES (for G = 39.478 AU^3/(MS·year²)):
+    // Formula: v = sqrt(G*M/r) for circular orbit around central mass M
+    // - Earth at 1 AU: v = √(39.478*1.0/1.0) = 6.28 AU/year ≈ 29.8 km/s
+    // - Jupiter at 5.2 AU: v = sqrt(39.478*1.0/5.2) = 2.76 AU/year ≈ 13.1 km/s
+    // - Mars at 1.52 AU: v = sqrt(39.478*1.0/1.52) = 5.07 AU/year ≈ 24.1 km/s
+    return {
+        // Sun (1 solar mass at origin, stationary)
+        MassObject(1.0, glm::vec2(0.0f, 0.0f), glm::vec2(0.0f, 0.0f)),
+        // Jupiter (0.001 solar masses at 5.2 AU with real orbital velocity)
+        MassObject(0.001, glm::vec2(5.2f, 0.0f), glm::vec2(0.0f, 2.76f)),
+        // Ganymede, jupiters biggest moon (7.5×10^-9 solar masses, 0.0071 AU orbit 2.29 AU orbital velo)
+        MassObject(7.5e-9, glm::vec2(5.2071f, 0.0f), glm::vec2(0.0f, -2.29f)),
+        // Earth (3×10⁻⁶ solar masses at 1 AU with real orbital velocity)
+        MassObject(3e-6, glm::vec2(1.0f, 0.0f), glm::vec2(0.0f, 6.28f)),
+        // Mars (3.2×10⁻⁷ solar masses at 1.52 AU with real orbital velocity)
+        MassObject(3.2e-7, glm::vec2(1.52f, 0.0f), glm::vec2(0.0f, 5.07f)),
+        // Large asteroid (10⁻¹⁰ solar masses in asteroid belt at 2.8 AU)
+        MassObject(1e-10, glm::vec2(2.8f, 0.0f), glm::vec2(0.0f, 3.76f)),
+    };
+}
+
+std::vector<MassObject> InitialConditions::generateKeplerBelt(size_t count, double innerRadius, double outerRadius, double bodyMass,
+                                                              double maxEccentricity, double centralMass, double G, uint64_t seed) {
+    std::vector<MassObject> bodies(count);
+    const double twoPi = glm::two_pi<double>();
+    const double r2min = innerRadius * innerRadius;
+    const double r2max = outerRadius * outerRadius;
+    const double mu = G * centralMass;
+
+    Parallel::parallelFor(0, count, kGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            CounterRng rng(seed, i);
+
+            // Semi-major axis uniform in area, random eccentricity, pericentre and true anomaly
+            double a = std::sqrt(r2min + (r2max - r2min) * rng.uniform());
+            double e = maxEccentricity * rng.uniform();
+            double omega = twoPi * rng.uniform();
+            double f = twoPi * rng.uniform();
+
+            double p = a * (1.0 - e * e); // semi-latus rectum
+            double r = p / (1.0 + e * std::cos(f));
+            double h = std::sqrt(mu / p);
+            double vRadial = h * e * std::sin(f);
+            double vTangential = h * (1.0 + e * std::cos(f));
+
+            double theta = f + omega;
+            double c = std::cos(theta);
+            double s = std::sin(theta);
+            bodies[i] = MassObject(bodyMass,
+                glm::vec2(static_cast<float>(r * c), static_cast<float>(r * s)),
+                glm::vec2(static_cast<float>(vRadial * c - vTangential * s), static_cast<float>(vRadial * s + vTangential * c)));
+        }
+    });
+
+    return bodies;
+}
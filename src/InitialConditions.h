@@ -0,0 +1,54 @@
+#pragma once
+#include "MassObject.h"
+#include <vector>
+#include <cstdint>
+
+// Counter-based random stream: the n-th draw of stream s depends only on (seed, s, n),
+// so bodies generated in parallel come out identical for any thread count
+class CounterRng {
+public:
+    CounterRng(uint64_t seed, uint64_t stream)
+        : key(mix(seed ^ mix(stream + 0x9E3779B97F4A7C15ull))) {}
+
+    uint64_t next() { return mix(key + (counter++) * 0x9E3779B97F4A7C15ull); }
+
+    // Uniform in [0, 1)
+    double uniform() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+
+    // Uniform in (0, 1], safe to take the log of
+    double uniformPositive() { return 1.0 - uniform(); }
+
+private:
+    // SplitMix64 finalizer
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t key;
+    uint64_t counter = 0;
+};
+
+// Large-N test systems, generated in parallel (one RNG stream per body)
+// All values use the simulation units: M☉, AU, AU/year, G in AU³/(M☉·year²)
+namespace InitialConditions {
+    // Plummer sphere sampled in 3D (Aarseth, Hénon & Wielen 1974) and projected onto the xy plane
+    std::vector<MassObject> generatePlummer(size_t count, double totalMass = 1.0, double scaleRadius = 1.0,
+                                            double G = 39.478, uint64_t seed = 1);
+
+    // Exponential disk (surface density ~ exp(-r / scaleLength)) on circular orbits around a central mass
+    // Body 0 is the central mass, the disk bodies share diskMass equally
+    std::vector<MassObject> generateExponentialDisk(size_t count, double diskMass = 0.1, double scaleLength = 2.0,
+                                                    double centralMass = 1.0, double G = 39.478, uint64_t seed = 2);
+
+    // The viewer's default system: Sun, Jupiter with Ganymede, Earth, Mars and one asteroid,
+    // on real orbital velocities for G = 39.478
+    std::vector<MassObject> exampleSolarSystem();
+
+    // Asteroid belt on Keplerian orbits around the main.cpp Sun (1 M☉ at the origin)
+    // The Sun itself is not included, add the belt to an existing solar system
+    std::vector<MassObject> generateKeplerBelt(size_t count, double innerRadius = 2.1, double outerRadius = 3.3,
+                                               double bodyMass = 1e-10, double maxEccentricity = 0.1,
+                                               double centralMass = 1.0, double G = 39.478, uint64_t seed = 3);
+}
@@ -3,14 +3,13 @@
 
 // integration using the euler method for gravity calculations
 void EulerIntegrator::integrate(std::vector<MassObject>& massObjects, 
-                               const std::vector<glm::vec2>& forces, 
+                               const std::vector<glm::vec2>& accelerations, 
                                double deltaTime) const {
     
     for (size_t i = 0; i < massObjects.size(); ++i) {
         MassObject& obj = massObjects[i];
         
-        // Calculate acceleration: a = F / m
-        glm::vec2 acceleration = forces[i] / static_cast<float>(obj.getMass());
+        const glm::vec2 acceleration = accelerations[i];
         
         // Update velocity: v = v + a * dt
         glm::vec2 newVelocity = obj.getVelocity() + acceleration * static_cast<float>(deltaTime);
@@ -28,7 +27,7 @@ void EulerIntegrator::integrate(std::vector<MassObject>& massObjects,
 
 // verlets method of integration, 2nd order of accuracy
 void VerletIntegrator::integrate(std::vector<MassObject>& massObjects, 
-                                const std::vector<glm::vec2>& forces, 
+                                const std::vector<glm::vec2>& accelerations, 
                                 double deltaTime) const {
     
     // Resize previous accelerations if needed
@@ -39,8 +38,7 @@ void VerletIntegrator::integrate(std::vector<MassObject>& massObjects,
     for (size_t i = 0; i < massObjects.size(); ++i) {
         MassObject& obj = massObjects[i];
         
-        // Calculate current acceleration: a = F / m
-        glm::vec2 currentAcceleration = forces[i] / static_cast<float>(obj.getMass());
+        glm::vec2 currentAcceleration = accelerations[i];
         
         // Velocity Verlet integration
         // v(t + dt) = v(t) + (a(t) + a(t + dt)) * dt / 2
@@ -68,4 +66,21 @@ void VerletIntegrator::integrate(std::vector<MassObject>& massObjects,
         // Store current acceleration for next timestep
         previousAccelerations[i] = currentAcceleration;
     }
-} 
\ No newline at end of file
+}
+
+void VerletIntegrator::swapRemove(size_t slot) {
+    if (slot >= previousAccelerations.size()) return;
+    previousAccelerations[slot] = previousAccelerations.back();
+    previousAccelerations.pop_back();
+}
+
+void VerletIntegrator::permute(const std::vector<size_t>& order) {
+    if (previousAccelerations.size() != order.size()) return; // resized (zeroed) on the next step anyway
+    std::vector<glm::vec2> reordered(order.size());
+    for (size_t i = 0; i < order.size(); ++i) reordered[i] = previousAccelerations[order[i]];
+    previousAccelerations.swap(reordered);
+}
+
+void VerletIntegrator::reset() {
+    previousAccelerations.clear();
+}
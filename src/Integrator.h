@@ -8,17 +8,25 @@ class Integrator {
 public:
     virtual ~Integrator() = default;
     
-    // Integrate one timestep given current state and forces
+    // Integrate one timestep given current state and accelerations (ForceCalculator::calculateAccelerations)
     virtual void integrate(std::vector<MassObject>& massObjects, 
-                          const std::vector<glm::vec2>& forces, 
+                          const std::vector<glm::vec2>& accelerations, 
                           double deltaTime) const = 0;
+
+    // Per-body state must follow the bodies when MassObjectTracker moves them
+    // Body at the last slot was moved into 'slot' and the last slot removed
+    virtual void swapRemove(size_t /*slot*/) {}
+    // Bodies were reordered: new slot i holds the body from old slot order[i]
+    virtual void permute(const std::vector<size_t>& /*order*/) {}
+    // Forget all per-body state (bodies cleared or replaced)
+    virtual void reset() {}
 };
 
 // Simple Euler integration (first-order, less stable but simple)
 class EulerIntegrator : public Integrator {
 public:
     void integrate(std::vector<MassObject>& massObjects, 
-                   const std::vector<glm::vec2>& forces, 
+                   const std::vector<glm::vec2>& accelerations, 
                    double deltaTime) const override;
 };
 
@@ -26,8 +34,12 @@ public:
 class VerletIntegrator : public Integrator {
 public:
     void integrate(std::vector<MassObject>& massObjects, 
-                   const std::vector<glm::vec2>& forces, 
+                   const std::vector<glm::vec2>& accelerations, 
                    double deltaTime) const override;
+
+    void swapRemove(size_t slot) override;
+    void permute(const std::vector<size_t>& order) override;
+    void reset() override;
     
 private:
     // Store previous accelerations for Verlet method
@@ -1,5 +1,6 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <cstdint>
 class MassObject
 {
 	public:
@@ -11,11 +12,15 @@ class MassObject
         glm::vec2 getPosition() const;
         glm::vec2 getVelocity() const;
         glm::vec2 getAcceleration() const;
+        uint64_t getId() const { return id; } // stable ID assigned by MassObjectTracker (0 = unassigned)
+        bool isTestParticle() const { return testParticle; } // feels gravity but exerts none, see TestParticles.h
 
         void setMass(double m);
         void setPosition(const glm::vec2& pos);
         void setVelocity(const glm::vec2& vel);
         void setAcceleration(const glm::vec2& accel);
+        void setId(uint64_t newId) { id = newId; }
+        void setTestParticle(bool flag) { testParticle = flag; }
 
         float distanceTo(const MassObject& other) const;
 
@@ -24,6 +29,8 @@ class MassObject
         glm::vec2 position = glm::vec2(0.0, 0.0); // position in AU (Astronomical Units)
         glm::vec2 velocity = glm::vec2(0.0, 0.0); // velocity in AU per year
         glm::vec2 acceleration = glm::vec2(0.0, 0.0); // acceleration in AU per year squared
+        uint64_t id = 0; // stays the same when the body moves to another slot
+        bool testParticle = false;
 
 };
 
@@ -1,24 +1,126 @@
 #include "MassObjectTracker.h"
 #include "ForceCalculator.h"
 #include "BarnesHutCalculator.h";
+#include "AutoCalculator.h"
 #include "Integrator.h"
+#include "CompressedTrajectory.h"
+#include "ScenarioLoader.h"
+#include "Profiler.h"
+#include "Trace.h"
 #include <glm/glm.hpp>
 #include <cmath>
 #include <iostream>
 #include <algorithm>
+#include <functional>
 
 MassObjectTracker::MassObjectTracker() {
     physicsEngine = std::make_unique<PhysicsEngine>();
 }
 
-void MassObjectTracker::addMassObject(const MassObject& massObj) {
+uint64_t MassObjectTracker::addMassObject(const MassObject& massObj) {
     massObjects.push_back(massObj);
+    return registerBodies(massObjects.size() - 1);
+}
+
+uint64_t MassObjectTracker::addBodies(std::span<const MassObject> bodies) {
+    const size_t first = massObjects.size();
+    massObjects.reserve(first + bodies.size());
+    massObjects.insert(massObjects.end(), bodies.begin(), bodies.end());
+    return registerBodies(first);
+}
+
+uint64_t MassObjectTracker::registerBodies(size_t first) {
+    const uint64_t firstId = nextId;
+    idToSlot.reserve(massObjects.size());
+    for (size_t i = first; i < massObjects.size(); ++i) {
+        massObjects[i].setId(nextId);
+        idToSlot[nextId] = i;
+        if (massObjects[i].isTestParticle()) ++testParticleCount;
+        ++nextId;
+    }
+    return firstId;
+}
+
+bool MassObjectTracker::loadScenario(const std::string& path) {
+    // Parse straight into the body vector, the loader reserves once for the whole file
+    const size_t before = massObjects.size();
+    if (!ScenarioLoader::load(path, massObjects)) {
+        massObjects.resize(before);
+        return false;
+    }
+    registerBodies(before);
+    std::cout << "Loaded " << (massObjects.size() - before) << " bodies from " << path << "\n";
+    return true;
 }
 
 void MassObjectTracker::removeMassObject(size_t index) {
-    if (index < massObjects.size()) {
-        massObjects.erase(massObjects.begin() + index);
+    if (index >= massObjects.size()) return;
+
+    // Swap-remove, then let the solver move its per-body state the same way
+    const size_t last = massObjects.size() - 1;
+    idToSlot.erase(massObjects[index].getId());
+    if (massObjects[index].isTestParticle()) --testParticleCount;
+    if (index != last) {
+        massObjects[index] = massObjects[last];
+        idToSlot[massObjects[index].getId()] = index;
+    }
+    massObjects.pop_back();
+    if (physicsEngine) physicsEngine->onBodySwapRemoved(index);
+}
+
+void MassObjectTracker::removeBody(uint64_t id) {
+    size_t slot = getSlot(id);
+    if (slot != INVALID_SLOT) removeMassObject(slot);
+}
+
+void MassObjectTracker::removeBodies(std::span<const uint64_t> ids) {
+    // Highest slot first: the body moved into a freed slot always comes from above it,
+    // so it is never one that is still waiting to be removed
+    std::vector<size_t> slots;
+    slots.reserve(ids.size());
+    for (uint64_t id : ids) {
+        size_t slot = getSlot(id);
+        if (slot != INVALID_SLOT) slots.push_back(slot);
     }
+    std::sort(slots.begin(), slots.end(), std::greater<size_t>());
+    slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+    for (size_t slot : slots) removeMassObject(slot);
+}
+
+void MassObjectTracker::reorderBodies(SpaceFillingCurve::Curve curve) {
+    NBODY_TRACE_SCOPE("reorder");
+    const std::vector<size_t> order = SpaceFillingCurve::sortOrder(massObjects, curve);
+
+    // Copy back instead of swapping vectors: the storage address stays the same for the calculator
+    std::vector<MassObject> reordered;
+    reordered.reserve(massObjects.size());
+    for (size_t oldSlot : order) reordered.push_back(massObjects[oldSlot]);
+    std::copy(reordered.begin(), reordered.end(), massObjects.begin());
+
+    for (size_t i = 0; i < massObjects.size(); ++i) idToSlot[massObjects[i].getId()] = i;
+    if (physicsEngine) {
+        physicsEngine->onBodiesReordered(order);
+        lastReorderStep = physicsEngine->getStepCount();
+    }
+}
+
+size_t MassObjectTracker::setTestParticleMass(double maxMass) {
+    testParticleCount = 0;
+    for (MassObject& body : massObjects) {
+        body.setTestParticle(body.getMass() <= maxMass);
+        if (body.isTestParticle()) ++testParticleCount;
+    }
+    return testParticleCount;
+}
+
+void MassObjectTracker::setReorderInterval(uint64_t everySubsteps, SpaceFillingCurve::Curve curve) {
+    reorderInterval = everySubsteps;
+    reorderCurve = curve;
+}
+
+size_t MassObjectTracker::getSlot(uint64_t id) const {
+    auto it = idToSlot.find(id);
+    return (it == idToSlot.end()) ? INVALID_SLOT : it->second;
 }
 
 const std::vector<MassObject>& MassObjectTracker::getMassObjects() const {
@@ -44,6 +146,8 @@ Sphere MassObjectTracker::getSphereForMassObject(size_t index) const {
 }
 
 std::vector<Sphere> MassObjectTracker::getAllSpheres() const {
+    Profiler::ScopedTimer timer(Profiler::Phase::Spheres);
+    NBODY_TRACE_SCOPE("spheres");
     std::vector<Sphere> spheres;
     spheres.reserve(massObjects.size());
     
@@ -56,6 +160,9 @@ std::vector<Sphere> MassObjectTracker::getAllSpheres() const {
 
 void MassObjectTracker::clear() {
     massObjects.clear();
+    idToSlot.clear();
+    testParticleCount = 0;
+    if (physicsEngine) physicsEngine->onBodiesCleared();
 }
 
 size_t MassObjectTracker::getCount() const {
@@ -85,6 +192,9 @@ float MassObjectTracker::getRadiusFromMass(double mass) const {
 void MassObjectTracker::updatePhysics(double deltaTime) {
     if (physicsEngine && !massObjects.empty()) {
         physicsEngine->update(massObjects, deltaTime);
+        if (reorderInterval > 0 && physicsEngine->getStepCount() - lastReorderStep >= reorderInterval) {
+            reorderBodies(reorderCurve);
+        }
     }
 }
 
@@ -103,13 +213,22 @@ void MassObjectTracker::switchToBruteForce(double G, double softening) {
     }
 }
 
-void MassObjectTracker::switchToBarnesHut(double G, double theta, double softening) {
+void MassObjectTracker::switchToBarnesHut(double G, double theta, double softening, bool reuseTree) {
     if (physicsEngine) {
-        physicsEngine->setForceCalculator(std::make_unique<BarnesHutCalculator>(G, theta, softening));
+        auto calc = std::make_unique<BarnesHutCalculator>(G, theta, softening);
+        calc->setTreeReuse(reuseTree); // substeps move bodies very little, refit instead of rebuilding
+        physicsEngine->setForceCalculator(std::move(calc));
         std::cout << "Switched to BarnesHut calculator (theta=" << theta << ")\n";
     }
 }
 
+void MassObjectTracker::switchToAuto(double G, double softening, double errorTarget) {
+    if (physicsEngine) {
+        physicsEngine->setForceCalculator(std::make_unique<AutoCalculator>(G, softening, errorTarget));
+        std::cout << "Switched to automatic calculator selection (p99 error target=" << errorTarget << ")\n";
+    }
+}
+
 void MassObjectTracker::switchToEulerIntegrator() {
     if (physicsEngine) {
         physicsEngine->setIntegrator(std::make_unique<EulerIntegrator>());
@@ -124,6 +243,38 @@ void MassObjectTracker::switchToVerletIntegrator() {
     }
 }
 
+bool MassObjectTracker::startRecording(const std::string& path, unsigned everySubsteps, BackpressurePolicy policy, size_t queueCapacity) {
+    const bool compressed = path.size() >= 5 && path.compare(path.size() - 5, 5, ".nbtz") == 0;
+    std::unique_ptr<TrajectorySink> sink;
+    if (compressed) sink = std::make_unique<CompressedTrajectorySink>(path);
+    else sink = std::make_unique<RawTrajectorySink>(path);
+    if (!startRecording(std::move(sink), everySubsteps, policy, queueCapacity)) return false;
+    std::cout << "Recording trajectory to " << path << " every " << everySubsteps << " substeps\n";
+    return true;
+}
+
+bool MassObjectTracker::startRecording(std::unique_ptr<TrajectorySink> sink, unsigned everySubsteps, BackpressurePolicy policy, size_t queueCapacity) {
+    if (!physicsEngine || !sink) return false;
+    if (!sink->isOpen()) {
+        std::cerr << "Trajectory output is not open, recording not started\n";
+        return false;
+    }
+
+    physicsEngine->setTrajectoryWriter(std::make_unique<TrajectoryWriter>(std::move(sink), queueCapacity, policy), everySubsteps);
+    return true;
+}
+
+void MassObjectTracker::stopRecording() {
+    if (physicsEngine && physicsEngine->getTrajectoryWriter()) {
+        physicsEngine->setTrajectoryWriter(nullptr); // destructor drains the queue
+        std::cout << "Stopped trajectory recording\n";
+    }
+}
+
+bool MassObjectTracker::isRecording() const {
+    return physicsEngine && physicsEngine->getTrajectoryWriter() != nullptr;
+}
+
 glm::vec4 MassObjectTracker::getColorFromMass(double mass) const {
     // Color coding based on solar mass ranges
     if (mass >= 0.1) {
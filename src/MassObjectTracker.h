@@ -2,19 +2,56 @@
 #include "MassObject.h"
 #include "Sphere.h"
 #include "PhysicsEngine.h"
+#include "TrajectoryWriter.h"
+#include "SpaceFillingCurve.h"
 #include <vector>
 #include <memory>
+#include <string>
+#include <span>
+#include <unordered_map>
+#include <cstdint>
 
 class MassObjectTracker {
 public:
     MassObjectTracker();
     
-    // Add a mass object to the tracker
-    void addMassObject(const MassObject& massObj);
+    // Every body gets a stable ID on insertion, slots (indices) change when bodies are removed
+    static constexpr size_t INVALID_SLOT = static_cast<size_t>(-1);
+
+    // Add a mass object to the tracker, returns its ID
+    uint64_t addMassObject(const MassObject& massObj);
+
+    // Add many mass objects with a single reservation
+    // IDs are consecutive, returns the ID of the first body
+    uint64_t addBodies(std::span<const MassObject> bodies);
+
+    // Load initial conditions from a text or binary scenario file (see ScenarioLoader.h)
+    bool loadScenario(const std::string& path);
     
-    // Remove mass object by index
+    // Remove mass object by index, O(1): the last body moves into the freed slot
     void removeMassObject(size_t index);
+
+    // Remove by ID, unknown IDs are ignored
+    void removeBody(uint64_t id);
+    void removeBodies(std::span<const uint64_t> ids);
+
+    // Current slot of a body, INVALID_SLOT if the ID is unknown
+    size_t getSlot(uint64_t id) const;
     
+    // Sort the storage along a space-filling curve so bodies close in space are close in memory
+    // IDs, integrator history and the calculator's kept tree follow the bodies; slots change
+    void reorderBodies(SpaceFillingCurve::Curve curve);
+
+    // Reorder from updatePhysics() once 'everySubsteps' substeps have passed (0 = never)
+    void setReorderInterval(uint64_t everySubsteps, SpaceFillingCurve::Curve curve = SpaceFillingCurve::Curve::Hilbert);
+    uint64_t getReorderInterval() const { return reorderInterval; }
+    SpaceFillingCurve::Curve getReorderCurve() const { return reorderCurve; }
+
+    // Flag every body with mass <= maxMass as a test particle (see TestParticles.h) and clear the
+    // flag of heavier ones, a negative limit clears all. Returns the number of test particles
+    size_t setTestParticleMass(double maxMass);
+    size_t getTestParticleCount() const { return testParticleCount; }
+
     // Get all mass objects
     const std::vector<MassObject>& getMassObjects() const;
     
@@ -36,12 +73,34 @@ public:
     void switchToEulerIntegrator();
     void switchToVerletIntegrator();
     void switchToBruteForce(double G = 39.478, double softening = 0.001);
-    void switchToBarnesHut(double G = 39.478, double theta = 0.5, double softening = 0.001);
+    void switchToBarnesHut(double G = 39.478, double theta = 0.5, double softening = 0.001, bool reuseTree = true);
+    // Measured selection between the calculators above, see AutoCalculator
+    void switchToAuto(double G = 39.478, double softening = 0.001, double errorTarget = 0.1);
     PhysicsEngine& getPhysicsEngine() { return *physicsEngine; }
 
+    // Trajectory output (written on a background thread)
+    // Paths ending in .nbtz use the compressed format, anything else the raw format
+    bool startRecording(const std::string& path, unsigned everySubsteps = 100,
+                        BackpressurePolicy policy = BackpressurePolicy::DropFrames, size_t queueCapacity = 8);
+    bool startRecording(std::unique_ptr<TrajectorySink> sink, unsigned everySubsteps = 100,
+                        BackpressurePolicy policy = BackpressurePolicy::DropFrames, size_t queueCapacity = 8);
+    void stopRecording();
+    bool isRecording() const;
+
 private:
     std::vector<MassObject> massObjects;
     std::unique_ptr<PhysicsEngine> physicsEngine;
+
+    std::unordered_map<uint64_t, size_t> idToSlot;
+    uint64_t nextId = 1;
+    size_t testParticleCount = 0; // kept up to date on insert and removal
+
+    uint64_t reorderInterval = 0;
+    SpaceFillingCurve::Curve reorderCurve = SpaceFillingCurve::Curve::Hilbert;
+    uint64_t lastReorderStep = 0; // physics step count at the last reorder
+
+    // Assign IDs to massObjects[first..] and register their slots
+    uint64_t registerBodies(size_t first);
     
     // Helper function to determine sphere radius based on mass
     float getRadiusFromMass(double mass) const;
@@ -0,0 +1,40 @@
+#include "Parallel.h"
+#include "TaskScheduler.h"
+#include <atomic>
+
+namespace {
+    std::atomic<unsigned> threadCount{ 0 };
+    std::atomic<bool> deterministic{ false };
+    thread_local unsigned threadOverride = 0; // ScopedThreadCount, 0 = none
+}
+
+unsigned Parallel::getThreadCount() {
+    if (threadOverride != 0) return threadOverride;
+    unsigned count = threadCount.load(std::memory_order_relaxed);
+    if (count == 0) {
+        count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return count;
+}
+
+void Parallel::setThreadCount(unsigned count) {
+    threadCount.store(count, std::memory_order_relaxed);
+    unsigned resolved = count != 0 ? count : std::max(1u, std::thread::hardware_concurrency());
+    TaskScheduler::setWorkerCount(resolved - 1);
+}
+
+void Parallel::setDeterministic(bool enabled) {
+    deterministic.store(enabled, std::memory_order_relaxed);
+}
+
+bool Parallel::isDeterministic() {
+    return deterministic.load(std::memory_order_relaxed);
+}
+
+Parallel::ScopedThreadCount::ScopedThreadCount(unsigned count) : previous(threadOverride) {
+    if (count != 0) threadOverride = count;
+}
+
+Parallel::ScopedThreadCount::~ScopedThreadCount() {
+    threadOverride = previous;
+}
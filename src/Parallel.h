@@ -0,0 +1,146 @@
+#pragma once
+#include "TaskScheduler.h"
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Minimal data-parallel helpers shared by the loaders, generators and calculators
+namespace Parallel {
+    // Number of threads used by parallelFor (defaults to the hardware concurrency)
+    unsigned getThreadCount();
+    void setThreadCount(unsigned count); // 0 = hardware concurrency, resizes the scheduler to count - 1 workers
+
+    // Deterministic mode: runs are bitwise reproducible across thread counts, machines and restarts.
+    // The reductions and force sums already are for any thread count; the mode also makes choices
+    // that would otherwise depend on timings deterministic (AutoCalculator ranks by interaction count)
+    void setDeterministic(bool enabled);
+    bool isDeterministic();
+
+    // Overrides the thread count for loops started on the current thread while in scope
+    class ScopedThreadCount {
+    public:
+        explicit ScopedThreadCount(unsigned count); // 0 keeps the global setting
+        ~ScopedThreadCount();
+
+        ScopedThreadCount(const ScopedThreadCount&) = delete;
+        ScopedThreadCount& operator=(const ScopedThreadCount&) = delete;
+
+    private:
+        unsigned previous;
+    };
+
+    // Split [begin, end) into contiguous ranges of at least 'grain' elements and call
+    // fn(rangeBegin, rangeEnd) for each range. Up to getThreadCount() threads (the caller and
+    // scheduler workers, see TaskScheduler.h) claim the ranges in order; there are a few more
+    // ranges than threads so a late or slow thread does not hold the loop up
+    template <typename Fn>
+    void parallelFor(size_t begin, size_t end, size_t grain, Fn&& fn) {
+        if (end <= begin) return;
+        const size_t count = end - begin;
+        grain = std::max<size_t>(grain, 1);
+
+        const size_t maxChunks = (count + grain - 1) / grain;
+        const size_t runners = std::min<size_t>(getThreadCount(), maxChunks);
+        if (runners <= 1) {
+            fn(begin, end);
+            return;
+        }
+
+        const size_t chunks = std::min(maxChunks, runners * 4);
+        const size_t chunkSize = (count + chunks - 1) / chunks;
+        std::atomic<size_t> next{ 0 };
+        auto claim = [&] {
+            for (size_t c = next++; c < chunks; c = next++) {
+                size_t b = begin + c * chunkSize;
+                if (b < end) fn(b, std::min(end, b + chunkSize));
+            }
+        };
+        TaskScheduler::TaskGroup group;
+        for (size_t r = 0; r + 1 < runners; ++r) group.run(claim);
+        claim();
+        group.wait();
+    }
+
+    // Call fn(i) for every i in [begin, end), each thread claims the next unclaimed index, so
+    // uneven items (subtrees, scenes) balance out. For a few coarse items, not per-element work
+    template <typename Fn>
+    void parallelForDynamic(size_t begin, size_t end, Fn&& fn) {
+        if (end <= begin) return;
+        std::atomic<size_t> next{ begin };
+        auto claim = [&] {
+            for (size_t i = next++; i < end; i = next++) fn(i);
+        };
+        const size_t runners = std::min<size_t>(getThreadCount(), end - begin);
+        TaskScheduler::TaskGroup group;
+        for (size_t r = 0; r + 1 < runners; ++r) group.run(claim);
+        claim();
+        group.wait();
+    }
+
+    // Stable partition of items[0, count) into K buckets by key(item) in [0, K), through 'scratch'
+    // (at least 'count' elements). Counts, offsets and the scatter run over fixed blocks, so the
+    // order does not depend on the thread count. Returns the bucket boundaries, bounds[K] = count
+    template <size_t K, typename T, typename Key>
+    std::array<size_t, K + 1> stablePartition(T* items, T* scratch, size_t count, Key&& key) {
+        constexpr size_t kBlock = 16384;
+        const size_t blocks = (count + kBlock - 1) / kBlock;
+        std::vector<std::array<size_t, K>> offsets(blocks);
+        parallelFor(0, blocks, 1, [&](size_t b0, size_t b1) {
+            for (size_t b = b0; b < b1; ++b) {
+                std::array<size_t, K> counts{};
+                for (size_t i = b * kBlock; i < std::min(count, (b + 1) * kBlock); ++i) ++counts[key(items[i])];
+                offsets[b] = counts;
+            }
+        });
+
+        // Bucket-major prefix sum: every block writes its part of a bucket after the earlier blocks
+        std::array<size_t, K + 1> bounds{};
+        size_t offset = 0;
+        for (size_t k = 0; k < K; ++k) {
+            bounds[k] = offset;
+            for (auto& block : offsets) {
+                const size_t n = block[k];
+                block[k] = offset;
+                offset += n;
+            }
+        }
+        bounds[K] = count;
+
+        parallelFor(0, blocks, 1, [&](size_t b0, size_t b1) {
+            for (size_t b = b0; b < b1; ++b) {
+                std::array<size_t, K> cursor = offsets[b];
+                for (size_t i = b * kBlock; i < std::min(count, (b + 1) * kBlock); ++i) scratch[cursor[key(items[i])]++] = items[i];
+            }
+        });
+        parallelFor(0, count, kBlock, [&](size_t b, size_t e) { std::copy(scratch + b, scratch + e, items + b); });
+        return bounds;
+    }
+
+    // Reduce [begin, end) over fixed blocks of 'blockSize' elements:
+    // blockFn(blockBegin, blockEnd) -> T runs in parallel, the block results are combined by a
+    // pairwise tree whose shape only depends on the block count, so the result is bitwise the
+    // same for any thread count (and rounding grows with log(blocks) instead of blocks)
+    template <typename T, typename BlockFn, typename Combine>
+    T parallelReduce(size_t begin, size_t end, size_t blockSize, T identity, BlockFn&& blockFn, Combine&& combine) {
+        if (end <= begin) return identity;
+        blockSize = std::max<size_t>(blockSize, 1);
+        const size_t blocks = (end - begin + blockSize - 1) / blockSize;
+
+        std::vector<T> partial(blocks, identity);
+        parallelFor(0, blocks, 1, [&](size_t b0, size_t b1) {
+            for (size_t b = b0; b < b1; ++b) {
+                size_t first = begin + b * blockSize;
+                partial[b] = blockFn(first, std::min(end, first + blockSize));
+            }
+        });
+
+        // ((b0 + b1) + (b2 + b3)) + ((b4 + b5) + ...)
+        for (size_t stride = 1; stride < blocks; stride *= 2) {
+            for (size_t b = 0; b + stride < blocks; b += 2 * stride) partial[b] = combine(partial[b], partial[b + stride]);
+        }
+        return combine(identity, partial[0]);
+    }
+}
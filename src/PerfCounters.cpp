@@ -0,0 +1,141 @@
+#include "PerfCounters.h"
+#include "TaskScheduler.h"
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <string>
+#endif
+
+namespace {
+    const char* const kCounterNames[PerfCounters::kCounterCount] = {
+        "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "fp_scalar", "fp_packed"
+    };
+
+    std::mutex mutex;
+    std::thread::id owner;
+
+#if defined(__linux__)
+    std::array<int, PerfCounters::kCounterCount> fds = { -1, -1, -1, -1, -1, -1, -1 };
+
+    bool isIntel() {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        while (std::getline(cpuinfo, line)) {
+            if (line.rfind("vendor_id", 0) == 0) return line.find("GenuineIntel") != std::string::npos;
+        }
+        return false;
+    }
+
+    uint64_t cacheConfig(uint64_t cache, uint64_t op, uint64_t result) {
+        return cache | (op << 8) | (result << 16);
+    }
+
+    int openEvent(uint32_t type, uint64_t config, int groupFd) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.exclude_kernel = 1; // works with perf_event_paranoid <= 2
+        attr.exclude_hv = 1;
+        attr.inherit = 1;        // count threads started after open()
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+    }
+
+    // Extrapolates when the group was multiplexed off the PMU part of the time
+    uint64_t readScaled(int fd) {
+        struct { uint64_t value, enabled, running; } data{};
+        if (::read(fd, &data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data.running == 0) return 0;
+        if (data.running >= data.enabled) return data.value;
+        return static_cast<uint64_t>(static_cast<double>(data.value) * static_cast<double>(data.enabled) / static_cast<double>(data.running));
+    }
+
+    void closeAll() {
+        for (int& fd : fds) {
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+        }
+    }
+#endif
+}
+
+const char* PerfCounters::getCounterName(Counter counter) {
+    return kCounterNames[static_cast<size_t>(counter)];
+}
+
+bool PerfCounters::open() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (isOpen()) return true;
+#if defined(__linux__)
+    auto slot = [](Counter c) -> int& { return fds[static_cast<size_t>(c)]; };
+
+    // Core group: cycles and instructions use fixed counters, the three misses fit the
+    // general-purpose ones, so the ratios come from the same time slices
+    slot(Counter::Cycles) = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (slot(Counter::Cycles) < 0) {
+        std::cerr << "Hardware counters unavailable: " << std::strerror(errno)
+                  << " (check /proc/sys/kernel/perf_event_paranoid)\n";
+        return false;
+    }
+    const int leader = slot(Counter::Cycles);
+    slot(Counter::Instructions) = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, leader);
+    slot(Counter::L1DMisses) = openEvent(PERF_TYPE_HW_CACHE,
+        cacheConfig(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS), leader);
+    slot(Counter::LLCMisses) = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, leader);
+    slot(Counter::BranchMisses) = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, leader);
+
+    // Vector group: FP_ARITH_INST_RETIRED (event 0xC7), umask 0x03 scalar, 0xFC packed
+    if (isIntel()) {
+        slot(Counter::FpPacked) = openEvent(PERF_TYPE_RAW, 0xFCC7, -1);
+        if (slot(Counter::FpPacked) >= 0) slot(Counter::FpScalar) = openEvent(PERF_TYPE_RAW, 0x03C7, slot(Counter::FpPacked));
+    }
+
+    owner = std::this_thread::get_id();
+    detail::open.store(true, std::memory_order_release);
+    lock.unlock();
+    // Existing scheduler workers would not be counted, this thread starts new ones
+    TaskScheduler::restart();
+    return true;
+#else
+    std::cerr << "Hardware counters need Linux perf_event_open\n";
+    return false;
+#endif
+}
+
+void PerfCounters::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    detail::open.store(false, std::memory_order_release);
+#if defined(__linux__)
+    closeAll();
+#endif
+}
+
+bool PerfCounters::isAvailable(Counter counter) {
+#if defined(__linux__)
+    return isOpen() && fds[static_cast<size_t>(counter)] >= 0;
+#else
+    (void)counter;
+    return false;
+#endif
+}
+
+bool PerfCounters::read(Values& out) {
+    if (!detail::open.load(std::memory_order_acquire) || std::this_thread::get_id() != owner) return false;
+#if defined(__linux__)
+    for (size_t i = 0; i < kCounterCount; ++i) {
+        out[i] = fds[i] >= 0 ? readScaled(fds[i]) : 0;
+    }
+    return true;
+#else
+    (void)out;
+    return false;
+#endif
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Optional hardware performance counters (Linux perf_event_open, user space only).
+// The counters are opened on one thread with inherit set, so threads it starts afterwards
+// are included; threads that already exist are not, open() restarts the scheduler workers
+// for that reason. Reads from any other thread fail, as do all reads on platforms without
+// perf_event_open.
+namespace PerfCounters {
+    enum class Counter : uint8_t {
+        Cycles,
+        Instructions,
+        L1DMisses,    // L1 data cache read misses
+        LLCMisses,    // last level cache misses
+        BranchMisses,
+        FpScalar,     // retired scalar SSE/AVX float ops (Intel FP_ARITH_INST_RETIRED only)
+        FpPacked,     // retired 128/256/512-bit packed float ops (Intel only)
+        Count
+    };
+
+    constexpr size_t kCounterCount = static_cast<size_t>(Counter::Count);
+    using Values = std::array<uint64_t, kCounterCount>;
+
+    const char* getCounterName(Counter counter);
+
+    // Opens the counter groups on the calling thread, false (with a message) if the
+    // hardware counters cannot be used; individual counters may still be unavailable
+    bool open();
+    // Must be called from the thread that opened the counters
+    void close();
+    bool isAvailable(Counter counter);
+
+    // Running totals scaled for multiplexing, false unless open and on the opening thread
+    bool read(Values& out);
+
+    // end - start, clamped at zero (multiplex scaling is not strictly monotonic)
+    inline Values difference(const Values& end, const Values& start) {
+        Values delta{};
+        for (size_t i = 0; i < kCounterCount; ++i) delta[i] = end[i] > start[i] ? end[i] - start[i] : 0;
+        return delta;
+    }
+
+    namespace detail {
+        inline std::atomic<bool> open{ false };
+    }
+
+    inline bool isOpen() {
+        return detail::open.load(std::memory_order_relaxed);
+    }
+}
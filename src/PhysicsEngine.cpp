@@ -1,6 +1,11 @@
 #include "PhysicsEngine.h"
 #include "ForceCalculator.h"
 #include "Integrator.h"
+#include "TrajectoryWriter.h"
+#include "DiagnosticsMonitor.h"
+#include "Profiler.h"
+#include "TaskGraph.h"
+#include "Trace.h"
 #include <algorithm>
 
 PhysicsEngine::PhysicsEngine()
@@ -30,44 +35,134 @@ void PhysicsEngine::update(std::vector<MassObject>& massObjects, double deltaTim
     
     // Accumulate time and process in small timesteps for stability
     accumulatedTime += deltaTime;
-    
+
+    if (pipelining) updatePipelined(massObjects);
+    else updateSequential(massObjects);
+}
+
+void PhysicsEngine::updateSequential(std::vector<MassObject>& massObjects) {
     while (accumulatedTime >= physicsTimestep) {
-        // Calculate forces for all objects
-        std::vector<glm::vec2> forces = forceCalculator->calculateForces(massObjects);
+        NBODY_TRACE_SCOPE("substep");
+        // Calculate accelerations for all objects
+        std::vector<glm::vec2> accelerations;
+        {
+            Profiler::ScopedTimer timer(Profiler::Phase::Forces);
+            NBODY_TRACE_SCOPE("forces");
+            accelerations = forceCalculator->calculateAccelerations(massObjects);
+        }
         
         // Integrate one timestep
-        integrator->integrate(massObjects, forces, physicsTimestep);
+        {
+            Profiler::ScopedTimer timer(Profiler::Phase::Integrate);
+            NBODY_TRACE_SCOPE("integrate");
+            integrator->integrate(massObjects, accelerations, physicsTimestep);
+        }
         
         accumulatedTime -= physicsTimestep;
+        ++stepCount;
+        simulationTime += physicsTimestep;
+
+        // Hand a copy to the I/O thread, never write from here
+        if (trajectoryWriter && stepCount % trajectoryInterval == 0) {
+            trajectoryWriter->submit(massObjects, stepCount, simulationTime);
+        }
+        if (diagnosticsMonitor && stepCount % diagnosticsInterval == 0) {
+            diagnosticsMonitor->publish(massObjects, *forceCalculator, stepCount, simulationTime);
+        }
     }
 }
 
+void PhysicsEngine::updatePipelined(std::vector<MassObject>& massObjects) {
+    size_t substeps = 0;
+    for (double t = accumulatedTime; t >= physicsTimestep; t -= physicsTimestep) ++substeps;
+    if (substeps == 0) return;
+
+    // forces(k) -> integrate(k) -> forces(k + 1) -> ... on this thread. The copies of substep k only
+    // read the bodies, like forces(k + 1); integrate(k + 1) waits for them before moving the bodies,
+    // so stepCount and simulationTime still hold substep k's values while they run
+    NBODY_TRACE_SCOPE("substeps");
+    TaskGraph graph;
+    std::vector<TaskGraph::Node> forcesAfter;    // integrate(k - 1)
+    std::vector<TaskGraph::Node> integrateAfter; // copies of substep k - 1
+    for (size_t k = 0; k < substeps; ++k) {
+        const uint64_t step = stepCount + k + 1;
+        const bool record = trajectoryWriter && step % trajectoryInterval == 0;
+        const bool measure = diagnosticsMonitor && step % diagnosticsInterval == 0;
+
+        TaskGraph::Node forcesNode = graph.add([this, &massObjects] {
+            Profiler::ScopedTimer timer(Profiler::Phase::Forces);
+            NBODY_TRACE_SCOPE("forces");
+            substepAccelerations = forceCalculator->calculateAccelerations(massObjects);
+        }, forcesAfter, TaskGraph::Affinity::Caller);
+
+        integrateAfter.push_back(forcesNode);
+        TaskGraph::Node integrateNode = graph.add([this, &massObjects, measure] {
+            {
+                Profiler::ScopedTimer timer(Profiler::Phase::Integrate);
+                NBODY_TRACE_SCOPE("integrate");
+                integrator->integrate(massObjects, substepAccelerations, physicsTimestep);
+            }
+            accumulatedTime -= physicsTimestep;
+            ++stepCount;
+            simulationTime += physicsTimestep;
+            // Cloned here, the calculator is busy during forces(k + 1)
+            if (measure) diagnosticsCalculator = forceCalculator->clone();
+        }, integrateAfter, TaskGraph::Affinity::Caller);
+
+        forcesAfter = { integrateNode };
+        integrateAfter.clear();
+        // Hand copies to the I/O and diagnostics threads, never write from here
+        if (record) {
+            integrateAfter.push_back(graph.add([this, &massObjects] {
+                trajectoryWriter->submit(massObjects, stepCount, simulationTime);
+            }, { integrateNode }));
+        }
+        if (measure) {
+            integrateAfter.push_back(graph.add([this, &massObjects] {
+                diagnosticsMonitor->publish(massObjects, std::move(diagnosticsCalculator), stepCount, simulationTime);
+            }, { integrateNode }));
+        }
+    }
+    graph.run();
+}
+
+void PhysicsEngine::setTrajectoryWriter(std::unique_ptr<TrajectoryWriter> writer, unsigned everySubsteps) {
+    trajectoryWriter = std::move(writer);
+    trajectoryInterval = std::max(1u, everySubsteps);
+}
+
+void PhysicsEngine::setDiagnosticsMonitor(std::unique_ptr<DiagnosticsMonitor> monitor, unsigned everySubsteps) {
+    diagnosticsMonitor = std::move(monitor);
+    setDiagnosticsInterval(everySubsteps);
+}
+
+void PhysicsEngine::onBodySwapRemoved(size_t slot) {
+    if (integrator) integrator->swapRemove(slot);
+    if (diagnosticsMonitor) diagnosticsMonitor->resetBaseline();
+}
+
+void PhysicsEngine::onBodiesReordered(const std::vector<size_t>& order) {
+    if (integrator) integrator->permute(order);
+    if (forceCalculator) forceCalculator->permute(order);
+}
+
+void PhysicsEngine::onBodiesCleared() {
+    if (integrator) integrator->reset();
+    if (diagnosticsMonitor) diagnosticsMonitor->resetBaseline();
+}
+
 void PhysicsEngine::setPhysicsTimestep(double timestep) {
     physicsTimestep = std::max(0.00001, timestep); // Minimum 0.00001 years ≈ 5.25 minutes for real G stability
 }
 
+SystemDiagnostics PhysicsEngine::computeDiagnostics(const std::vector<MassObject>& massObjects) const {
+    if (!forceCalculator) return SystemDiagnostics();
+
+    SystemDiagnostics d = Diagnostics::compute(massObjects, *forceCalculator);
+    d.time = simulationTime;
+    return d;
+}
+
 double PhysicsEngine::calculateTotalEnergy(const std::vector<MassObject>& massObjects) const {
-    if (!forceCalculator) return 0.0;
-    
-    double kineticEnergy = 0.0;
-    double potentialEnergy = 0.0;
-    
-    // Calculate kinetic energy: KE = 0.5 * m * v² (in AU²·M☉/year²)
-    for (const auto& obj : massObjects) {
-        glm::vec2 velocity = obj.getVelocity();
-        double speed2 = velocity.x * velocity.x + velocity.y * velocity.y;
-        kineticEnergy += 0.5 * obj.getMass() * speed2;
-    }
-    
-    // Calculate gravitational potential energy: PE = -G * m1 * m2 / r (in AU·M☉/year²)
-    for (size_t i = 0; i < massObjects.size(); ++i) {
-        for (size_t j = i + 1; j < massObjects.size(); ++j) {
-            double distance = massObjects[i].distanceTo(massObjects[j]);
-            if (distance > 0.001) { // Avoid division by zero (0.001 AU ≈ 150,000 km)
-                potentialEnergy -= (1.0 * massObjects[i].getMass() * massObjects[j].getMass()) / distance;
-            }
-        }
-    }
-    
-    return kineticEnergy + potentialEnergy;
-} 
\ No newline at end of file
+    return computeDiagnostics(massObjects).totalEnergy;
+}
@@ -1,11 +1,16 @@
 #pragma once
 #include "MassObject.h"
+#include "Diagnostics.h"
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include <algorithm>
 
 // Forward declarations
 class ForceCalculator;
 class Integrator;
+class TrajectoryWriter;
+class DiagnosticsMonitor;
 
 class PhysicsEngine {
 public:
@@ -14,6 +19,7 @@ public:
     
     // Set the force calculation method (brute force, Barnes-Hut, etc.)
     void setForceCalculator(std::unique_ptr<ForceCalculator> calculator);
+    ForceCalculator* getForceCalculator() const { return forceCalculator.get(); }
     
     // Set the numerical integration method
     void setIntegrator(std::unique_ptr<Integrator> integrator);
@@ -30,11 +36,39 @@ public:
     // Enable/disable physics simulation
     void setEnabled(bool enabled) { physicsEnabled = enabled; }
     bool isEnabled() const { return physicsEnabled; }
+
+    // Run each update's substeps as a task graph (see TaskGraph.h): forces and integration stay on
+    // the calling thread in order, the diagnostics and trajectory copies of substep k run on the
+    // workers during the forces of substep k + 1. Same results as the sequential loop
+    void setPipelining(bool enabled) { pipelining = enabled; }
+    bool getPipelining() const { return pipelining; }
+    
+    // Keep per-body solver state aligned with MassObjectTracker's storage
+    void onBodySwapRemoved(size_t slot);
+    void onBodiesReordered(const std::vector<size_t>& order); // new slot i = old slot order[i]
+    void onBodiesCleared();
     
-    // Debug/analysis methods
+    // Debug/analysis methods, potentials use the active force calculator (and its G)
+    SystemDiagnostics computeDiagnostics(const std::vector<MassObject>& massObjects) const;
     double calculateTotalEnergy(const std::vector<MassObject>& massObjects) const;
 
+    // Record positions/velocities every 'everySubsteps' physics substeps (nullptr stops recording)
+    void setTrajectoryWriter(std::unique_ptr<TrajectoryWriter> writer, unsigned everySubsteps = 100);
+    TrajectoryWriter* getTrajectoryWriter() const { return trajectoryWriter.get(); }
+
+    // Publish a snapshot to the background diagnostics thread every 'everySubsteps' substeps
+    void setDiagnosticsMonitor(std::unique_ptr<DiagnosticsMonitor> monitor, unsigned everySubsteps = 1000);
+    DiagnosticsMonitor* getDiagnosticsMonitor() const { return diagnosticsMonitor.get(); }
+    void setDiagnosticsInterval(unsigned everySubsteps) { diagnosticsInterval = std::max(1u, everySubsteps); }
+    unsigned getDiagnosticsInterval() const { return diagnosticsInterval; }
+
+    uint64_t getStepCount() const { return stepCount; }
+    double getSimulationTime() const { return simulationTime; }
+
 private:
+    void updateSequential(std::vector<MassObject>& massObjects);
+    void updatePipelined(std::vector<MassObject>& massObjects);
+
     std::unique_ptr<ForceCalculator> forceCalculator;
     std::unique_ptr<Integrator> integrator;
     double physicsTimestep;  // Internal physics timestep (smaller than render timestep)
@@ -42,4 +76,17 @@ private:
     
     // Accumulate small timesteps to handle larger deltaTime
     double accumulatedTime;
+
+    uint64_t stepCount = 0;      // substeps taken so far
+    double simulationTime = 0.0; // simulated years
+
+    std::unique_ptr<TrajectoryWriter> trajectoryWriter;
+    unsigned trajectoryInterval = 100;
+
+    std::unique_ptr<DiagnosticsMonitor> diagnosticsMonitor;
+    unsigned diagnosticsInterval = 1000;
+
+    bool pipelining = true;
+    std::vector<glm::vec2> substepAccelerations;            // pipelined substeps, reused
+    std::unique_ptr<ForceCalculator> diagnosticsCalculator; // cloned between the force passes
 }; 
\ No newline at end of file
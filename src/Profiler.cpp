@@ -0,0 +1,222 @@
+#include "Profiler.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+namespace {
+    struct PhaseData {
+        std::array<float, Profiler::kWindow> window{}; // milliseconds
+        size_t head = 0;
+        size_t count = 0;
+        double frameSeconds = 0.0;
+        uint32_t frameCalls = 0;
+        double lastFrameSeconds = 0.0;
+        uint32_t lastFrameCalls = 0;
+        PerfCounters::Values frameCounters{};
+        PerfCounters::Values lastFrameCounters{};
+        bool frameCounted = false;
+        bool lastFrameCounted = false;
+    };
+
+    std::mutex mutex;
+    std::array<PhaseData, Profiler::kPhaseCount> phases;
+    Profiler::WalkTotals frameWalk;
+    Profiler::WalkTotals lastFrameWalk;
+    TaskScheduler::Stats schedulerSnapshot;
+    std::chrono::steady_clock::time_point snapshotTime = std::chrono::steady_clock::now();
+    Profiler::SchedulerTotals lastFrameScheduler;
+    std::ofstream stream;
+    uint64_t frameIndex = 0;
+    std::chrono::steady_clock::time_point streamStart;
+
+    const char* const kPhaseNames[Profiler::kPhaseCount] = {
+        "tree_build", "tree_finalize", "force_walk", "forces", "integrate", "grid", "spheres", "gl_submit"
+    };
+
+    size_t histogramBin(float ms) {
+        double us = static_cast<double>(ms) * 1000.0;
+        if (us < 1.0) return 0;
+        return std::min(Profiler::kHistogramBins - 1, static_cast<size_t>(std::log2(us)));
+    }
+}
+
+const char* Profiler::getPhaseName(Phase phase) {
+    return kPhaseNames[static_cast<size_t>(phase)];
+}
+
+void Profiler::setEnabled(bool enabled) {
+    detail::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Profiler::isEnabled() {
+    return detail::enabled.load(std::memory_order_relaxed);
+}
+
+void Profiler::record(Phase phase, double seconds) {
+    if (!isEnabled()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    PhaseData& p = phases[static_cast<size_t>(phase)];
+    p.window[p.head] = static_cast<float>(seconds * 1000.0);
+    p.head = (p.head + 1) % kWindow;
+    p.count = std::min(p.count + 1, kWindow);
+    p.frameSeconds += seconds;
+    ++p.frameCalls;
+}
+
+void Profiler::recordCounters(Phase phase, const PerfCounters::Values& delta) {
+    std::lock_guard<std::mutex> lock(mutex);
+    PhaseData& p = phases[static_cast<size_t>(phase)];
+    for (size_t i = 0; i < PerfCounters::kCounterCount; ++i) p.frameCounters[i] += delta[i];
+    p.frameCounted = true;
+}
+
+void Profiler::recordWalk(const WalkTotals& walk) {
+    if (!isEnabled()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    frameWalk.evaluations += walk.evaluations;
+    frameWalk.bodies += walk.bodies;
+    frameWalk.nodeBody += walk.nodeBody;
+    frameWalk.bodyBody += walk.bodyBody;
+    frameWalk.nodesVisited += walk.nodesVisited;
+    frameWalk.maxDepth = std::max(frameWalk.maxDepth, walk.maxDepth);
+    frameWalk.maxBodyNodesVisited = std::max(frameWalk.maxBodyNodesVisited, walk.maxBodyNodesVisited);
+    frameWalk.cellCell += walk.cellCell;
+}
+
+Profiler::WalkTotals Profiler::getLastFrameWalk() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastFrameWalk;
+}
+
+Profiler::SchedulerTotals Profiler::getLastFrameScheduler() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastFrameScheduler;
+}
+
+void Profiler::endFrame() {
+    TaskScheduler::Stats scheduler = TaskScheduler::getStats();
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (PhaseData& p : phases) {
+        p.lastFrameSeconds = p.frameSeconds;
+        p.lastFrameCalls = p.frameCalls;
+        p.frameSeconds = 0.0;
+        p.frameCalls = 0;
+        p.lastFrameCounters = p.frameCounters;
+        p.lastFrameCounted = p.frameCounted;
+        p.frameCounters = {};
+        p.frameCounted = false;
+    }
+    lastFrameWalk = frameWalk;
+    frameWalk = {};
+
+    // Totals are cumulative per slot, a worker added by a resize diffs against zero
+    lastFrameScheduler = {};
+    lastFrameScheduler.workers = scheduler.workers;
+    lastFrameScheduler.frameSeconds = std::chrono::duration<double>(now - snapshotTime).count();
+    for (size_t i = 0; i < scheduler.threads.size(); ++i) {
+        const bool outside = i + 1 == scheduler.threads.size();
+        TaskScheduler::WorkerStats before;
+        if (outside && !schedulerSnapshot.threads.empty()) before = schedulerSnapshot.threads.back();
+        else if (!outside && i < schedulerSnapshot.workers) before = schedulerSnapshot.threads[i];
+        const TaskScheduler::WorkerStats& after = scheduler.threads[i];
+        lastFrameScheduler.tasks += after.tasks - std::min(after.tasks, before.tasks);
+        lastFrameScheduler.steals += after.steals - std::min(after.steals, before.steals);
+        lastFrameScheduler.busySeconds.push_back(std::max(0.0, after.busySeconds - before.busySeconds));
+    }
+    schedulerSnapshot = std::move(scheduler);
+    snapshotTime = now;
+
+    if (stream.is_open()) {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - streamStart).count();
+        stream << "{\"frame\":" << frameIndex << ",\"t\":" << elapsed << ",\"phases\":{";
+        for (size_t i = 0; i < kPhaseCount; ++i) {
+            stream << (i ? "," : "") << '"' << kPhaseNames[i] << "\":{\"ms\":" << phases[i].lastFrameSeconds * 1000.0
+                   << ",\"calls\":" << phases[i].lastFrameCalls;
+            if (phases[i].lastFrameCounted) {
+                bool first = true;
+                stream << ",\"counters\":{";
+                for (size_t c = 0; c < PerfCounters::kCounterCount; ++c) {
+                    PerfCounters::Counter counter = static_cast<PerfCounters::Counter>(c);
+                    if (!PerfCounters::isAvailable(counter)) continue;
+                    stream << (first ? "" : ",") << '"' << PerfCounters::getCounterName(counter) << "\":" << phases[i].lastFrameCounters[c];
+                    first = false;
+                }
+                stream << '}';
+            }
+            stream << '}';
+        }
+        stream << '}';
+        if (lastFrameWalk.evaluations > 0) {
+            stream << ",\"walk\":{\"evaluations\":" << lastFrameWalk.evaluations << ",\"bodies\":" << lastFrameWalk.bodies
+                   << ",\"node_body\":" << lastFrameWalk.nodeBody << ",\"body_body\":" << lastFrameWalk.bodyBody
+                   << ",\"nodes_visited\":" << lastFrameWalk.nodesVisited << ",\"max_depth\":" << lastFrameWalk.maxDepth
+                   << ",\"max_body_nodes_visited\":" << lastFrameWalk.maxBodyNodesVisited << ",\"cell_cell\":" << lastFrameWalk.cellCell << '}';
+        }
+        stream << ",\"scheduler\":{\"workers\":" << lastFrameScheduler.workers << ",\"tasks\":" << lastFrameScheduler.tasks
+               << ",\"steals\":" << lastFrameScheduler.steals << ",\"busy_ms\":[";
+        for (size_t i = 0; i < lastFrameScheduler.busySeconds.size(); ++i) {
+            stream << (i ? "," : "") << lastFrameScheduler.busySeconds[i] * 1000.0;
+        }
+        stream << "]}";
+        stream << "}\n";
+    }
+    ++frameIndex;
+}
+
+Profiler::PhaseStats Profiler::getStats(Phase phase) {
+    std::vector<float> samples;
+    PhaseStats stats;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const PhaseData& p = phases[static_cast<size_t>(phase)];
+        samples.assign(p.window.begin(), p.window.begin() + p.count);
+        stats.lastFrameMs = p.lastFrameSeconds * 1000.0;
+        stats.lastFrameCalls = p.lastFrameCalls;
+        stats.hasCounters = p.lastFrameCounted;
+        stats.lastFrameCounters = p.lastFrameCounters;
+    }
+
+    stats.samples = samples.size();
+    if (samples.empty()) return stats;
+
+    double sum = 0.0;
+    for (float ms : samples) {
+        sum += ms;
+        ++stats.histogram[histogramBin(ms)];
+    }
+    std::sort(samples.begin(), samples.end());
+    stats.meanMs = sum / static_cast<double>(samples.size());
+    stats.p50Ms = samples[samples.size() / 2];
+    stats.p95Ms = samples[std::min(samples.size() - 1, samples.size() * 95 / 100)];
+    stats.maxMs = samples.back();
+    return stats;
+}
+
+void Profiler::getRecentSamples(Phase phase, std::vector<float>& outMs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const PhaseData& p = phases[static_cast<size_t>(phase)];
+    outMs.resize(p.count);
+    size_t first = (p.head + kWindow - p.count) % kWindow;
+    for (size_t i = 0; i < p.count; ++i) {
+        outMs[i] = p.window[(first + i) % kWindow];
+    }
+}
+
+bool Profiler::openStatsStream(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stream.is_open()) stream.close();
+    if (path.empty()) return true;
+
+    stream.open(path, std::ios::trunc);
+    if (!stream.is_open()) {
+        std::cerr << "Failed to open stats stream " << path << "\n";
+        return false;
+    }
+    streamStart = std::chrono::steady_clock::now();
+    frameIndex = 0;
+    return true;
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include "PerfCounters.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Low-overhead per-phase timers for the hot path.
+// Samples go into a rolling window per phase (read by the "Performance" window) and, when a
+// stats stream is open, every endFrame() writes the per-frame totals as one JSON line.
+// While PerfCounters are open, timed phases on the counting thread also sum counter deltas.
+namespace Profiler {
+    enum class Phase : uint8_t {
+        TreeBuild,    // BarnesHutCalculator inserts
+        TreeFinalize, // BarnesHutCalculator mass/COM aggregation
+        ForceWalk,    // BarnesHutCalculator force evaluation
+        Forces,       // whole calculateForces call, any calculator
+        Integrate,
+        Grid,         // GridGenerator::generateGridVertices
+        Spheres,      // MassObjectTracker::getAllSpheres
+        GLSubmit,     // grid and sphere draw calls
+        Count
+    };
+
+    constexpr size_t kPhaseCount = static_cast<size_t>(Phase::Count);
+    constexpr size_t kWindow = 512;       // samples kept per phase
+    constexpr size_t kHistogramBins = 24; // bin b holds durations in [2^b, 2^(b+1)) microseconds
+
+    struct PhaseStats {
+        size_t samples = 0; // in the rolling window
+        double meanMs = 0.0;
+        double p50Ms = 0.0;
+        double p95Ms = 0.0;
+        double maxMs = 0.0;
+        double lastFrameMs = 0.0;    // summed over the last completed frame
+        uint32_t lastFrameCalls = 0;
+        std::array<uint32_t, kHistogramBins> histogram{};
+        bool hasCounters = false;          // counter deltas were recorded in the last frame
+        PerfCounters::Values lastFrameCounters{};
+    };
+
+    const char* getPhaseName(Phase phase);
+
+    // Disabled timers skip the clock reads entirely
+    void setEnabled(bool enabled);
+    bool isEnabled();
+
+    void record(Phase phase, double seconds);
+    void recordCounters(Phase phase, const PerfCounters::Values& delta);
+
+    // Barnes-Hut opening statistics, summed over the force evaluations of a frame
+    struct WalkTotals {
+        uint32_t evaluations = 0;
+        uint64_t bodies = 0;
+        uint64_t nodeBody = 0;
+        uint64_t bodyBody = 0;
+        uint64_t nodesVisited = 0;
+        uint32_t maxDepth = 0;            // max over the frame
+        uint64_t maxBodyNodesVisited = 0; // max over the frame
+        uint64_t cellCell = 0;            // dual-tree accepted cell pairs
+    };
+    void recordWalk(const WalkTotals& walk);
+    WalkTotals getLastFrameWalk();
+
+    // Task scheduler activity between the last two endFrame() calls (TaskScheduler::getStats deltas)
+    struct SchedulerTotals {
+        unsigned workers = 0;
+        uint64_t tasks = 0;
+        uint64_t steals = 0;
+        double frameSeconds = 0.0;
+        std::vector<double> busySeconds; // per worker, then threads outside the pool
+    };
+    SchedulerTotals getLastFrameScheduler();
+
+    // Close the current frame's totals (and write a JSON line if a stream is open)
+    void endFrame();
+
+    PhaseStats getStats(Phase phase);
+    // Window samples in milliseconds, oldest first
+    void getRecentSamples(Phase phase, std::vector<float>& outMs);
+
+    // JSON-lines output for headless runs, an empty path closes the stream
+    bool openStatsStream(const std::string& path);
+
+    namespace detail {
+        inline std::atomic<bool> enabled{ true };
+    }
+
+    // Hardware counter deltas only, for phases that read the clock themselves
+    class CounterScope {
+    public:
+        explicit CounterScope(Phase phase)
+            : phase(phase), active(PerfCounters::isOpen() && detail::enabled.load(std::memory_order_relaxed) && PerfCounters::read(start)) {}
+        ~CounterScope() {
+            PerfCounters::Values end;
+            if (active && PerfCounters::read(end)) recordCounters(phase, PerfCounters::difference(end, start));
+        }
+
+        CounterScope(const CounterScope&) = delete;
+        CounterScope& operator=(const CounterScope&) = delete;
+
+    private:
+        Phase phase;
+        bool active;
+        PerfCounters::Values start;
+    };
+
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Phase phase)
+            : counters(phase), phase(phase), active(detail::enabled.load(std::memory_order_relaxed)) {
+            if (active) start = std::chrono::steady_clock::now();
+        }
+        ~ScopedTimer() {
+            if (active) record(phase, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        CounterScope counters; // brackets the clock reads
+        Phase phase;
+        bool active;
+        std::chrono::steady_clock::time_point start;
+    };
+}
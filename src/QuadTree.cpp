@@ -1,7 +1,25 @@
 #include "QuadTree.h"
+#include "Parallel.h"
+#include "Trace.h"
 #include <algorithm>
 #include <cmath>
 
+namespace {
+    // 0 nw, 1 ne, 2 sw, 3 se, the rule of QuadNode::childFor
+    inline size_t quadrantOf(const glm::vec2& p, const glm::vec2& c) {
+        return (p.y >= c.y ? 0 : 2) + (p.x <= c.x ? 0 : 1);
+    }
+}
+
+const char* getOpeningCriterionName(OpeningCriterion::Type type) {
+    switch (type) {
+    case OpeningCriterion::Type::Geometric: return "Geometric";
+    case OpeningCriterion::Type::Bmax: return "Bmax";
+    case OpeningCriterion::Type::RelativeAcceleration: return "Relative acceleration";
+    }
+    return "Unknown";
+}
+
 bool AABB::contains(const glm::vec2& p) const {
     return std::abs(p.x - center.x) <= halfSize.x &&
         std::abs(p.y - center.y) <= halfSize.y;
@@ -14,6 +32,13 @@ bool AABB::intersects(const AABB& other) const {
 
 QuadNode::QuadNode(const AABB& region) : bounds(region) {}
 
+QuadNode::~QuadNode() {
+    delete nw;
+    delete ne;
+    delete sw;
+    delete se;
+}
+
 void QuadNode::subdivide() {
     glm::vec2 hs = bounds.halfSize * 0.5f;
     glm::vec2 c = bounds.center;
@@ -23,35 +48,40 @@ void QuadNode::subdivide() {
     se = new QuadNode({ {c.x + hs.x, c.y - hs.y}, hs });
 }
 
+QuadNode* QuadNode::childFor(const glm::vec2& p) const {
+    const bool west = p.x <= bounds.center.x;
+    const bool north = p.y >= bounds.center.y;
+    return north ? (west ? nw : ne) : (west ? sw : se);
+}
+
 bool QuadNode::insert(const MassObject& m) {
-    const glm::vec2 p = m.getPosition();
-    if (!bounds.contains(p)) return false;
+    if (!bounds.contains(m.getPosition())) return false;
+    insertBelow(m);
+    return true;
+}
 
-    if (isLeaf() && body == nullptr) {
-        body = &m;
-        totalMass = m.getMass();
-        com = p;
-        return true;
-    }
+void QuadNode::insertBelow(const MassObject& m) {
+    const glm::vec2 p = m.getPosition();
+    QuadNode* node = this;
+    while (true) {
+        if (node->isLeaf() && node->body == nullptr) {
+            node->body = &m;
+            node->totalMass = m.getMass();
+            node->com = p;
+            return;
+        }
 
-    if (isLeaf()) {
-        subdivide();
-        const MassObject* old = body;
-        body = nullptr;
-        insert(*old);
+        if (node->isLeaf()) {
+            node->subdivide();
+            const MassObject* old = node->body;
+            node->body = nullptr;
+            node->childFor(old->getPosition())->insertBelow(*old);
+        }
+        node = node->childFor(p);
     }
-
-    if (nw->insert(m)) return true;
-    if (ne->insert(m)) return true;
-    if (sw->insert(m)) return true;
-    if (se->insert(m)) return true;
-    return false;
 }
 
-void QuadNode::finalize() {
-    if (isLeaf()) return;
-    nw->finalize(); ne->finalize(); sw->finalize(); se->finalize();
-
+void QuadNode::aggregateChildren() {
     double msum = 0.0;
     glm::vec2 csum{0.0f, 0.0f};
     QuadNode* kids[4] = { nw, ne, sw, se };
@@ -65,6 +95,102 @@ void QuadNode::finalize() {
     com = (msum > 0.0) ? (csum / static_cast<float>(msum)) : glm::vec2{ 0.0f, 0.0f };
 }
 
+void QuadNode::finalize() {
+    if (isLeaf()) return;
+    nw->finalize(); ne->finalize(); sw->finalize(); se->finalize();
+    aggregateChildren();
+}
+
+void QuadNode::build(const std::vector<MassObject>& bodies, size_t taskCutoff) {
+    taskCutoff = std::max<size_t>(taskCutoff, 1);
+    std::vector<const MassObject*> items;
+    items.reserve(bodies.size());
+    for (const auto& b : bodies) {
+        if (bounds.contains(b.getPosition())) items.push_back(&b);
+    }
+    std::vector<const MassObject*> scratch(items.size());
+
+    // Top levels: split every node above the cutoff, the subtrees below it become tasks
+    struct Task { QuadNode* node; size_t begin; size_t count; };
+    std::vector<Task> tasks;
+    std::vector<QuadNode*> split; // pre-order, parents before children
+    auto plan = [&](auto&& self, QuadNode* node, size_t begin, size_t count) -> void {
+        if (count <= taskCutoff) {
+            tasks.push_back({ node, begin, count });
+            return;
+        }
+        node->subdivide();
+        split.push_back(node);
+        const glm::vec2 c = node->bounds.center;
+        const auto quadrants = Parallel::stablePartition<4>(items.data() + begin, scratch.data() + begin, count,
+                                                            [c](const MassObject* m) { return quadrantOf(m->getPosition(), c); });
+        QuadNode* kids[4] = { node->nw, node->ne, node->sw, node->se };
+        for (size_t q = 0; q < 4; ++q) self(self, kids[q], begin + quadrants[q], quadrants[q + 1] - quadrants[q]);
+    };
+    plan(plan, this, 0, items.size());
+
+    // Largest first, so the last claimed tasks are short
+    std::sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b) { return a.count > b.count; });
+    Parallel::parallelForDynamic(0, tasks.size(), [&](size_t t) {
+        NBODY_TRACE_SCOPE("tree_build_task");
+        tasks[t].node->buildSubtree(items.data() + tasks[t].begin, tasks[t].count);
+    });
+    for (auto it = split.rbegin(); it != split.rend(); ++it) (*it)->aggregateChildren();
+}
+
+void QuadNode::buildSubtree(const MassObject** items, size_t count) {
+    if (count == 0) {
+        totalMass = 0.0;
+        return;
+    }
+    if (count == 1) {
+        body = items[0];
+        totalMass = body->getMass();
+        com = body->getPosition();
+        return;
+    }
+
+    subdivide();
+    const glm::vec2 c = bounds.center;
+    const MassObject** last = items + count;
+    const MassObject** southBegin = std::partition(items, last, [c](const MassObject* m) { return m->getPosition().y >= c.y; });
+    const MassObject** neBegin = std::partition(items, southBegin, [c](const MassObject* m) { return m->getPosition().x <= c.x; });
+    const MassObject** seBegin = std::partition(southBegin, last, [c](const MassObject* m) { return m->getPosition().x <= c.x; });
+    nw->buildSubtree(items, neBegin - items);
+    ne->buildSubtree(neBegin, southBegin - neBegin);
+    sw->buildSubtree(southBegin, seBegin - southBegin);
+    se->buildSubtree(seBegin, last - seBegin);
+    aggregateChildren();
+}
+
+size_t QuadNode::refit(const MassObject* base, std::vector<QuadNode*>& leafOf) {
+    if (isLeaf()) {
+        if (!body) {
+            totalMass = 0.0;
+            return 0;
+        }
+        totalMass = body->getMass();
+        com = body->getPosition();
+        leafOf[body - base] = this;
+        return 1;
+    }
+
+    size_t count = nw->refit(base, leafOf) + ne->refit(base, leafOf) + sw->refit(base, leafOf) + se->refit(base, leafOf);
+    if (count <= 1) {
+        // Children are leaves by now, keep the one body (if any) here
+        QuadNode* kids[4] = { nw, ne, sw, se };
+        for (auto* k : kids) {
+            if (k->body) body = k->body;
+            delete k;
+        }
+        nw = ne = sw = se = nullptr;
+        return refit(base, leafOf);
+    }
+
+    aggregateChildren();
+    return count;
+}
+
 static inline glm::vec2 pairForce(const glm::vec2& from, const glm::vec2& to, double mass, double G, double softening) {
     glm::vec2 r = to - from;
     double dist = std::max(static_cast<double>(glm::length(r)), softening);
@@ -74,29 +200,80 @@ static inline glm::vec2 pairForce(const glm::vec2& from, const glm::vec2& to, do
     return dir * static_cast<float>(mag);
 }
 
-glm::vec2 QuadNode::computeForceAt(const glm::vec2& point, double theta, double G, double softening) const {
-    if (totalMass <= 0.0) return { 0.0f, 0.0f };
+glm::vec2 QuadNode::computeForceAt(const glm::vec2& point, const OpeningCriterion& mac, float acceleration, double G, double softening, WalkCounters* counters) const {
+    return computeForceAt(point, mac, acceleration, G, softening, counters, 0);
+}
 
-    // Size over distance heuristic
+bool QuadNode::accepts(const glm::vec2& point, const OpeningCriterion& mac, float acceleration, double G, double softening) const {
     double s = static_cast<double>(bounds.halfSize.x + bounds.halfSize.y); // rough size
     double d = std::max(static_cast<double>(glm::length(com - point)), softening);
+    if (mac.type == OpeningCriterion::Type::Geometric && !mac.boxCheck) return (s / d) < mac.theta;
+    return mac.accepts(com - point, static_cast<float>(d * d), static_cast<float>(totalMass), static_cast<float>(s), acceleration, G,
+                       bounds.center, point);
+}
+
+glm::vec2 QuadNode::computeForceAt(const glm::vec2& point, const OpeningCriterion& mac, float acceleration, double G, double softening, WalkCounters* counters, uint32_t depth) const {
+    if (counters) {
+        ++counters->nodesVisited;
+        counters->maxDepth = std::max(counters->maxDepth, depth);
+    }
+    if (totalMass <= 0.0) return { 0.0f, 0.0f };
 
     if (isLeaf()) {
         if (body && (body->getPosition().x != point.x || body->getPosition().y != point.y)) {
+            if (counters) ++counters->bodyBody;
             return pairForce(point, body->getPosition(), body->getMass() * G, 1.0, softening); // G folded into mass for reuse
         }
         return { 0.0f, 0.0f };
     }
 
-    if ((s / d) < theta) {
+    if (accepts(point, mac, acceleration, G, softening)) {
         // Treat node as a single body at COM
+        if (counters) ++counters->nodeBody;
         return pairForce(point, com, totalMass * G, 1.0, softening);
     }
 
     glm::vec2 f{0.0f, 0.0f};
-    if (nw) f += nw->computeForceAt(point, theta, G, softening);
-    if (ne) f += ne->computeForceAt(point, theta, G, softening);
-    if (sw) f += sw->computeForceAt(point, theta, G, softening);
-    if (se) f += se->computeForceAt(point, theta, G, softening);
+    if (nw) f += nw->computeForceAt(point, mac, acceleration, G, softening, counters, depth + 1);
+    if (ne) f += ne->computeForceAt(point, mac, acceleration, G, softening, counters, depth + 1);
+    if (sw) f += sw->computeForceAt(point, mac, acceleration, G, softening, counters, depth + 1);
+    if (se) f += se->computeForceAt(point, mac, acceleration, G, softening, counters, depth + 1);
     return f;
+}
+
+double QuadNode::computePotentialAt(const glm::vec2& point, const OpeningCriterion& mac, float acceleration, double G, double softening) const {
+    if (totalMass <= 0.0) return 0.0;
+
+    if (isLeaf()) {
+        if (body && (body->getPosition().x != point.x || body->getPosition().y != point.y)) {
+            double r = std::max(static_cast<double>(glm::length(body->getPosition() - point)), softening);
+            return -G * body->getMass() / r;
+        }
+        return 0.0;
+    }
+
+    if (accepts(point, mac, acceleration, G, softening)) {
+        double d = std::max(static_cast<double>(glm::length(com - point)), softening);
+        return -G * totalMass / d;
+    }
+
+    double phi = 0.0;
+    if (nw) phi += nw->computePotentialAt(point, mac, acceleration, G, softening);
+    if (ne) phi += ne->computePotentialAt(point, mac, acceleration, G, softening);
+    if (sw) phi += sw->computePotentialAt(point, mac, acceleration, G, softening);
+    if (se) phi += se->computePotentialAt(point, mac, acceleration, G, softening);
+    return phi;
+}
+
+void WalkCounters::merge(const WalkCounters& other) {
+    nodeBody += other.nodeBody;
+    bodyBody += other.bodyBody;
+    nodesVisited += other.nodesVisited;
+    cellCell += other.cellCell;
+    maxDepth = std::max(maxDepth, other.maxDepth);
+}
+
+size_t QuadNode::countNodes() const {
+    if (isLeaf()) return 1;
+    return 1 + nw->countNodes() + ne->countNodes() + sw->countNodes() + se->countNodes();
 }
\ No newline at end of file
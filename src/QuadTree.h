@@ -1,6 +1,9 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
 #include <vector>
+#include <cstdint>
 #include "MassObject.h"
 
 struct AABB {
@@ -10,10 +13,67 @@ struct AABB {
     bool intersects(const AABB& other) const;
 };
 
+// Tallies of force walks, accumulated by the caller across bodies
+struct WalkCounters {
+    uint64_t nodeBody = 0;     // accepted cells, treated as one body at their COM
+    uint64_t bodyBody = 0;     // leaf bodies
+    uint64_t nodesVisited = 0; // every node the walk touched, opened or not
+    uint32_t maxDepth = 0;     // deepest node touched, the root is depth 0
+    uint64_t cellCell = 0;     // dual-tree walks only: accepted cell pairs
+
+    uint64_t interactions() const { return nodeBody + bodyBody + cellCell; }
+    void merge(const WalkCounters& other);
+};
+
+// Multipole acceptance criterion (MAC): when a walk may treat a cell as one body at its COM.
+// 'side' is the cell's width, 'd' the distance from the target to the COM (at least the softening)
+struct OpeningCriterion {
+    enum class Type {
+        Geometric,            // side / d < theta
+        Bmax,                 // distance from the COM to the farthest corner / d < theta
+        RelativeAcceleration, // G M side^2 / d^4 < alpha |a|, |a| the target's previous acceleration
+    };
+    Type type = Type::Geometric;
+    double theta = 0.5;    // Geometric and Bmax, RelativeAcceleration while the target's |a| is unknown
+    double alpha = 0.001;  // RelativeAcceleration: tolerated force error as a fraction of |a|
+    bool boxCheck = false; // also open cells whose box is closer to the target than 10% of their side
+
+    // r = COM - target, d2 = max(|r|^2, softening^2), acceleration = the target's previous |a| (0 if unknown)
+    bool accepts(const glm::vec2& r, float d2, float mass, float side, float acceleration, double G,
+                 const glm::vec2& boxCentre, const glm::vec2& target) const {
+        const float theta2 = static_cast<float>(theta * theta);
+        bool accept;
+        if (type == Type::Bmax) {
+            const float half = 0.5f * side;
+            const glm::vec2 corner = glm::abs(r + target - boxCentre) + half;
+            accept = corner.x * corner.x + corner.y * corner.y < theta2 * d2;
+        }
+        else if (type == Type::RelativeAcceleration && acceleration > 0.0f) {
+            accept = G * mass * side * side < alpha * acceleration * static_cast<double>(d2) * d2;
+        }
+        else accept = side * side < theta2 * d2;
+        if (!accept || !boxCheck) return accept;
+
+        // The COM lies in the box, from (sqrt(2) + 0.1) sides away the box cannot be that close
+        if (r.x * r.x + r.y * r.y > 2.3f * side * side) return true;
+        const float half = 0.5f * side;
+        const float dx = std::max(std::abs(boxCentre.x - target.x) - half, 0.0f);
+        const float dy = std::max(std::abs(boxCentre.y - target.y) - half, 0.0f);
+        return dx * dx + dy * dy >= 0.01f * side * side; // 0 inside the box
+    }
+};
+
+const char* getOpeningCriterionName(OpeningCriterion::Type type);
+
 class QuadNode {
 public:
     QuadNode(const AABB& region);
+    ~QuadNode(); // frees the children
 
+    QuadNode(const QuadNode&) = delete;
+    QuadNode& operator=(const QuadNode&) = delete;
+
+    // False if the body lies outside this node
     bool insert(const MassObject& body);
     void subdivide();
 
@@ -35,6 +95,38 @@ public:
     // Build aggregation after inserts
     void finalize();
 
+    // Top-down build of the tree the inserts produce, moments included. The top levels are split
+    // with parallel partition passes until subtrees hold at most 'taskCutoff' bodies, those are
+    // built and finalized as parallel tasks. Call on a fresh root, bodies outside it are skipped
+    void build(const std::vector<MassObject>& bodies, size_t taskCutoff = 4096);
+
+    // Tree reuse: recompute masses/COMs bottom-up from the bodies' current positions, collapse
+    // subtrees holding at most one body (same topology as a fresh build) and record each body's
+    // leaf in leafOf[body - base]. Returns the number of bodies in the subtree
+    size_t refit(const MassObject* base, std::vector<QuadNode*>& leafOf);
+
     // Accumulate force contribution to a point using BarnesHut criterion
-    glm::vec2 computeForceAt(const glm::vec2& point, double theta, double G, double softening) const;
+    // 'acceleration' is the point's |a| from the previous evaluation, 0 if unknown (RelativeAcceleration only)
+    // 'counters' (optional) is incremented for this walk, without it the walk does no bookkeeping
+    glm::vec2 computeForceAt(const glm::vec2& point, const OpeningCriterion& mac, float acceleration, double G, double softening, WalkCounters* counters = nullptr) const;
+
+    // Same walk for the potential -G*m/max(r, softening), bodies at 'point' are skipped
+    double computePotentialAt(const glm::vec2& point, const OpeningCriterion& mac, float acceleration, double G, double softening) const;
+
+    // Number of nodes in this subtree (including empty leaves)
+    size_t countNodes() const;
+
+private:
+    // Child quadrant for a point, chosen against the centre so float gaps between
+    // child bounds cannot drop a body (the boundary goes west and north, like contains())
+    QuadNode* childFor(const glm::vec2& p) const;
+    void insertBelow(const MassObject& body);
+    // Serial top-down build below this node, bodies are reordered by quadrant
+    void buildSubtree(const MassObject** items, size_t count);
+    // Mass and COM from the children's
+    void aggregateChildren();
+
+    glm::vec2 computeForceAt(const glm::vec2& point, const OpeningCriterion& mac, float acceleration, double G, double softening, WalkCounters* counters, uint32_t depth) const;
+    // Geometric without the box check is the original size over distance test
+    bool accepts(const glm::vec2& point, const OpeningCriterion& mac, float acceleration, double G, double softening) const;
 };
\ No newline at end of file
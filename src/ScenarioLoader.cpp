@@ -0,0 +1,268 @@
+#include "ScenarioLoader.h"
+#include "Parallel.h"
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr char kMagic[4] = { 'N', 'B', 'S', 'C' };
+    constexpr uint32_t kVersion = 1;
+    constexpr size_t kHeaderSize = 4 + 4 + 8;
+    constexpr size_t kRecordSize = 8 + 4 * 4;
+    constexpr size_t kMinChunkBytes = 1 << 20; // parse at least 1 MiB per task
+
+    // Read-only memory mapping of a whole file
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+            file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return;
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapping) return;
+            data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            if (data) size = static_cast<size_t>(fileSize.QuadPart);
+#else
+            fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0) return;
+            void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) return;
+            madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+            data = static_cast<const char*>(p);
+            size = static_cast<size_t>(st.st_size);
+#endif
+        }
+
+        ~MappedFile() {
+#ifdef _WIN32
+            if (data) UnmapViewOfFile(data);
+            if (mapping) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+            if (data) munmap(const_cast<char*>(data), size);
+            if (fd >= 0) ::close(fd);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool isOpen() const {
+#ifdef _WIN32
+            return file != INVALID_HANDLE_VALUE;
+#else
+            return fd >= 0;
+#endif
+        }
+
+        const char* data = nullptr;
+        size_t size = 0;
+
+    private:
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#else
+        int fd = -1;
+#endif
+    };
+
+    inline bool isSeparator(char c) {
+        return c == ' ' || c == '\t' || c == ',' || c == ';' || c == '\r';
+    }
+
+    inline bool parseNumber(const char*& p, const char* end, double& value) {
+        while (p < end && isSeparator(*p)) ++p;
+        if (p < end && *p == '+') ++p; // from_chars does not accept a leading '+'
+        auto result = std::from_chars(p, end, value);
+        if (result.ec != std::errc()) return false;
+        p = result.ptr;
+        return true;
+    }
+
+    struct ChunkResult {
+        std::vector<MassObject> bodies;
+        const char* errorAt = nullptr; // first malformed line
+    };
+
+    void parseChunk(const char* p, const char* end, ChunkResult& result) {
+        // Rough guess of 40 bytes per line avoids most regrowth
+        result.bodies.reserve(static_cast<size_t>(end - p) / 40 + 1);
+
+        while (p < end) {
+            const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            if (!lineEnd) lineEnd = end;
+
+            const char* q = p;
+            while (q < lineEnd && isSeparator(*q)) ++q;
+            bool skip = q == lineEnd || *q == '#' || (*q >= 'A' && *q <= 'Z') || (*q >= 'a' && *q <= 'z');
+
+            if (!skip) {
+                double v[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+                int fields = 0;
+                while (fields < 5 && parseNumber(q, lineEnd, v[fields])) ++fields;
+                while (q < lineEnd && isSeparator(*q)) ++q;
+
+                if ((fields != 3 && fields != 5) || q != lineEnd) {
+                    if (!result.errorAt) result.errorAt = p;
+                }
+                else {
+                    result.bodies.emplace_back(v[0],
+                        glm::vec2(static_cast<float>(v[1]), static_cast<float>(v[2])),
+                        glm::vec2(static_cast<float>(v[3]), static_cast<float>(v[4])));
+                }
+            }
+            p = (lineEnd == end) ? end : lineEnd + 1;
+        }
+    }
+}
+
+bool ScenarioLoader::load(const std::string& path, std::vector<MassObject>& out) {
+    MappedFile file(path);
+    if (!file.isOpen()) {
+        std::cerr << "Failed to open scenario file " << path << "\n";
+        return false;
+    }
+    if (!file.data) return true; // empty file, nothing to add
+
+    bool ok = (file.size >= 4 && std::memcmp(file.data, kMagic, 4) == 0)
+        ? loadBinary(file.data, file.size, out)
+        : loadText(file.data, file.size, out);
+    if (!ok) std::cerr << "Failed to load scenario " << path << "\n";
+    return ok;
+}
+
+bool ScenarioLoader::loadText(const char* data, size_t size, std::vector<MassObject>& out) {
+    // Split at line boundaries into roughly equal chunks
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(Parallel::getThreadCount() * 4, size / kMinChunkBytes));
+    std::vector<const char*> bounds;
+    bounds.push_back(data);
+    for (size_t c = 1; c < chunkCount; ++c) {
+        const char* p = std::max(bounds.back(), data + c * (size / chunkCount));
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(data + size - p)));
+        if (!nl) break;
+        bounds.push_back(nl + 1);
+    }
+    bounds.push_back(data + size);
+
+    std::vector<ChunkResult> results(bounds.size() - 1);
+    Parallel::parallelFor(0, results.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) parseChunk(bounds[c], bounds[c + 1], results[c]);
+    });
+
+    size_t total = 0;
+    for (const ChunkResult& r : results) {
+        if (r.errorAt) {
+            size_t line = 1 + static_cast<size_t>(std::count(data, r.errorAt, '\n'));
+            std::cerr << "Scenario parse error on line " << line << "\n";
+            return false;
+        }
+        total += r.bodies.size();
+    }
+
+    out.reserve(out.size() + total);
+    for (ChunkResult& r : results) {
+        out.insert(out.end(), r.bodies.begin(), r.bodies.end());
+    }
+    return true;
+}
+
+bool ScenarioLoader::loadBinary(const char* data, size_t size, std::vector<MassObject>& out) {
+    if (size < kHeaderSize || std::memcmp(data, kMagic, 4) != 0) return false;
+
+    uint32_t version;
+    uint64_t count;
+    std::memcpy(&version, data + 4, sizeof(version));
+    std::memcpy(&count, data + 8, sizeof(count));
+    if (version != kVersion || (size - kHeaderSize) / kRecordSize < count) {
+        std::cerr << "Scenario file is truncated or has an unknown version\n";
+        return false;
+    }
+
+    const size_t first = out.size();
+    out.resize(first + static_cast<size_t>(count));
+    const char* records = data + kHeaderSize;
+    Parallel::parallelFor(0, static_cast<size_t>(count), 1 << 16, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const char* r = records + i * kRecordSize;
+            double mass;
+            float f[4];
+            std::memcpy(&mass, r, sizeof(mass));
+            std::memcpy(f, r + 8, sizeof(f));
+            out[first + i] = MassObject(mass, glm::vec2(f[0], f[1]), glm::vec2(f[2], f[3]));
+        }
+    });
+    return true;
+}
+
+bool ScenarioLoader::saveBinary(const std::string& path, std::span<const MassObject> bodies) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open scenario file " << path << "\n";
+        return false;
+    }
+
+    const uint64_t count = bodies.size();
+    file.write(kMagic, sizeof(kMagic));
+    file.write(reinterpret_cast<const char*>(&kVersion), sizeof(kVersion));
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+    std::vector<char> buffer(std::min<size_t>(bodies.size(), 1 << 16) * kRecordSize);
+    for (size_t start = 0; start < bodies.size(); start += 1 << 16) {
+        size_t n = std::min<size_t>(bodies.size() - start, 1 << 16);
+        for (size_t i = 0; i < n; ++i) {
+            const MassObject& b = bodies[start + i];
+            double mass = b.getMass();
+            float f[4] = { b.getPosition().x, b.getPosition().y, b.getVelocity().x, b.getVelocity().y };
+            std::memcpy(buffer.data() + i * kRecordSize, &mass, sizeof(mass));
+            std::memcpy(buffer.data() + i * kRecordSize + 8, f, sizeof(f));
+        }
+        file.write(buffer.data(), static_cast<std::streamsize>(n * kRecordSize));
+    }
+    return static_cast<bool>(file);
+}
+
+bool ScenarioLoader::saveText(const std::string& path, std::span<const MassObject> bodies) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open scenario file " << path << "\n";
+        return false;
+    }
+
+    file << "# mass x y vx vy\n";
+    char line[160];
+    for (const MassObject& b : bodies) {
+        // Shortest round-trip representation
+        char* p = line;
+        char* end = line + sizeof(line);
+        double values[5] = { b.getMass(), b.getPosition().x, b.getPosition().y, b.getVelocity().x, b.getVelocity().y };
+        for (int k = 0; k < 5; ++k) {
+            if (k > 0) *p++ = ' ';
+            auto result = (k == 0) ? std::to_chars(p, end, values[k]) : std::to_chars(p, end, static_cast<float>(values[k]));
+            p = result.ptr;
+        }
+        *p++ = '\n';
+        file.write(line, p - line);
+    }
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "MassObject.h"
+#include <vector>
+#include <string>
+#include <span>
+
+// Initial-condition files
+//
+// Text (CSV or whitespace separated), one body per line:
+//   mass x y [vx vy]          mass in M☉, position in AU, velocity in AU/year
+// Lines starting with '#' or a letter (header rows) are skipped.
+//
+// Binary (.nbsc):
+//   "NBSC", uint32 version, uint64 count, count * { double mass, float x, y, vx, vy }
+//
+// Files are memory-mapped and text is parsed in parallel chunks with std::from_chars.
+namespace ScenarioLoader {
+    // Detects the format from the file contents and appends the bodies to 'out'
+    bool load(const std::string& path, std::vector<MassObject>& out);
+
+    bool loadText(const char* data, size_t size, std::vector<MassObject>& out);
+    bool loadBinary(const char* data, size_t size, std::vector<MassObject>& out);
+
+    bool saveBinary(const std::string& path, std::span<const MassObject> bodies);
+    bool saveText(const std::string& path, std::span<const MassObject> bodies);
+}
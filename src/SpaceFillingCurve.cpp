@@ -0,0 +1,86 @@
+#include "SpaceFillingCurve.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+    constexpr uint32_t kGridBits = 16;
+    constexpr uint32_t kGridSize = 1u << kGridBits;
+
+    // Spread the low 16 bits to the even bit positions
+    uint32_t spreadBits(uint32_t v) {
+        v &= 0xFFFFu;
+        v = (v | (v << 8)) & 0x00FF00FFu;
+        v = (v | (v << 4)) & 0x0F0F0F0Fu;
+        v = (v | (v << 2)) & 0x33333333u;
+        v = (v | (v << 1)) & 0x55555555u;
+        return v;
+    }
+
+    // Non-finite coordinates go to cell 0 instead of an undefined conversion
+    uint32_t toCell(float c) {
+        if (!(c > 0.0f)) return 0;
+        return static_cast<uint32_t>(std::min(c, static_cast<float>(kGridSize - 1)));
+    }
+}
+
+const char* SpaceFillingCurve::getCurveName(Curve curve) {
+    return curve == Curve::Hilbert ? "hilbert" : "morton";
+}
+
+uint32_t SpaceFillingCurve::mortonKey(uint32_t x, uint32_t y) {
+    return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+uint32_t SpaceFillingCurve::hilbertKey(uint32_t x, uint32_t y) {
+    x &= kGridSize - 1;
+    y &= kGridSize - 1;
+    uint32_t key = 0;
+    for (uint32_t s = kGridSize / 2; s > 0; s /= 2) {
+        const uint32_t rx = (x & s) ? 1u : 0u;
+        const uint32_t ry = (y & s) ? 1u : 0u;
+        key += s * s * ((3u * rx) ^ ry);
+        // Rotate the quadrant so the sub-curve is entered and left at the right corners
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+            std::swap(x, y);
+        }
+        x &= s - 1;
+        y &= s - 1;
+    }
+    return key;
+}
+
+std::vector<size_t> SpaceFillingCurve::sortOrder(const std::vector<MassObject>& bodies, Curve curve) {
+    const size_t n = bodies.size();
+    std::vector<size_t> order(n);
+    if (n == 0) return order;
+
+    glm::vec2 lo = bodies[0].getPosition();
+    glm::vec2 hi = lo;
+    for (const MassObject& body : bodies) {
+        lo = glm::min(lo, body.getPosition());
+        hi = glm::max(hi, body.getPosition());
+    }
+    // Square cell so the curve is not stretched along the longer axis
+    const float extent = std::max(hi.x - lo.x, hi.y - lo.y);
+    const float scale = extent > 0.0f ? static_cast<float>(kGridSize - 1) / extent : 0.0f;
+
+    std::vector<std::pair<uint32_t, uint32_t>> keys(n); // key, old slot
+    Parallel::parallelFor(0, n, 4096, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec2 cell = (bodies[i].getPosition() - lo) * scale;
+            uint32_t x = toCell(cell.x);
+            uint32_t y = toCell(cell.y);
+            keys[i] = { curve == Curve::Hilbert ? hilbertKey(x, y) : mortonKey(x, y), static_cast<uint32_t>(i) };
+        }
+    });
+    std::sort(keys.begin(), keys.end());
+
+    for (size_t i = 0; i < n; ++i) order[i] = keys[i].second;
+    return order;
+}
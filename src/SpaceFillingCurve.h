@@ -0,0 +1,22 @@
+#pragma once
+#include "MassObject.h"
+#include <cstdint>
+#include <vector>
+
+// Space-filling curve keys for sorting bodies so that neighbours in space are neighbours in memory
+namespace SpaceFillingCurve {
+    enum class Curve {
+        Morton,  // Z-order, bit interleaving, cheapest key
+        Hilbert  // no jumps between quadrants, slightly better locality
+    };
+
+    const char* getCurveName(Curve curve);
+
+    // Keys of a 2^16 x 2^16 grid cell
+    uint32_t mortonKey(uint32_t x, uint32_t y);
+    uint32_t hilbertKey(uint32_t x, uint32_t y);
+
+    // order[newSlot] = oldSlot, bodies sorted by the key of their position inside the bounding box
+    // (ties keep their current order)
+    std::vector<size_t> sortOrder(const std::vector<MassObject>& bodies, Curve curve);
+}
@@ -0,0 +1,76 @@
+#include "TaskGraph.h"
+#include <functional>
+#include <mutex>
+
+TaskGraph::Node TaskGraph::add(TaskScheduler::Task task, const std::vector<Node>& after, Affinity affinity) {
+    const Node id = nodes.size();
+    nodes.emplace_back();
+    NodeData& node = nodes.back();
+    node.task = std::move(task);
+    node.affinity = affinity;
+    for (Node predecessor : after) {
+        if (predecessor >= id) continue; // not added yet, would be a cycle
+        nodes[predecessor].successors.push_back(id);
+        ++node.predecessors;
+    }
+    return id;
+}
+
+void TaskGraph::run() {
+    if (nodes.empty()) return;
+
+    std::atomic<size_t> unfinished{ nodes.size() };
+    std::mutex callerMutex;
+    std::deque<Node> callerReady;
+    TaskScheduler::TaskGroup group;
+
+    std::function<void(Node)> schedule;
+    auto execute = [&](Node n) {
+        NodeData& node = nodes[n];
+        node.task();
+        for (Node successor : node.successors) {
+            if (nodes[successor].remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) schedule(successor);
+        }
+        if (unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1) TaskScheduler::notifyWaiters();
+    };
+    schedule = [&](Node n) {
+        if (nodes[n].affinity == Affinity::Caller) {
+            {
+                std::lock_guard<std::mutex> lock(callerMutex);
+                callerReady.push_back(n);
+            }
+            TaskScheduler::notifyWaiters();
+        }
+        else {
+            group.run([&execute, n] { execute(n); });
+        }
+    };
+
+    for (NodeData& node : nodes) node.remaining.store(node.predecessors, std::memory_order_relaxed);
+    for (Node n = 0; n < nodes.size(); ++n) {
+        if (nodes[n].predecessors == 0) schedule(n);
+    }
+
+    auto callerCanProceed = [&] {
+        if (unfinished.load(std::memory_order_acquire) == 0) return true;
+        std::lock_guard<std::mutex> lock(callerMutex);
+        return !callerReady.empty();
+    };
+
+    // Caller nodes first, otherwise help with whatever is queued or sleep until one is ready
+    while (unfinished.load(std::memory_order_acquire) != 0) {
+        Node next = 0;
+        bool ready = false;
+        {
+            std::lock_guard<std::mutex> lock(callerMutex);
+            if (!callerReady.empty()) {
+                next = callerReady.front();
+                callerReady.pop_front();
+                ready = true;
+            }
+        }
+        if (ready) execute(next);
+        else TaskScheduler::waitUntil(callerCanProceed);
+    }
+    group.wait();
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "TaskScheduler.h"
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+// Tasks with dependencies, run on the scheduler (see TaskScheduler.h).
+// A node becomes ready once every node it was added after has finished, independent ready
+// nodes overlap. Caller nodes always run on the thread that called run(), so a critical chain
+// stays on one thread (and inside its hardware-counter scopes) while side work spreads over
+// the workers; the caller helps with side work while its next node is not ready.
+class TaskGraph {
+public:
+    using Node = size_t;
+
+    enum class Affinity {
+        Any,    // any thread of the pool
+        Caller  // the thread that calls run()
+    };
+
+    // 'after' must name nodes added earlier, so the graph is acyclic by construction
+    Node add(TaskScheduler::Task task, const std::vector<Node>& after = {}, Affinity affinity = Affinity::Any);
+
+    // Run every node once and return when all have finished. Graphs can be run again
+    void run();
+
+    void clear() { nodes.clear(); }
+    size_t size() const { return nodes.size(); }
+
+private:
+    struct NodeData {
+        TaskScheduler::Task task;
+        std::vector<Node> successors;
+        unsigned predecessors = 0;
+        Affinity affinity = Affinity::Any;
+        std::atomic<unsigned> remaining{ 0 };
+    };
+
+    std::deque<NodeData> nodes; // deque: NodeData is not movable
+};
@@ -0,0 +1,391 @@
+#include "TaskScheduler.h"
+#include "Trace.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+using namespace TaskScheduler;
+
+namespace {
+    struct Item {
+        Task fn;
+        TaskGroup* group = nullptr;
+    };
+
+    // One deque per worker plus the shared queue, each on its own cache lines
+    struct alignas(64) Slot {
+        std::mutex mutex;
+        std::deque<Item> tasks;
+        std::atomic<size_t> size{ 0 }; // lets thieves skip empty deques without locking
+        std::atomic<uint64_t> executed{ 0 };
+        std::atomic<uint64_t> stolen{ 0 };
+        std::atomic<uint64_t> busyNanos{ 0 };
+    };
+
+    constexpr unsigned kShared = kMaxWorkers; // slot index of the shared queue
+
+    struct Pool {
+        std::array<Slot, kMaxWorkers + 1> slots;
+        std::atomic<unsigned> workers{ 0 }; // running workers, the deques thieves look at
+        std::atomic<size_t> queued{ 0 };     // tasks in all deques
+        std::atomic<bool> retiring{ false };
+
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        std::atomic<unsigned> sleepers{ 0 };
+
+        // Threads in waitUntil, woken by any push and by notifyWaiters
+        std::mutex waitMutex;
+        std::condition_variable waitWake;
+        std::atomic<unsigned> waiters{ 0 };
+
+        std::mutex controlMutex; // everything below
+        std::vector<std::thread> threads;
+        std::atomic<bool> started{ false };
+        unsigned requested = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        bool pin = false;
+    };
+
+    void stopWorkers(Pool& p);
+
+    // Created on first use, after the Trace registry, so the workers are joined before it goes away
+    Pool& pool() {
+        struct Owner {
+            Pool pool;
+            ~Owner() {
+                std::lock_guard<std::mutex> lock(pool.controlMutex);
+                stopWorkers(pool);
+            }
+        };
+        static Owner instance;
+        return instance.pool;
+    }
+
+    thread_local int workerIndex = -1;
+
+    constexpr int kSpins = 64; // yields before a worker or waiter with nothing to run sleeps
+
+    void push(Slot& slot, Item item, bool back) {
+        Pool& p = pool();
+        {
+            std::lock_guard<std::mutex> lock(slot.mutex);
+            if (back) slot.tasks.push_back(std::move(item));
+            else slot.tasks.push_front(std::move(item));
+            slot.size.store(slot.tasks.size(), std::memory_order_relaxed);
+        }
+        // Pairs with the sleeper's increment-then-check in workerLoop, one of the two sees the other
+        p.queued.fetch_add(1, std::memory_order_seq_cst);
+        if (p.sleepers.load(std::memory_order_seq_cst) > 0) {
+            { std::lock_guard<std::mutex> lock(p.sleepMutex); }
+            p.wake.notify_one();
+        }
+        if (p.waiters.load(std::memory_order_seq_cst) > 0) {
+            { std::lock_guard<std::mutex> lock(p.waitMutex); }
+            p.waitWake.notify_all();
+        }
+    }
+
+    bool pop(Slot& slot, bool back, Item& out) {
+        if (slot.size.load(std::memory_order_relaxed) == 0) return false;
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        if (slot.tasks.empty()) return false;
+        if (back) {
+            out = std::move(slot.tasks.back());
+            slot.tasks.pop_back();
+        }
+        else {
+            out = std::move(slot.tasks.front());
+            slot.tasks.pop_front();
+        }
+        slot.size.store(slot.tasks.size(), std::memory_order_relaxed);
+        pool().queued.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Own deque (newest first), the shared queue, then the other workers' oldest tasks, nearest first
+    bool findWork(int self, Item& out, bool& stolen) {
+        Pool& p = pool();
+        stolen = false;
+        if (self >= 0 && pop(p.slots[self], true, out)) return true;
+        if (p.queued.load(std::memory_order_relaxed) == 0) return false;
+        if (pop(p.slots[kShared], false, out)) return true;
+
+        const int workers = static_cast<int>(p.workers.load(std::memory_order_acquire));
+        const int origin = self >= 0 ? self : 0;
+        for (int d = self >= 0 ? 1 : 0; d < workers; ++d) {
+            for (int victim : { origin + d, origin - d }) {
+                if (victim < 0 || victim >= workers || victim == self) continue;
+                if (pop(p.slots[victim], false, out)) {
+                    stolen = true;
+                    return true;
+                }
+                if (d == 0) break;
+            }
+        }
+        return false;
+    }
+
+    void execute(int self, Item& item, bool stolen) {
+        Slot& stats = pool().slots[self >= 0 ? static_cast<unsigned>(self) : kShared];
+        auto start = std::chrono::steady_clock::now();
+        item.fn();
+        auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        stats.busyNanos.fetch_add(static_cast<uint64_t>(nanos), std::memory_order_relaxed);
+        stats.executed.fetch_add(1, std::memory_order_relaxed);
+        if (stolen) stats.stolen.fetch_add(1, std::memory_order_relaxed);
+        if (item.group) item.group->finishOne();
+    }
+
+    std::vector<unsigned> allowedCpus() {
+        std::vector<unsigned> cpus;
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (unsigned c = 0; c < CPU_SETSIZE; ++c) {
+                if (CPU_ISSET(c, &set)) cpus.push_back(c);
+            }
+        }
+#elif defined(_WIN32)
+        DWORD_PTR processMask = 0, systemMask = 0;
+        if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+            for (unsigned c = 0; c < sizeof(DWORD_PTR) * 8; ++c) {
+                if (processMask & (DWORD_PTR(1) << c)) cpus.push_back(c);
+            }
+        }
+#endif
+        return cpus;
+    }
+
+    bool pinCurrentThread(unsigned cpu) {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+        return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+
+    void workerLoop(int index, int cpu) {
+        Pool& p = pool();
+        workerIndex = index;
+        Trace::setThreadName("worker " + std::to_string(index));
+        if (cpu >= 0 && !pinCurrentThread(static_cast<unsigned>(cpu))) {
+            std::cerr << "Could not pin worker " << index << " to CPU " << cpu << "\n";
+        }
+
+        Item item;
+        bool stolen = false;
+        while (!p.retiring.load(std::memory_order_acquire)) {
+            if (findWork(index, item, stolen)) {
+                execute(index, item, stolen);
+                item = Item();
+                continue;
+            }
+            // A short spin keeps back-to-back loops from paying for a wakeup
+            bool found = false;
+            for (int spin = 0; spin < kSpins && !found; ++spin) {
+                std::this_thread::yield();
+                found = p.queued.load(std::memory_order_relaxed) > 0;
+            }
+            if (found) continue;
+
+            std::unique_lock<std::mutex> lock(p.sleepMutex);
+            p.sleepers.fetch_add(1, std::memory_order_seq_cst);
+            if (p.queued.load(std::memory_order_seq_cst) == 0 && !p.retiring.load(std::memory_order_acquire)) {
+                p.wake.wait(lock);
+            }
+            p.sleepers.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Callers hold controlMutex
+    void startWorkers(Pool& p) {
+        const unsigned count = std::min(p.requested, kMaxWorkers);
+        std::vector<unsigned> cpus = p.pin ? allowedCpus() : std::vector<unsigned>();
+        p.threads.reserve(count);
+        for (unsigned i = 0; i < count; ++i) {
+            int cpu = cpus.empty() ? -1 : static_cast<int>(cpus[(i + 1) % cpus.size()]);
+            p.threads.emplace_back(workerLoop, static_cast<int>(i), cpu);
+        }
+        p.workers.store(count, std::memory_order_release);
+        p.started.store(true, std::memory_order_release);
+    }
+
+    void stopWorkers(Pool& p) {
+        p.retiring.store(true, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(p.sleepMutex);
+            p.wake.notify_all();
+        }
+        for (auto& t : p.threads) t.join();
+        p.threads.clear();
+        p.workers.store(0, std::memory_order_release);
+        p.retiring.store(false, std::memory_order_release);
+
+        // Tasks left in the retired deques move to the shared queue, in their order
+        Item item;
+        for (unsigned i = 0; i < kMaxWorkers; ++i) {
+            while (pop(p.slots[i], false, item)) push(p.slots[kShared], std::move(item), true);
+        }
+    }
+
+    bool insideTask(const char* what) {
+        if (workerIndex < 0) return false;
+        std::cerr << "TaskScheduler::" << what << " called from a worker, ignored\n";
+        return true;
+    }
+
+    void ensureStarted() {
+        Pool& p = pool();
+        if (p.started.load(std::memory_order_acquire)) return;
+        std::lock_guard<std::mutex> lock(p.controlMutex);
+        if (!p.started.load(std::memory_order_relaxed)) startWorkers(p);
+    }
+}
+
+void TaskGroup::run(Task task) {
+    ensureStarted();
+    pending.fetch_add(1, std::memory_order_relaxed);
+    Pool& p = pool();
+    if (workerIndex >= 0) push(p.slots[workerIndex], Item{ std::move(task), this }, true);
+    else push(p.slots[kShared], Item{ std::move(task), this }, true);
+}
+
+void TaskGroup::wait() {
+    if (pending.load(std::memory_order_acquire) == 0) return;
+    waitUntil([this] { return pending.load(std::memory_order_acquire) == 0; });
+}
+
+void TaskGroup::finishOne() {
+    // The waiter may destroy the group once pending reads 0, so only the pool is touched after
+    if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) notifyWaiters();
+}
+
+void TaskScheduler::setWorkerCount(unsigned workers) {
+    if (insideTask("setWorkerCount")) return;
+    Pool& p = pool();
+    std::lock_guard<std::mutex> lock(p.controlMutex);
+    workers = std::min(workers, kMaxWorkers);
+    if (workers == p.requested) return;
+    p.requested = workers;
+    if (p.started.load(std::memory_order_relaxed)) {
+        stopWorkers(p);
+        startWorkers(p);
+    }
+}
+
+unsigned TaskScheduler::getWorkerCount() {
+    Pool& p = pool();
+    std::lock_guard<std::mutex> lock(p.controlMutex);
+    return p.requested;
+}
+
+void TaskScheduler::setPinning(bool pin) {
+    if (insideTask("setPinning")) return;
+    Pool& p = pool();
+    std::lock_guard<std::mutex> lock(p.controlMutex);
+    if (pin == p.pin) return;
+    p.pin = pin;
+    // Unpinning needs fresh threads too, a pinned thread keeps its mask
+    if (p.started.load(std::memory_order_relaxed)) {
+        stopWorkers(p);
+        startWorkers(p);
+    }
+}
+
+bool TaskScheduler::getPinning() {
+    Pool& p = pool();
+    std::lock_guard<std::mutex> lock(p.controlMutex);
+    return p.pin;
+}
+
+void TaskScheduler::restart() {
+    if (insideTask("restart")) return;
+    Pool& p = pool();
+    std::lock_guard<std::mutex> lock(p.controlMutex);
+    if (!p.started.load(std::memory_order_relaxed)) return; // started later anyway
+    stopWorkers(p);
+    startWorkers(p);
+}
+
+int TaskScheduler::getWorkerIndex() {
+    return workerIndex;
+}
+
+bool TaskScheduler::runOneTask() {
+    const int self = workerIndex;
+    Item item;
+    bool stolen = false;
+    if (!findWork(self, item, stolen)) return false;
+    execute(self, item, stolen);
+    return true;
+}
+
+void TaskScheduler::waitUntil(const std::function<bool()>& done) {
+    int idle = 0;
+    while (!done()) {
+        if (runOneTask()) {
+            idle = 0;
+            continue;
+        }
+        if (++idle < kSpins) {
+            std::this_thread::yield();
+            continue;
+        }
+        // done() is checked under waitMutex, which notifyWaiters takes before notifying, and the
+        // increment-then-check pairs with push() like a sleeping worker's
+        Pool& p = pool();
+        std::unique_lock<std::mutex> lock(p.waitMutex);
+        p.waiters.fetch_add(1, std::memory_order_seq_cst);
+        if (p.queued.load(std::memory_order_seq_cst) == 0 && !done()) p.waitWake.wait(lock);
+        p.waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void TaskScheduler::notifyWaiters() {
+    Pool& p = pool();
+    { std::lock_guard<std::mutex> lock(p.waitMutex); }
+    p.waitWake.notify_all();
+}
+
+TaskScheduler::Stats TaskScheduler::getStats() {
+    Pool& p = pool();
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(p.controlMutex);
+        stats.workers = p.started.load(std::memory_order_relaxed) ? p.workers.load(std::memory_order_relaxed) : p.requested;
+        stats.pinned = p.pin;
+    }
+    auto read = [](const Slot& slot) {
+        WorkerStats s;
+        s.tasks = slot.executed.load(std::memory_order_relaxed);
+        s.steals = slot.stolen.load(std::memory_order_relaxed);
+        s.busySeconds = slot.busyNanos.load(std::memory_order_relaxed) * 1e-9;
+        return s;
+    };
+    for (unsigned i = 0; i < stats.workers; ++i) stats.threads.push_back(read(p.slots[i]));
+    stats.threads.push_back(read(p.slots[kShared]));
+    return stats;
+}
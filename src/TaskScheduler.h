@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Persistent work-stealing pool behind every parallel loop (see Parallel.h).
+// Each worker owns a deque: it pushes and pops its own tasks at the back and, when that is empty,
+// takes from the shared queue and then steals from the front of the other workers' deques,
+// nearest index first. Threads outside the pool (main, diagnostics, I/O) queue on the shared
+// queue. A thread waiting for a group runs queued tasks until the group is done, so nested groups
+// need no extra threads. Workers start on first use, workers and waiters sleep while nothing is queued.
+namespace TaskScheduler {
+    using Task = std::function<void()>;
+
+    constexpr unsigned kMaxWorkers = 255;
+
+    // Fork-join group, the destructor waits
+    class TaskGroup {
+    public:
+        TaskGroup() = default;
+        ~TaskGroup() { wait(); }
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        // Queue on the calling worker's deque, or the shared queue outside the pool
+        void run(Task task);
+        // Run queued tasks (of any group) until every task of this one has finished
+        void wait();
+
+        // Scheduler internals: a queued task of this group finished
+        void finishOne();
+
+    private:
+        std::atomic<size_t> pending{ 0 };
+    };
+
+    // Worker threads besides the threads that wait (Parallel::setThreadCount(n) sets n - 1).
+    // Resizing lets running tasks finish, queued tasks move to the new workers. Not from a task
+    void setWorkerCount(unsigned workers);
+    unsigned getWorkerCount();
+
+    // Pin worker i to the (i + 1)-th CPU of the process affinity mask (Linux, Windows), the
+    // first CPU is left to the main thread. Steals already prefer neighbouring workers
+    void setPinning(bool pin);
+    bool getPinning();
+
+    // Stop and start the workers, e.g. so hardware counters opened now include them
+    void restart();
+
+    // Index of the calling worker, -1 outside the pool
+    int getWorkerIndex();
+
+    // Run one queued task on the calling thread, false if there was none
+    bool runOneTask();
+
+    // Run queued tasks until done() holds. With nothing queued the thread spins briefly and then
+    // sleeps until a task is queued or notifyWaiters() is called, so whatever makes done() true
+    // must call notifyWaiters() afterwards
+    void waitUntil(const std::function<bool()>& done);
+    void notifyWaiters();
+
+    struct WorkerStats {
+        uint64_t tasks = 0;       // executed
+        uint64_t steals = 0;      // of those, taken from another worker's deque
+        double busySeconds = 0.0; // running tasks
+    };
+
+    // Totals since start: one entry per worker, then threads outside the pool combined
+    struct Stats {
+        unsigned workers = 0;
+        bool pinned = false;
+        std::vector<WorkerStats> threads;
+    };
+    Stats getStats();
+}
@@ -0,0 +1,115 @@
+#include "TestParticles.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NBODY_TEST_PARTICLES_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+    constexpr size_t kBlock = 256; // test particles per chunk, their positions and sums stay in L1
+
+    // Massive bodies as structure of arrays, G*m folded in
+    struct Sources {
+        std::vector<float> x, y, gm;
+    };
+
+    // Accelerations of 'count' test particles, sources in the outer loop so the inner one runs over
+    // contiguous test particles. The SSE2 and scalar paths do the same float operations in the same order
+    void accumulate(const Sources& sources, const float* px, const float* py, float* ax, float* ay, size_t count, float softening) {
+        for (size_t j = 0; j < sources.gm.size(); ++j) {
+            const float sx = sources.x[j], sy = sources.y[j], gm = sources.gm[j];
+            size_t k = 0;
+#if NBODY_TEST_PARTICLES_SSE2
+            const __m128 vsx = _mm_set1_ps(sx), vsy = _mm_set1_ps(sy), vgm = _mm_set1_ps(gm);
+            const __m128 veps = _mm_set1_ps(softening), zero = _mm_setzero_ps();
+            for (; k + 4 <= count; k += 4) {
+                const __m128 dx = _mm_sub_ps(vsx, _mm_loadu_ps(px + k));
+                const __m128 dy = _mm_sub_ps(vsy, _mm_loadu_ps(py + k));
+                const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+                const __m128 d = _mm_sqrt_ps(d2);
+                const __m128 s = _mm_max_ps(d, veps);
+                __m128 scale = _mm_div_ps(vgm, _mm_mul_ps(_mm_mul_ps(s, s), d));
+                scale = _mm_and_ps(scale, _mm_cmpgt_ps(d2, zero)); // coincident: no force
+                _mm_storeu_ps(ax + k, _mm_add_ps(_mm_loadu_ps(ax + k), _mm_mul_ps(dx, scale)));
+                _mm_storeu_ps(ay + k, _mm_add_ps(_mm_loadu_ps(ay + k), _mm_mul_ps(dy, scale)));
+            }
+#endif
+            for (; k < count; ++k) {
+                const float dx = sx - px[k];
+                const float dy = sy - py[k];
+                const float d2 = dx * dx + dy * dy;
+                const float d = std::sqrt(d2);
+                const float s = std::max(d, softening);
+                const float scale = d2 > 0.0f ? gm / (s * s * d) : 0.0f;
+                ax[k] += dx * scale;
+                ay[k] += dy * scale;
+            }
+        }
+    }
+}
+
+bool TestParticles::split(const std::vector<MassObject>& bodies, std::vector<size_t>& tests, std::vector<size_t>& sources) {
+    tests.clear();
+    sources.clear();
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        if (bodies[i].isTestParticle()) tests.push_back(i);
+    }
+    if (tests.empty()) return false;
+
+    sources.reserve(bodies.size() - tests.size());
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        if (!bodies[i].isTestParticle()) sources.push_back(i);
+    }
+    return true;
+}
+
+void TestParticles::computeAccelerations(const std::vector<MassObject>& bodies, const std::vector<size_t>& tests, const std::vector<size_t>& sources,
+                                         double G, double softening, std::vector<glm::vec2>& accelerations) {
+    Sources massive;
+    massive.x.reserve(sources.size());
+    massive.y.reserve(sources.size());
+    massive.gm.reserve(sources.size());
+    for (size_t j : sources) {
+        massive.x.push_back(bodies[j].getPosition().x);
+        massive.y.push_back(bodies[j].getPosition().y);
+        massive.gm.push_back(static_cast<float>(G * bodies[j].getMass()));
+    }
+
+    const size_t blocks = (tests.size() + kBlock - 1) / kBlock;
+    Parallel::parallelFor(0, blocks, 1, [&](size_t begin, size_t end) {
+        float px[kBlock], py[kBlock], ax[kBlock], ay[kBlock];
+        for (size_t b = begin; b < end; ++b) {
+            const size_t first = b * kBlock;
+            const size_t count = std::min(kBlock, tests.size() - first);
+            for (size_t k = 0; k < count; ++k) {
+                const glm::vec2 p = bodies[tests[first + k]].getPosition();
+                px[k] = p.x;
+                py[k] = p.y;
+                ax[k] = ay[k] = 0.0f;
+            }
+            accumulate(massive, px, py, ax, ay, count, static_cast<float>(softening));
+            for (size_t k = 0; k < count; ++k) accelerations[tests[first + k]] = glm::vec2(ax[k], ay[k]);
+        }
+    });
+}
+
+std::vector<double> TestParticles::computePotentials(const std::vector<MassObject>& bodies, const std::vector<size_t>& tests,
+                                                     const std::vector<size_t>& sources, double G, double softening) {
+    std::vector<double> potentials(tests.size());
+    Parallel::parallelFor(0, tests.size(), kBlock, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            const glm::vec2 p = bodies[tests[k]].getPosition();
+            double phi = 0.0;
+            for (size_t j : sources) {
+                const glm::vec2 r = bodies[j].getPosition() - p;
+                const double dist = std::max(std::sqrt(static_cast<double>(r.x) * r.x + static_cast<double>(r.y) * r.y), softening);
+                phi -= bodies[j].getMass() / dist;
+            }
+            potentials[k] = G * phi;
+        }
+    });
+    return potentials;
+}
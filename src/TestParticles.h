@@ -0,0 +1,26 @@
+#pragma once
+#include "MassObject.h"
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+// Bodies flagged with MassObject::setTestParticle feel gravity but exert none, like asteroids or
+// debris around a few planets. Calculators leave them out of their sums and trees and get their
+// accelerations here, from a direct sum over the massive bodies: N_test * N_massive interactions
+// instead of a share of N² or of a tree over every body. A test particle's mass never enters its
+// motion, so it may be 0. Diagnostics count a test particle's pairs with the massive bodies once
+// and ignore pairs of test particles.
+namespace TestParticles {
+    // Slots of the test particles and of the massive bodies, in slot order. False if there are no test particles
+    bool split(const std::vector<MassObject>& bodies, std::vector<size_t>& tests, std::vector<size_t>& sources);
+
+    // Acceleration of each test particle from the sources with the calculators' softening law
+    // |a| = G*m_j / max(r, softening)², written to accelerations[tests[k]]. Chunks of test particles
+    // run in parallel, four at a time with SSE2 where available; results do not depend on either
+    void computeAccelerations(const std::vector<MassObject>& bodies, const std::vector<size_t>& tests, const std::vector<size_t>& sources,
+                              double G, double softening, std::vector<glm::vec2>& accelerations);
+
+    // Potential -sum_j G*m_j / max(r, softening) at each test particle from the sources, in double
+    std::vector<double> computePotentials(const std::vector<MassObject>& bodies, const std::vector<size_t>& tests,
+                                          const std::vector<size_t>& sources, double G, double softening);
+}
@@ -0,0 +1,173 @@
+#include "Trace.h"
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    struct Event {
+        const char* name;
+        uint64_t startNs;
+        uint64_t durationNs;
+    };
+
+    // Single writer (the owning thread), readers only see events published through 'count'
+    struct ThreadBuffer {
+        static constexpr size_t kChunkEvents = 4096;
+        static constexpr size_t kMaxChunks = 512; // 2M events per lane
+
+        uint32_t lane = 0;
+        std::string name;                          // guarded by registryMutex
+        std::array<std::atomic<Event*>, kMaxChunks> chunks{};
+        std::atomic<size_t> count{ 0 };
+        uint64_t generation = 0;                   // owner only
+        std::atomic<uint64_t> dropped{ 0 };
+
+        ~ThreadBuffer() {
+            for (auto& chunk : chunks) delete[] chunk.load();
+        }
+    };
+
+    std::mutex registryMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> lanes; // never shrinks, events outlive their threads
+    std::vector<ThreadBuffer*> freeLanes;             // lanes of exited threads, reused once they hold no current events
+
+    std::atomic<uint64_t> generation{ 1 };
+    std::atomic<uint64_t> startTimeNs{ 0 };
+
+    const std::chrono::steady_clock::time_point processStart = std::chrono::steady_clock::now();
+
+    // Returns the lane to the pool when the thread exits, so short-lived workers do not grow the registry
+    struct LaneHandle {
+        ThreadBuffer* buffer = nullptr;
+        ~LaneHandle() {
+            if (!buffer) return;
+            std::lock_guard<std::mutex> lock(registryMutex);
+            freeLanes.push_back(buffer);
+        }
+    };
+
+    ThreadBuffer& currentLane() {
+        thread_local LaneHandle handle;
+        if (!handle.buffer) {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            // Events of an earlier recording are skipped by the export and rewound by the new owner,
+            // the current recording's must stay on their own tid under their own thread's name
+            const uint64_t current = generation.load(std::memory_order_relaxed);
+            auto reusable = std::find_if(freeLanes.begin(), freeLanes.end(), [current](const ThreadBuffer* buffer) {
+                return buffer->generation != current || buffer->count.load(std::memory_order_relaxed) == 0;
+            });
+            if (reusable != freeLanes.end()) {
+                handle.buffer = *reusable;
+                freeLanes.erase(reusable);
+            }
+            else {
+                lanes.push_back(std::make_unique<ThreadBuffer>());
+                handle.buffer = lanes.back().get();
+                handle.buffer->lane = static_cast<uint32_t>(lanes.size());
+            }
+            // A reused lane must not keep the previous thread's name
+            handle.buffer->name = "worker " + std::to_string(handle.buffer->lane);
+        }
+        return *handle.buffer;
+    }
+
+    void writeEscaped(std::ostream& out, const std::string& text) {
+        for (char c : text) {
+            if (c == '"' || c == '\\') out << '\\';
+            out << c;
+        }
+    }
+}
+
+uint64_t Trace::nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - processStart).count());
+}
+
+void Trace::start() {
+    generation.fetch_add(1, std::memory_order_relaxed);
+    startTimeNs.store(nowNs(), std::memory_order_relaxed);
+    detail::enabled.store(true, std::memory_order_release);
+}
+
+void Trace::stop() {
+    detail::enabled.store(false, std::memory_order_release);
+}
+
+void Trace::setThreadName(const std::string& name) {
+    ThreadBuffer& buffer = currentLane();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    buffer.name = name;
+}
+
+void Trace::recordComplete(const char* name, uint64_t startNs, uint64_t durationNs) {
+    ThreadBuffer& buffer = currentLane();
+
+    // A new recording started, the owner rewinds its own buffer
+    uint64_t current = generation.load(std::memory_order_relaxed);
+    if (buffer.generation != current) {
+        buffer.generation = current;
+        buffer.count.store(0, std::memory_order_release);
+    }
+
+    size_t index = buffer.count.load(std::memory_order_relaxed);
+    size_t chunk = index / ThreadBuffer::kChunkEvents;
+    if (chunk >= ThreadBuffer::kMaxChunks) {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Event* events = buffer.chunks[chunk].load(std::memory_order_acquire);
+    if (!events) {
+        events = new Event[ThreadBuffer::kChunkEvents];
+        buffer.chunks[chunk].store(events, std::memory_order_release);
+    }
+    events[index % ThreadBuffer::kChunkEvents] = { name, startNs, durationNs };
+    buffer.count.store(index + 1, std::memory_order_release);
+}
+
+uint64_t Trace::getDroppedEvents() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    uint64_t dropped = 0;
+    for (const auto& lane : lanes) dropped += lane->dropped.load(std::memory_order_relaxed);
+    return dropped;
+}
+
+bool Trace::writeChromeJson(const std::string& path) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open trace file " << path << "\n";
+        return false;
+    }
+
+    const uint64_t since = startTimeNs.load(std::memory_order_relaxed);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    size_t written = 0;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto& lane : lanes) {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << lane->lane
+            << ",\"args\":{\"name\":\"";
+        writeEscaped(out, lane->name);
+        out << "\"}}";
+        first = false;
+
+        const size_t count = lane->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; ++i) {
+            const Event* events = lane->chunks[i / ThreadBuffer::kChunkEvents].load(std::memory_order_acquire);
+            const Event& e = events[i % ThreadBuffer::kChunkEvents];
+            if (e.startNs < since) continue; // left over from an earlier recording
+            out << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << lane->lane
+                << ",\"ts\":" << static_cast<double>(e.startNs) / 1000.0
+                << ",\"dur\":" << static_cast<double>(e.durationNs) / 1000.0 << "}";
+            ++written;
+        }
+    }
+    out << "\n]}\n";
+    std::cout << "Wrote " << written << " trace events to " << path << "\n";
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Per-thread timeline recording exported as Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev).
+// Each thread appends complete ("X") events to its own buffer without locks; the only cost while
+// tracing is off is one relaxed atomic load per scope. Define NBODY_DISABLE_TRACE to compile scopes out.
+namespace Trace {
+    // Start a new recording (earlier events are discarded) / stop recording
+    void start();
+    void stop();
+    inline bool isEnabled();
+
+    // Label the calling thread's lane in the trace viewer
+    void setThreadName(const std::string& name);
+
+    // Write every event recorded since start(), call after stop() for a complete file
+    bool writeChromeJson(const std::string& path);
+
+    // Events dropped because a thread's buffer was full
+    uint64_t getDroppedEvents();
+
+    // 'name' must be a string literal (only the pointer is stored)
+    void recordComplete(const char* name, uint64_t startNs, uint64_t durationNs);
+    uint64_t nowNs();
+
+    namespace detail {
+        inline std::atomic<bool> enabled{ false };
+    }
+
+    inline bool isEnabled() { return detail::enabled.load(std::memory_order_relaxed); }
+
+    class Scope {
+    public:
+        explicit Scope(const char* name) : name(isEnabled() ? name : nullptr) {
+            if (this->name) start = nowNs();
+        }
+        ~Scope() {
+            if (name) recordComplete(name, start, nowNs() - start);
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* name;
+        uint64_t start = 0;
+    };
+}
+
+#define NBODY_TRACE_CONCAT_INNER(a, b) a##b
+#define NBODY_TRACE_CONCAT(a, b) NBODY_TRACE_CONCAT_INNER(a, b)
+
+#ifdef NBODY_DISABLE_TRACE
+#define NBODY_TRACE_SCOPE(name) ((void)0)
+#else
+#define NBODY_TRACE_SCOPE(name) ::Trace::Scope NBODY_TRACE_CONCAT(traceScope_, __LINE__)(name)
+#endif
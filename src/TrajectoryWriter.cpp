@@ -0,0 +1,169 @@
+#include "TrajectoryWriter.h"
+#include "Trace.h"
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+RawTrajectorySink::RawTrajectorySink(const std::string& path)
+    : file(path, std::ios::binary | std::ios::trunc) {
+    if (!file.is_open()) {
+        std::cerr << "Failed to open trajectory file " << path << "\n";
+        return;
+    }
+    const char magic[4] = { 'N', 'B', 'T', 'R' };
+    const uint32_t version = 2;
+    file.write(magic, sizeof(magic));
+    file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+}
+
+size_t RawTrajectorySink::writeFrame(const TrajectoryFrame& frame) {
+    if (!file.is_open()) return 0;
+
+    const uint32_t count = static_cast<uint32_t>(frame.positions.size());
+    const size_t payload = count * sizeof(glm::vec2);
+
+    file.write(reinterpret_cast<const char*>(&frame.step), sizeof(frame.step));
+    file.write(reinterpret_cast<const char*>(&frame.time), sizeof(frame.time));
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    file.write(reinterpret_cast<const char*>(frame.positions.data()), payload);
+    file.write(reinterpret_cast<const char*>(frame.velocities.data()), payload);
+    if (frame.ids.size() == count) {
+        file.write(reinterpret_cast<const char*>(frame.ids.data()), count * sizeof(uint64_t));
+    }
+    else {
+        const std::vector<uint64_t> noIds(count, 0);
+        file.write(reinterpret_cast<const char*>(noIds.data()), count * sizeof(uint64_t));
+    }
+
+    if (!file) return 0;
+    return sizeof(frame.step) + sizeof(frame.time) + sizeof(count) + 2 * payload + count * sizeof(uint64_t);
+}
+
+void RawTrajectorySink::flush() {
+    if (file.is_open()) file.flush();
+}
+
+TrajectoryWriter::TrajectoryWriter(std::unique_ptr<TrajectorySink> sink, size_t queueCapacity, BackpressurePolicy policy)
+    : sink(std::move(sink)), policy(policy), capacity(std::max<size_t>(queueCapacity, 1)) {
+    // One buffer per queue slot plus the one the I/O thread is writing
+    freeFrames.reserve(capacity + 1);
+    for (size_t i = 0; i < capacity + 1; ++i) {
+        freeFrames.push_back(std::make_unique<TrajectoryFrame>());
+    }
+    metrics.queueCapacity = capacity;
+    ioThread = std::thread(&TrajectoryWriter::writerLoop, this);
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frameQueued.notify_all();
+    bufferReleased.notify_all();
+    if (ioThread.joinable()) ioThread.join();
+    if (sink) sink->flush();
+}
+
+bool TrajectoryWriter::submit(const std::vector<MassObject>& massObjects, uint64_t step, double time) {
+    std::unique_ptr<TrajectoryFrame> frame;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ++metrics.framesSubmitted;
+
+        if (freeFrames.empty()) {
+            if (policy == BackpressurePolicy::DropFrames) {
+                ++metrics.framesDropped;
+                return false;
+            }
+            bufferReleased.wait(lock, [this] { return !freeFrames.empty() || stopping; });
+            if (stopping) {
+                ++metrics.framesDropped;
+                return false;
+            }
+        }
+        frame = std::move(freeFrames.back());
+        freeFrames.pop_back();
+    }
+
+    // Copy outside the lock, the pooled vectors keep their capacity between frames
+    NBODY_TRACE_SCOPE("trajectory_snapshot");
+    const size_t n = massObjects.size();
+    frame->step = step;
+    frame->time = time;
+    frame->positions.resize(n);
+    frame->velocities.resize(n);
+    frame->ids.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        frame->positions[i] = massObjects[i].getPosition();
+        frame->velocities[i] = massObjects[i].getVelocity();
+        frame->ids[i] = massObjects[i].getId();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(std::move(frame));
+    }
+    frameQueued.notify_one();
+    return true;
+}
+
+void TrajectoryWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    bufferReleased.wait(lock, [this] { return (pending.empty() && !writing) || stopping; });
+    lock.unlock();
+    if (sink) sink->flush();
+}
+
+void TrajectoryWriter::setPolicy(BackpressurePolicy p) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        policy = p;
+    }
+    bufferReleased.notify_all();
+}
+
+BackpressurePolicy TrajectoryWriter::getPolicy() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return policy;
+}
+
+TrajectoryWriterMetrics TrajectoryWriter::getMetrics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    TrajectoryWriterMetrics m = metrics;
+    m.queueDepth = pending.size();
+    m.throughputMBps = (m.writeSeconds > 0.0) ? (static_cast<double>(m.bytesWritten) / (1024.0 * 1024.0)) / m.writeSeconds : 0.0;
+    return m;
+}
+
+void TrajectoryWriter::writerLoop() {
+    Trace::setThreadName("trajectory io");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        frameQueued.wait(lock, [this] { return !pending.empty() || stopping; });
+        if (pending.empty()) break; // stopping and fully drained
+
+        std::unique_ptr<TrajectoryFrame> frame = std::move(pending.front());
+        pending.pop_front();
+        writing = true;
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        size_t bytes = 0;
+        {
+            NBODY_TRACE_SCOPE("trajectory_write");
+            bytes = sink ? sink->writeFrame(*frame) : 0;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        lock.lock();
+        writing = false;
+        if (bytes > 0) {
+            ++metrics.framesWritten;
+            metrics.bytesWritten += bytes;
+        }
+        metrics.writeSeconds += seconds;
+        freeFrames.push_back(std::move(frame));
+        bufferReleased.notify_all();
+    }
+}
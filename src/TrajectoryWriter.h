@@ -0,0 +1,116 @@
+#pragma once
+#include "MassObject.h"
+#include <vector>
+#include <deque>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// One recorded simulation state (copied out of the body vector so the physics can keep stepping)
+struct TrajectoryFrame {
+    uint64_t step = 0;  // physics substep index
+    double time = 0.0;  // simulated time in years
+    std::vector<glm::vec2> positions;  // AU
+    std::vector<glm::vec2> velocities; // AU/year
+    std::vector<uint64_t> ids;         // stable body IDs, slots change when bodies are removed
+};
+
+// Abstract base class for trajectory output formats
+class TrajectorySink {
+public:
+    virtual ~TrajectorySink() = default;
+
+    // Write one frame, returns number of bytes written (0 on failure)
+    virtual size_t writeFrame(const TrajectoryFrame& frame) = 0;
+
+    // Push buffered data to disk
+    virtual void flush() {}
+
+    // False if the output could not be opened, such a sink is not recorded to
+    virtual bool isOpen() const { return true; }
+};
+
+// Uncompressed binary format:
+//   header: "NBTR" magic, uint32 version
+//   frame:  uint64 step, double time, uint32 count, count * vec2 positions, count * vec2 velocities,
+//           count * uint64 ids
+class RawTrajectorySink : public TrajectorySink {
+public:
+    RawTrajectorySink(const std::string& path);
+
+    bool isOpen() const override { return file.is_open(); }
+
+    size_t writeFrame(const TrajectoryFrame& frame) override;
+    void flush() override;
+
+private:
+    std::ofstream file;
+};
+
+// What to do when the I/O thread falls behind and every pooled buffer is in flight
+enum class BackpressurePolicy {
+    DropFrames, // skip the snapshot, the simulation never waits on disk
+    Block       // stall the caller until a buffer is free, no frame is lost
+};
+
+struct TrajectoryWriterMetrics {
+    uint64_t framesSubmitted = 0;
+    uint64_t framesWritten = 0;
+    uint64_t framesDropped = 0;
+    uint64_t bytesWritten = 0;
+    double writeSeconds = 0.0;     // time the I/O thread spent inside the sink
+    double throughputMBps = 0.0;   // bytesWritten / writeSeconds
+    size_t queueDepth = 0;         // frames waiting to be written
+    size_t queueCapacity = 0;
+};
+
+// Records snapshots on a dedicated I/O thread.
+// Snapshots are copied into pooled buffers and handed over through a bounded queue,
+// so submit() costs one memcpy-sized copy and never touches the file system.
+class TrajectoryWriter {
+public:
+    TrajectoryWriter(std::unique_ptr<TrajectorySink> sink,
+                     size_t queueCapacity = 8,
+                     BackpressurePolicy policy = BackpressurePolicy::DropFrames);
+    ~TrajectoryWriter(); // drains the queue and joins the I/O thread
+
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    // Copy the current state into a pooled buffer and queue it for writing
+    // Returns false if the frame was dropped because of back-pressure
+    bool submit(const std::vector<MassObject>& massObjects, uint64_t step, double time);
+
+    // Block until every queued frame has reached the sink
+    void flush();
+
+    void setPolicy(BackpressurePolicy p);
+    BackpressurePolicy getPolicy() const;
+
+    TrajectoryWriterMetrics getMetrics() const;
+
+private:
+    void writerLoop();
+
+    std::unique_ptr<TrajectorySink> sink;
+    BackpressurePolicy policy;
+    size_t capacity;
+
+    mutable std::mutex mutex;
+    std::condition_variable frameQueued;    // signals the I/O thread
+    std::condition_variable bufferReleased; // signals blocked producers and flush()
+
+    std::vector<std::unique_ptr<TrajectoryFrame>> freeFrames; // buffer pool
+    std::deque<std::unique_ptr<TrajectoryFrame>> pending;     // bounded queue
+    bool writing = false; // I/O thread currently holds a frame
+    bool stopping = false;
+
+    TrajectoryWriterMetrics metrics;
+
+    std::thread ioThread;
+};
@@ -7,8 +7,23 @@
 #include "Sphere.h"
 #include <iostream>
 #include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
 #include "Camera.h"
 #include "MassObjectTracker.h"
+#include "CompressedTrajectory.h"
+#include "InitialConditions.h"
+#include "AutoCalculator.h"
+#include "BarnesHutCalculator.h"
+#include "DiagnosticsMonitor.h"
+#include "Parallel.h"
+#include "PerfCounters.h"
+#include "Profiler.h"
+#include "TaskScheduler.h"
+#include "Trace.h"
+#include <thread>
+#include <vector>
 
 // Dear ImGui includes
 #include "imgui/imgui.h"
@@ -43,8 +58,10 @@ void main() {
 Camera camera;
 MassObjectTracker* globalMassTracker = nullptr; // For keyboard callbacks
 static float g_timeScale = 1.0f;
-static int forceCalcInUse = 0; //0 for BruteForce, 1 for Barnes-Hut, in use currently
+static int forceCalcInUse = 0; //0 for BruteForce, 1 for Barnes-Hut, 3 for Auto, in use currently
 static int forceCalculatorSelected = 0; //selected by user
+static std::string g_tracePath = "trace.json"; // Chrome trace output, --trace <file> starts recording at launch
+static bool g_asyncGrid = true; // evaluate the grid field on the workers while the physics runs
 
 // Basic ImGui interface function
 void createBasicGUI() {
@@ -76,10 +93,171 @@ void createBasicGUI() {
 
     ImGui::Text("Select Simulation Algorithm");
 
-    static const char* items[] = { "Direct Pairwise O(N²)", "Barnes-Hut Tree O(N log(N))", "Fast Multipole Method O(N)" };
+    static const char* items[] = { "Direct Pairwise O(N²)", "Barnes-Hut Tree O(N log(N))", "Fast Multipole Method O(N)", "Auto (measured)" };
     
     ImGui::Combo(" ", &forceCalculatorSelected, items, IM_ARRAYSIZE(items));
 
+    // Barnes-Hut node layout: pointer tree (kept between substeps) or flat depth-first array,
+    // walked per body or cell against cell
+    if (globalMassTracker) {
+        if (BarnesHutCalculator* tree = dynamic_cast<BarnesHutCalculator*>(globalMassTracker->getPhysicsEngine().getForceCalculator())) {
+            bool flat = tree->getFlatTree();
+            bool dual = tree->getDualTree();
+            int leafSize = static_cast<int>(tree->getLeafSize());
+            bool changed = ImGui::Checkbox("Flat tree", &flat);
+            if (flat) {
+                changed |= ImGui::SliderInt("Bodies per leaf", &leafSize, 1, 32);
+                changed |= ImGui::Checkbox("Dual-tree traversal", &dual);
+            }
+            if (changed) {
+                tree->setFlatTree(flat, static_cast<unsigned>(leafSize));
+                tree->setDualTree(flat && dual);
+            }
+            bool parallelBuild = tree->getParallelBuild();
+            if (ImGui::Checkbox("Parallel tree build", &parallelBuild)) tree->setParallelBuild(parallelBuild, tree->getTaskCutoff());
+
+            // Opening criterion of the per-body walks
+            if (!tree->getDualTree()) {
+                static const char* criteria[] = { "Geometric", "Bmax", "Relative acceleration" };
+                OpeningCriterion mac = tree->getOpeningCriterion();
+                int type = static_cast<int>(mac.type);
+                float alpha = static_cast<float>(mac.alpha);
+                bool macChanged = ImGui::Combo("Opening criterion", &type, criteria, IM_ARRAYSIZE(criteria));
+                if (type == static_cast<int>(OpeningCriterion::Type::RelativeAcceleration)) {
+                    macChanged |= ImGui::SliderFloat("Force error (alpha)", &alpha, 0.0001f, 0.05f, "%.4f", ImGuiSliderFlags_Logarithmic);
+                }
+                macChanged |= ImGui::Checkbox("Box distance check", &mac.boxCheck);
+                if (macChanged) {
+                    mac.type = static_cast<OpeningCriterion::Type>(type);
+                    mac.alpha = alpha;
+                    tree->setOpeningCriterion(mac);
+                }
+            }
+        }
+    }
+
+    // Autotuner state: the selection and every configuration timed by the last measurement
+    if (globalMassTracker) {
+        if (AutoCalculator* autoCalc = dynamic_cast<AutoCalculator*>(globalMassTracker->getPhysicsEngine().getForceCalculator())) {
+            // Every new target reruns the whole candidate sweep, so it is applied once the drag ends
+            static float draggedTarget = -1.0f; // value while the slider is held
+            float target = draggedTarget >= 0.0f ? draggedTarget : static_cast<float>(autoCalc->getErrorTarget());
+            ImGui::SliderFloat("p99 error target", &target, 0.001f, 0.5f, "%.3f", ImGuiSliderFlags_Logarithmic);
+            draggedTarget = ImGui::IsItemActive() ? target : -1.0f;
+            if (ImGui::IsItemDeactivatedAfterEdit()) autoCalc->setErrorTarget(target);
+            const TuningResult& selection = autoCalc->getSelection();
+            ImGui::Text("Using %s on %u thread(s): %.3f ms, p99 error %.2e%s", selection.calculator.c_str(), selection.threads,
+                selection.seconds * 1000.0, selection.error, autoCalc->isSelectionCached() ? " (cached)" : "");
+            if (ImGui::Button("Retune now")) autoCalc->requestRetune();
+            for (const TuningResult& r : autoCalc->getLastTuning()) {
+                ImGui::BulletText("%-8s x%-2u %8.3f ms  %.2e%s", r.calculator.c_str(), r.threads, r.seconds * 1000.0, r.error, r.meetsTarget ? "" : "  (over target)");
+            }
+        }
+    }
+
+    // Body storage order, sorted along a space-filling curve for cache locality
+    if (globalMassTracker) {
+        ImGui::Separator();
+        ImGui::Text("Memory Layout");
+
+        static const char* orders[] = { "Insertion order", "Morton (Z-order)", "Hilbert" };
+        const bool reordering = globalMassTracker->getReorderInterval() > 0;
+        int order = reordering ? (globalMassTracker->getReorderCurve() == SpaceFillingCurve::Curve::Morton ? 1 : 2) : 0;
+        int interval = reordering ? static_cast<int>(globalMassTracker->getReorderInterval()) : 1000;
+        bool changed = ImGui::Combo("Body order", &order, orders, IM_ARRAYSIZE(orders));
+        if (order > 0) changed |= ImGui::SliderInt("Reorder every N substeps", &interval, 10, 20000, "%d", ImGuiSliderFlags_Logarithmic);
+        if (changed) {
+            const auto curve = order == 1 ? SpaceFillingCurve::Curve::Morton : SpaceFillingCurve::Curve::Hilbert;
+            globalMassTracker->setReorderInterval(order > 0 ? static_cast<uint64_t>(interval) : 0, curve);
+        }
+
+        // Light bodies feel gravity but are left out of the sums and trees
+        static float testMassExponent = -9.0f; // log10 of the mass limit in M☉
+        ImGui::Text("Test particles: %zu", globalMassTracker->getTestParticleCount());
+        ImGui::SliderFloat("Test-particle mass (log10 M☉)", &testMassExponent, -15.0f, -3.0f, "%.1f");
+        if (ImGui::Button("Flag test particles")) globalMassTracker->setTestParticleMass(std::pow(10.0, testMassExponent));
+        ImGui::SameLine();
+        if (ImGui::Button("Clear flags")) globalMassTracker->setTestParticleMass(-1.0);
+    }
+
+    // Trajectory output, written by a background I/O thread
+    ImGui::Separator();
+    ImGui::Text("Trajectory Output");
+
+    static int recordInterval = 100;
+    static int recordPolicy = 0; // 0 = drop frames, 1 = block
+    static bool recordCompressed = true;
+    static float recordTolerance = 0.0f;         // AU, 0 = lossless
+    static float recordVelocityTolerance = 0.0f; // AU/year, 0 = lossless
+    static const char* policies[] = { "Drop frames", "Block" };
+    bool recording = globalMassTracker && globalMassTracker->isRecording();
+
+    if (!recording) {
+        ImGui::SliderInt("Every N substeps", &recordInterval, 1, 1000);
+        ImGui::Combo("When behind", &recordPolicy, policies, IM_ARRAYSIZE(policies));
+        ImGui::Checkbox("Compress", &recordCompressed);
+        if (recordCompressed) {
+            ImGui::InputFloat("Position tolerance (AU)", &recordTolerance, 0.0f, 0.0f, "%.1e");
+            ImGui::InputFloat("Velocity tolerance (AU/yr)", &recordVelocityTolerance, 0.0f, 0.0f, "%.1e");
+        }
+    }
+    if (ImGui::Checkbox("Record trajectory", &recording) && globalMassTracker) {
+        BackpressurePolicy policy = recordPolicy == 0 ? BackpressurePolicy::DropFrames : BackpressurePolicy::Block;
+        if (recording && recordCompressed) {
+            CompressionOptions options;
+            options.positionTolerance = std::max(0.0, static_cast<double>(recordTolerance));
+            options.velocityTolerance = std::max(0.0, static_cast<double>(recordVelocityTolerance));
+            globalMassTracker->startRecording(std::make_unique<CompressedTrajectorySink>("trajectory.nbtz", options),
+                static_cast<unsigned>(recordInterval), policy);
+        }
+        else if (recording) {
+            globalMassTracker->startRecording("trajectory.nbtr", static_cast<unsigned>(recordInterval), policy);
+        }
+        else {
+            globalMassTracker->stopRecording();
+        }
+    }
+    if (globalMassTracker && globalMassTracker->getPhysicsEngine().getTrajectoryWriter()) {
+        TrajectoryWriterMetrics m = globalMassTracker->getPhysicsEngine().getTrajectoryWriter()->getMetrics();
+        ImGui::Text("Frames: %llu written, %llu dropped", (unsigned long long)m.framesWritten, (unsigned long long)m.framesDropped);
+        ImGui::Text("Queue: %zu / %zu", m.queueDepth, m.queueCapacity);
+        ImGui::Text("Throughput: %.1f MB/s", m.throughputMBps);
+    }
+
+    // Diagnostics, measured on a background thread from published snapshots
+    DiagnosticsMonitor* monitor = globalMassTracker ? globalMassTracker->getPhysicsEngine().getDiagnosticsMonitor() : nullptr;
+    if (monitor) {
+        ImGui::Separator();
+        ImGui::Text("Diagnostics");
+
+        PhysicsEngine& engine = globalMassTracker->getPhysicsEngine();
+        int diagnosticsInterval = static_cast<int>(engine.getDiagnosticsInterval());
+        if (ImGui::SliderInt("Sample every N substeps", &diagnosticsInterval, 10, 20000)) {
+            engine.setDiagnosticsInterval(static_cast<unsigned>(diagnosticsInterval));
+        }
+
+        std::vector<DiagnosticsSample> samples = monitor->getHistory().snapshot();
+        if (!samples.empty()) {
+            static std::vector<float> drift;
+            drift.resize(samples.size());
+            for (size_t i = 0; i < samples.size(); ++i) drift[i] = static_cast<float>(samples[i].energyDrift * 100.0);
+            ImGui::PlotLines("Energy drift %", drift.data(), static_cast<int>(drift.size()), 0, nullptr, FLT_MAX, FLT_MAX, ImVec2(0, 60));
+
+            const DiagnosticsSample& s = samples.back();
+            const SystemDiagnostics& d = s.diagnostics;
+            ImGui::Text("t = %.3f yr, E = %.6e (drift %.4f%%)", d.time, d.totalEnergy, s.energyDrift * 100.0);
+            ImGui::Text("Virial 2K/|W| = %.4f", d.virialRatio);
+            ImGui::Text("|P| = %.3e, L = %.6e", glm::length(d.linearMomentum), d.angularMomentum);
+            ImGui::Text("COM = (%.3e, %.3e) AU", d.centreOfMass.x, d.centreOfMass.y);
+            ImGui::Text("State hash at step %llu: %016llx", (unsigned long long)s.step, (unsigned long long)d.stateHash);
+            ImGui::Text("Sample cost: %.2f ms, skipped %llu / %llu", s.computeSeconds * 1000.0,
+                (unsigned long long)monitor->getSnapshotsSkipped(), (unsigned long long)monitor->getSnapshotsPublished());
+        }
+        if (ImGui::Button("Reset energy baseline")) {
+            monitor->resetBaseline();
+        }
+    }
+
 
     // Add some simulation info
     ImGui::Separator();
@@ -93,6 +271,123 @@ void createBasicGUI() {
     ImGui::End();
 }
 
+// Rolling per-phase timings (see Profiler.h)
+void createPerformanceGUI() {
+    ImGui::Begin("Performance");
+
+    bool enabled = Profiler::isEnabled();
+    if (ImGui::Checkbox("Enable timers", &enabled)) {
+        Profiler::setEnabled(enabled);
+    }
+
+    // Per-thread timeline, written when recording is switched off
+    bool tracing = Trace::isEnabled();
+    if (ImGui::Checkbox("Record trace", &tracing)) {
+        if (tracing) {
+            Trace::start();
+        }
+        else {
+            Trace::stop();
+            Trace::writeChromeJson(g_tracePath);
+        }
+    }
+    ImGui::SameLine();
+    ImGui::TextDisabled("-> %s", g_tracePath.c_str());
+
+    // perf_event_open counters, opened on this thread so physics workers are inherited
+    bool counters = PerfCounters::isOpen();
+    if (ImGui::Checkbox("Hardware counters", &counters)) {
+        if (counters) PerfCounters::open();
+        else PerfCounters::close();
+    }
+    ImGui::Text("Frame: %.2f ms (%.0f FPS)", 1000.0f / std::max(ImGui::GetIO().Framerate, 1.0f), ImGui::GetIO().Framerate);
+
+    // Barnes-Hut opening statistics of the last frame, per body
+    Profiler::WalkTotals walk = Profiler::getLastFrameWalk();
+    if (walk.bodies > 0) {
+        double bodies = static_cast<double>(walk.bodies);
+        ImGui::Text("Walk: %.1f cells + %.1f bodies, %.1f nodes visited per body (max %llu), depth %u",
+            walk.nodeBody / bodies, walk.bodyBody / bodies, walk.nodesVisited / bodies,
+            static_cast<unsigned long long>(walk.maxBodyNodesVisited), walk.maxDepth);
+        if (walk.cellCell > 0) ImGui::Text("Dual tree: %.2f cell pairs per body", walk.cellCell / bodies);
+    }
+
+    // Work-stealing scheduler behind every parallel loop: threads = caller + workers
+    int threads = static_cast<int>(Parallel::getThreadCount());
+    if (ImGui::SliderInt("Threads", &threads, 1, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())) * 2)) {
+        Parallel::setThreadCount(static_cast<unsigned>(threads));
+    }
+    bool pin = TaskScheduler::getPinning();
+    if (ImGui::Checkbox("Pin workers", &pin)) {
+        TaskScheduler::setPinning(pin);
+    }
+    if (globalMassTracker) {
+        PhysicsEngine& engine = globalMassTracker->getPhysicsEngine();
+        bool pipelining = engine.getPipelining();
+        if (ImGui::Checkbox("Pipeline substeps", &pipelining)) {
+            engine.setPipelining(pipelining);
+        }
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("Grid during physics", &g_asyncGrid);
+    bool deterministic = Parallel::isDeterministic();
+    if (ImGui::Checkbox("Deterministic", &deterministic)) {
+        Parallel::setDeterministic(deterministic);
+        // The ranking changes with the mode, so the current pick may not be the one a fresh run would make
+        if (globalMassTracker) {
+            if (AutoCalculator* autoCalc = dynamic_cast<AutoCalculator*>(globalMassTracker->getPhysicsEngine().getForceCalculator())) {
+                autoCalc->requestRetune();
+            }
+        }
+    }
+    Profiler::SchedulerTotals scheduler = Profiler::getLastFrameScheduler();
+    ImGui::Text("Scheduler: %u workers, %llu tasks, %llu steals per frame", scheduler.workers,
+        static_cast<unsigned long long>(scheduler.tasks), static_cast<unsigned long long>(scheduler.steals));
+    if (scheduler.frameSeconds > 0.0 && ImGui::TreeNode("Worker utilisation")) {
+        for (size_t i = 0; i < scheduler.busySeconds.size(); ++i) {
+            float busy = static_cast<float>(std::min(1.0, scheduler.busySeconds[i] / scheduler.frameSeconds));
+            std::string label = i + 1 < scheduler.busySeconds.size() ? "worker " + std::to_string(i) : "outside pool";
+            ImGui::ProgressBar(busy, ImVec2(150, 0), label.c_str());
+        }
+        ImGui::TreePop();
+    }
+    ImGui::Separator();
+
+    static std::vector<float> samples;
+    for (size_t i = 0; i < Profiler::kPhaseCount; ++i) {
+        Profiler::Phase phase = static_cast<Profiler::Phase>(i);
+        Profiler::PhaseStats stats = Profiler::getStats(phase);
+        if (stats.samples == 0) continue;
+
+        const char* name = Profiler::getPhaseName(phase);
+        if (ImGui::TreeNode(name, "%-13s %7.3f ms/frame (%u calls)  p50 %.3f  p95 %.3f  max %.3f ms", name,
+                stats.lastFrameMs, stats.lastFrameCalls, stats.p50Ms, stats.p95Ms, stats.maxMs)) {
+            if (stats.hasCounters) {
+                // Per thousand instructions: high cache misses and low IPC = memory bound, high branch misses = branch bound
+                using PerfCounters::Counter;
+                auto value = [&](Counter c) { return static_cast<double>(stats.lastFrameCounters[static_cast<size_t>(c)]); };
+                double kilo = std::max(value(Counter::Instructions) / 1000.0, 1.0);
+                ImGui::Text("IPC %.2f  L1D miss/ki %.2f  LLC miss/ki %.2f  branch miss/ki %.2f",
+                    value(Counter::Instructions) / std::max(value(Counter::Cycles), 1.0),
+                    value(Counter::L1DMisses) / kilo, value(Counter::LLCMisses) / kilo, value(Counter::BranchMisses) / kilo);
+                if (PerfCounters::isAvailable(Counter::FpPacked)) {
+                    double fp = value(Counter::FpPacked) + value(Counter::FpScalar);
+                    ImGui::Text("Packed FP ops %.0f%%", fp > 0.0 ? 100.0 * value(Counter::FpPacked) / fp : 0.0);
+                }
+            }
+            Profiler::getRecentSamples(phase, samples);
+            ImGui::PlotLines("ms per call", samples.data(), static_cast<int>(samples.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 50));
+
+            float bins[Profiler::kHistogramBins];
+            for (size_t b = 0; b < Profiler::kHistogramBins; ++b) bins[b] = static_cast<float>(stats.histogram[b]);
+            ImGui::PlotHistogram("log2 us", bins, static_cast<int>(Profiler::kHistogramBins), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 50));
+            ImGui::TreePop();
+        }
+    }
+
+    ImGui::End();
+}
+
 void initializeCamera() {
     // Set camera for better grid visibility
     camera.setLookAt(glm::vec3(0.0f, 0.0f, 0.0f));  // Look at center
@@ -168,7 +463,96 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 }
 
 
-int main() {
+// Create realistic solar system example with proper astronomical units
+void addExampleSolarSystem(MassObjectTracker& massTracker) {
+    for (const MassObject& body : InitialConditions::exampleSolarSystem()) {
+        massTracker.addMassObject(body);
+    }
+}
+
+// Command line options, on a bad one
+void printUsage() {
+    std::cerr << "usage: NBodyProblem [--scenario file] [--generate plummer|disk|belt count] [--seed n] [--test-mass m]\n"
+              << "                    [--threads n] [--pin] [--deterministic] [--diagnostics-log file] [--stats file]\n"
+              << "                    [--trace file] [--counters]\n"
+              << "--generate belt adds test particles to the scenario or the example solar system, plummer and disk replace it\n";
+}
+
+int main(int argc, char** argv) {
+    // Command line options
+    std::string scenarioPath;  // --scenario <file>: load initial conditions (text or .nbsc)
+    std::string generatorKind; // --generate <plummer|disk|belt> <count>: built-in large-N test systems
+    size_t generatorCount = 0;
+    uint64_t generatorSeed = 1; // --seed <n>
+    std::string diagnosticsLogPath; // --diagnostics-log <file>: CSV of every diagnostics sample
+    std::string statsPath; // --stats <file>: per-frame phase timings as JSON lines
+    bool traceAtLaunch = false; // --trace <file>: record a Chrome trace from the start
+    bool countersAtLaunch = false; // --counters: hardware counters per profiled phase (Linux)
+    unsigned threadCount = 0; // --threads <n>: threads per parallel loop, 0 = hardware concurrency
+    bool pinWorkers = false;  // --pin: pin scheduler workers to CPUs
+    bool deterministic = false; // --deterministic: bitwise reproducible runs (see Parallel::setDeterministic)
+    double testParticleMass = -1.0; // --test-mass <m>: bodies up to this mass are test particles
+    int i = 1;
+    try {
+        for (; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--scenario" && i + 1 < argc) {
+                scenarioPath = argv[++i];
+            }
+            else if (arg == "--generate" && i + 2 < argc) {
+                generatorKind = argv[++i];
+                generatorCount = std::stoull(argv[++i]);
+            }
+            else if (arg == "--seed" && i + 1 < argc) {
+                generatorSeed = std::stoull(argv[++i]);
+            }
+            else if (arg == "--diagnostics-log" && i + 1 < argc) {
+                diagnosticsLogPath = argv[++i];
+            }
+            else if (arg == "--stats" && i + 1 < argc) {
+                statsPath = argv[++i];
+            }
+            else if (arg == "--trace" && i + 1 < argc) {
+                g_tracePath = argv[++i];
+                traceAtLaunch = true;
+            }
+            else if (arg == "--counters") {
+                countersAtLaunch = true;
+            }
+            else if (arg == "--threads" && i + 1 < argc) {
+                threadCount = static_cast<unsigned>(std::stoul(argv[++i]));
+            }
+            else if (arg == "--pin") {
+                pinWorkers = true;
+            }
+            else if (arg == "--deterministic") {
+                deterministic = true;
+            }
+            else if (arg == "--test-mass" && i + 1 < argc) {
+                testParticleMass = std::stod(argv[++i]);
+            }
+        }
+    }
+    catch (const std::logic_error&) { // std::invalid_argument or std::out_of_range from the sto* calls
+        std::cerr << "Invalid number " << argv[i] << "\n";
+        printUsage();
+        return 1;
+    }
+    // A Plummer sphere or disk replaces the initial conditions, the belt is added to them
+    if (!scenarioPath.empty() && (generatorKind == "plummer" || generatorKind == "disk")) {
+        std::cerr << "--generate " << generatorKind << " replaces the scenario, it cannot be combined with --scenario\n";
+        printUsage();
+        return 1;
+    }
+    if (!generatorKind.empty() && generatorKind != "plummer" && generatorKind != "disk" && generatorKind != "belt") {
+        std::cerr << "Unknown system " << generatorKind << " for --generate\n";
+        printUsage();
+        return 1;
+    }
+    Parallel::setDeterministic(deterministic);
+    if (threadCount != 0) Parallel::setThreadCount(threadCount);
+    TaskScheduler::setPinning(pinWorkers);
+
     // Initialize GLFW
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW\n";
@@ -316,37 +700,31 @@ int main() {
     MassObjectTracker massTracker;
     globalMassTracker = &massTracker; // Set global pointer for keyboard callbacks
     
-    // Create realistic solar system example with proper astronomical units
-    // All masses in solar masses (MS), distances in AU, velocities in AU/year
-    // 
-    // REAL-WORLD ORBITAL VELOCITIES (for G = 39.478 AU^3/(MS·year²)):
-    // Formula: v = sqrt(G*M/r) for circular orbit around central mass M
-    // - Earth at 1 AU: v = √(39.478*1.0/1.0) = 6.28 AU/year ≈ 29.8 km/s
-    // - Jupiter at 5.2 AU: v = sqrt(39.478*1.0/5.2) = 2.76 AU/year ≈ 13.1 km/s
-    // - Mars at 1.52 AU: v = sqrt(39.478*1.0/1.52) = 5.07 AU/year ≈ 24.1 km/s
-    
-    // Sun (1 solar mass at origin, stationary)
-    massTracker.addMassObject(MassObject(1.0, glm::vec2(0.0f, 0.0f), glm::vec2(0.0f, 0.0f)));
-    
-    // Using real orbital velocities
-    // Jupiter (0.001 solar masses at 5.2 AU with real orbital velocity)
-    massTracker.addMassObject(MassObject(0.001, glm::vec2(5.2f, 0.0f), glm::vec2(0.0f, 2.76f)));
-    //Ganymede, jupiters biggest moon (7.5×10^-9 solar masses, 0.0071 AU orbit 2.29 AU orbital velo)
-    massTracker.addMassObject(MassObject(7.5e-9, glm::vec2(5.2071f, 0.0f), glm::vec2(0.0f, -2.29f)));
-
-
-    
-    // Earth (3×10⁻⁶ solar masses at 1 AU with real orbital velocity) 
-    massTracker.addMassObject(MassObject(3e-6, glm::vec2(1.0f, 0.0f), glm::vec2(0.0f, 6.28f)));
-    
-    // Mars (3.2×10⁻⁷ solar masses at 1.52 AU with real orbital velocity)
-    massTracker.addMassObject(MassObject(3.2e-7, glm::vec2(1.52f, 0.0f), glm::vec2(0.0f, 5.07f)));
-    
-    // Large asteroid (10⁻¹⁰ solar masses in asteroid belt at 2.8 AU)
-    massTracker.addMassObject(MassObject(1e-10, glm::vec2(2.8f, 0.0f), glm::vec2(0.0f, 3.76f)));
+    // Initial conditions: scenario file from the command line, or the example solar system
+    if (generatorKind == "plummer") {
+        massTracker.addBodies(InitialConditions::generatePlummer(generatorCount, 1.0, 5.0, 39.478, generatorSeed));
+    }
+    else if (generatorKind == "disk") {
+        massTracker.addBodies(InitialConditions::generateExponentialDisk(generatorCount, 0.1, 3.0, 1.0, 39.478, generatorSeed));
+    }
+    else if (scenarioPath.empty() || !massTracker.loadScenario(scenarioPath)) {
+        addExampleSolarSystem(massTracker);
+    }
+    if (generatorKind == "belt") { // asteroid belt around the example Sun, as test particles
+        std::vector<MassObject> belt = InitialConditions::generateKeplerBelt(generatorCount, 2.1, 3.3, 1e-10, 0.1, 1.0, 39.478, generatorSeed);
+        for (MassObject& body : belt) body.setTestParticle(true);
+        massTracker.addBodies(belt);
+    }
+    if (testParticleMass >= 0.0) massTracker.setTestParticleMass(testParticleMass);
     
     // Configure physics timestep for real astronomical values (needs smaller timestep)
     massTracker.getPhysicsEngine().setPhysicsTimestep(0.0001); // 0.0001 years ≈ 0.88 hours
+    massTracker.setReorderInterval(1000, SpaceFillingCurve::Curve::Hilbert); // keep neighbours adjacent in memory
+
+    // Energy/momentum diagnostics run off the render thread (every 0.1 simulated years)
+    auto diagnosticsMonitor = std::make_unique<DiagnosticsMonitor>();
+    if (!diagnosticsLogPath.empty()) diagnosticsMonitor->setLogFile(diagnosticsLogPath);
+    massTracker.getPhysicsEngine().setDiagnosticsMonitor(std::move(diagnosticsMonitor), 1000);
     
     // Display system information
     std::cout << "=== N-Body Solar System Simulation ===" << std::endl;
@@ -362,14 +740,18 @@ int main() {
     std::cout << "Controls: SPACE=physics on/off, E=Euler, V=Verlet" << std::endl;
     std::cout << "=========================================" << std::endl;
 
-    // Variables for timing and energy monitoring
+    if (!statsPath.empty()) Profiler::openStatsStream(statsPath);
+    Trace::setThreadName("main");
+    if (traceAtLaunch) Trace::start();
+    if (countersAtLaunch) PerfCounters::open(); // after the diagnostics thread, which is not counted
+
+    // Variables for timing
     double lastTime = glfwGetTime();
-    double physicsTime = 0.0;
-    double initialEnergy = massTracker.getPhysicsEngine().calculateTotalEnergy(massTracker.getMassObjects());
-    double energyCheckTimer = 0.0;
+    std::vector<MassObject> gridBodies; // snapshot read by the grid task
 
     // Main loop
     while (!glfwWindowShouldClose(window)) {
+        NBODY_TRACE_SCOPE("frame");
         glfwPollEvents();
         
         // Start the Dear ImGui frame
@@ -383,10 +765,27 @@ int main() {
         double deltaTime = currentTime - lastTime;
         lastTime = currentTime;
 
+        // Grid field of the bodies as they are before this frame's physics, evaluated on the workers
+        // while the physics runs; it trails the spheres by one frame, which the smoothing hides
+        // The checkbox can change while the task runs, so the flag is read once and applies from the next frame
+        const bool asyncGrid = g_asyncGrid;
+        std::vector<float> gridVertices;
+        TaskScheduler::TaskGroup gridTask;
+        if (asyncGrid) {
+            gridBodies.assign(massTracker.getMassObjects().begin(), massTracker.getMassObjects().end());
+            gridTask.run([&gridVertices, &gridBodies] {
+                GridGenerator gg;
+                gridVertices = gg.generateGridVertices(20, 0.5f, gridBodies);
+            });
+        }
+
         // Update physics (limit to prevent huge time steps)
         double clampedDeltaTime = std::min(deltaTime, 0.02); // Max 20ms per frame
         double scaledDeltaTime = clampedDeltaTime * static_cast<double>(g_timeScale);
-        massTracker.updatePhysics(scaledDeltaTime);
+        {
+            NBODY_TRACE_SCOPE("physics");
+            massTracker.updatePhysics(scaledDeltaTime);
+        }
         if (forceCalculatorSelected != forceCalcInUse) {
             forceCalcInUse = forceCalculatorSelected;
             if (forceCalculatorSelected == 0) { //brute force
@@ -395,21 +794,14 @@ int main() {
             else if (forceCalculatorSelected == 1) {
                 massTracker.switchToBarnesHut();
             }
-        }
-
-        physicsTime += scaledDeltaTime;
-
-        // Monitor energy conservation (print every 2 seconds of simulation time)
-        energyCheckTimer += scaledDeltaTime;
-        if (energyCheckTimer >= 2.0) {
-            double currentEnergy = massTracker.getPhysicsEngine().calculateTotalEnergy(massTracker.getMassObjects());
-            double energyChange = ((currentEnergy - initialEnergy) / initialEnergy) * 100.0;
-            std::cout << "Energy change: " << energyChange << "% (Time: " << physicsTime << ")\n";
-            energyCheckTimer = 0.0;
+            else if (forceCalculatorSelected == 3) {
+                massTracker.switchToAuto();
+            }
         }
 
         // Create ImGui interface
         createBasicGUI();
+        createPerformanceGUI();
         
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -431,40 +823,63 @@ int main() {
         glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
         // Update grid vertices based on current gravitational field
-        GridGenerator gg;
-
-        std::vector<float> gridVertices = gg.generateGridVertices(20, 0.5f, massTracker.getMassObjects());
+        if (asyncGrid) {
+            gridTask.wait();
+        }
+        else {
+            GridGenerator gg;
+            gridVertices = gg.generateGridVertices(20, 0.5f, massTracker.getMassObjects());
+        }
         
-        // Update the existing grid buffer with new data
-        glBindBuffer(GL_ARRAY_BUFFER, gridVBO);
-        glBufferData(GL_ARRAY_BUFFER, gridVertices.size() * sizeof(float), gridVertices.data(), GL_DYNAMIC_DRAW);
-
-        // Draw grid
-        glm::mat4 gridModel = glm::mat4(1.0f);
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(gridModel));
-        glUniform4f(colorLoc, 0.8f, 0.8f, 0.8f, 1.0f);
-        glBindVertexArray(gridVAO);
-        glDrawArrays(GL_LINES, 0, gridVertices.size() / 3);
-
-        // Draw spheres from mass objects
-        glBindVertexArray(sphereGeometry.VAO);
         std::vector<Sphere> spheres = massTracker.getAllSpheres();
-        for (const auto& sphere : spheres) {
-            glm::mat4 sphereModel = sphere.getModelMatrix();
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(sphereModel));
+
+        // GL submission (grid upload + draw calls), ImGui and the swap are not included
+        {
+            Profiler::ScopedTimer timer(Profiler::Phase::GLSubmit);
+            NBODY_TRACE_SCOPE("gl_submit");
+            // Update the existing grid buffer with new data
+            glBindBuffer(GL_ARRAY_BUFFER, gridVBO);
+            glBufferData(GL_ARRAY_BUFFER, gridVertices.size() * sizeof(float), gridVertices.data(), GL_DYNAMIC_DRAW);
+
+            // Draw grid
+            glm::mat4 gridModel = glm::mat4(1.0f);
+            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(gridModel));
+            glUniform4f(colorLoc, 0.8f, 0.8f, 0.8f, 1.0f);
+            glBindVertexArray(gridVAO);
+            glDrawArrays(GL_LINES, 0, gridVertices.size() / 3);
+
+            // Draw spheres from mass objects
+            glBindVertexArray(sphereGeometry.VAO);
+            for (const auto& sphere : spheres) {
+                glm::mat4 sphereModel = sphere.getModelMatrix();
+                glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(sphereModel));
             
-            const glm::vec4& sphereColor = sphere.getColor();
-            glUniform4f(colorLoc, sphereColor.r, sphereColor.g, sphereColor.b, sphereColor.a);
+                const glm::vec4& sphereColor = sphere.getColor();
+                glUniform4f(colorLoc, sphereColor.r, sphereColor.g, sphereColor.b, sphereColor.a);
             
-            glDrawElements(GL_TRIANGLES, sphereGeometry.vertexCount, GL_UNSIGNED_INT, 0);
+                glDrawElements(GL_TRIANGLES, sphereGeometry.vertexCount, GL_UNSIGNED_INT, 0);
+            }
         }
 
         // Render ImGui
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        {
+            NBODY_TRACE_SCOPE("imgui");
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+
+        {
+            NBODY_TRACE_SCOPE("swap");
+            glfwSwapBuffers(window);
+        }
+        Profiler::endFrame();
+    }
 
-        glfwSwapBuffers(window);
+    if (Trace::isEnabled()) {
+        Trace::stop();
+        Trace::writeChromeJson(g_tracePath);
     }
+    PerfCounters::close();
 
     // Cleanup ImGui
     ImGui_ImplOpenGL3_Shutdown();